@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <string.h>
+#include "flog/flog.h"
+#include "recording_painter.h"
+#include "backend/software/painter.h"
+#ifdef GFX_HAS_OFFSCREEN
+#include "backend/opengl/offscreen.h"
+#endif
+#include <stdexcept>
+#include <functional>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.141592653589793238462643383279502884197
+#endif
+
+struct FontFile {
+    const char* file;
+    const char* name;
+};
+
+// Fonts bundled under vendor/res
+const FontFile FONT_FILES[] = {
+    { "Roboto-Black.ttf",       "Roboto Black" },
+    { "Roboto-Bold.ttf",        "Roboto Bold" },
+    { "Roboto-Medium.ttf",      "Roboto Medium" },
+    { "Roboto-Regular.ttf",     "Roboto Regular" },
+    { "Roboto-Thin.ttf",        "Roboto Thin" },
+    { "OpenSans-Medium.ttf",    "Open Sans Medium" },
+    { "OpenSans-Regular.ttf",   "Open Sans Regular" },
+    { "NotoSans-Medium.ttf",    "Noto Sans Medium" },
+    { "NotoSans-Regular.ttf",   "Noto Sans Regular" },
+    { "arial.ttf",              "Arial Regular" }
+};
+
+const char* PARAGRAPH[] = {
+    "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore et dolore magna aliqua.",
+    "Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. 0123456789",
+    "Duis aute irure dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur. Excepteur sint.",
+    "The quick brown fox jumps over the lazy dog. THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG. Ünïcödé àéîõü ß ÆØÅ."
+};
+
+/**
+ * Painter backend under test.
+*/
+class Backend {
+public:
+    virtual ~Backend() {}
+    virtual const char* getName() = 0;
+    virtual gfx::Painter& getPainter() = 0;
+    virtual void loadFont(const std::string& path) = 0;
+    virtual void beginFrame() = 0;
+    virtual void submitFrame() = 0;
+    virtual void finishFrame() = 0;
+    virtual void compile(const gfx::RecordingPainter& recording) = 0;
+    virtual void drawCompiled() = 0;
+    virtual void resetStats() = 0;
+    virtual std::string getStats(int frames) = 0;
+};
+
+class SoftwareBackend : public Backend {
+public:
+    SoftwareBackend(const gfx::Sizei& size, int threads) : painter(size, threads) {}
+    const char* getName() { return "software"; }
+    gfx::Painter& getPainter() { return painter; }
+    void loadFont(const std::string& path) { painter.fc.loadFont(path); }
+    void beginFrame() {
+        painter.beginRender();
+        painter.clear(gfx::Color(0.05f, 0.05f, 0.05f, 1.0f));
+    }
+    void submitFrame() {}
+    void finishFrame() {
+        painter.endRender();
+        commands += painter.getStats().commands;
+        tiles += painter.getStats().tiles;
+    }
+    void compile(const gfx::RecordingPainter& recording) { this->recording = &recording; }
+    void drawCompiled() { recording->replay(painter); }
+    void resetStats() { commands = 0; tiles = 0; }
+    std::string getStats(int frames) {
+        char buf[128];
+        sprintf(buf, "%10.0f commands %8.0f tiles", (double)commands / frames, (double)tiles / frames);
+        return buf;
+    }
+
+private:
+    gfx::Software::Painter painter;
+    const gfx::RecordingPainter* recording = NULL;
+    int64_t commands = 0;
+    int64_t tiles = 0;
+};
+
+#ifdef GFX_HAS_OFFSCREEN
+class OpenGLBackend : public Backend {
+public:
+    OpenGLBackend(const gfx::Sizei& size, bool streaming, bool distanceFields) : ctx(size) {
+        ctx.getPainter().setStreaming(streaming && ctx.getPainter().getStreaming());
+        if (distanceFields) { ctx.getPainter().fc->setGlyphMode(gfx::OpenGL::GLYPH_MODE_SDF); }
+    }
+    const char* getName() { return "opengl"; }
+    gfx::Painter& getPainter() { return ctx.getPainter(); }
+    void loadFont(const std::string& path) { ctx.getPainter().fc->loadFont(path); }
+    void beginFrame() { ctx.beginFrame(gfx::Color(0.05f, 0.05f, 0.05f, 1.0f)); }
+    void submitFrame() {
+        ctx.getPainter().endRender();
+    }
+    void finishFrame() {
+        glFinish();
+        const auto& stats = ctx.getPainter().getStats();
+        vertices += stats.vertices;
+        quads += stats.quads;
+        flushes += stats.flushes;
+    }
+    void compile(const gfx::RecordingPainter& recording) { ctx.getPainter().compile(recording, list); }
+    void drawCompiled() { ctx.getPainter().drawDisplayList(list); }
+    void resetStats() { vertices = 0; quads = 0; flushes = 0; }
+    std::string getStats(int frames) {
+        char buf[128];
+        sprintf(buf, "%10.0f vertices %8.0f quads %8.1f flushes", (double)vertices / frames, (double)quads / frames, (double)flushes / frames);
+        return buf;
+    }
+
+private:
+    gfx::OpenGL::OffscreenContext ctx;
+    gfx::OpenGL::DisplayList list;
+    int64_t vertices = 0;
+    int64_t quads = 0;
+    int64_t flushes = 0;
+};
+#endif
+
+struct Workload {
+    const char* name;
+    std::function<void(gfx::Painter&, int)> draw;
+};
+
+const gfx::Sizei CANVAS_SIZE(1280, 720);
+
+std::vector<Workload> createWorkloads(std::vector<gfx::Font>& fonts) {
+    std::vector<Workload> workloads;
+
+    // 10k small filled rectangles
+    workloads.push_back({ "rects", [](gfx::Painter& painter, int frame) {
+        for (int i = 0; i < 10000; i++) {
+            float x = (float)((i * 37 + frame) % (CANVAS_SIZE.x - 20));
+            float y = (float)((i * 53) % (CANVAS_SIZE.y - 20));
+            painter.fillRect(gfx::Rect(gfx::Point(x, y), gfx::Size(16, 12)), gfx::Color((i & 0xFF) / 255.0f, 0.5f, 0.8f, 1.0f));
+        }
+    }});
+
+    // Dense paragraphs in every bundled font
+    workloads.push_back({ "text", [&fonts](gfx::Painter& painter, int frame) {
+        float y = 14.0f;
+        for (auto& font : fonts) {
+            for (int l = 0; l < 4; l++) {
+                painter.drawText(gfx::Point(4.0f + (frame & 3) * 0.25f, y), PARAGRAPH[l], font, gfx::Color(1.0f, 1.0f, 1.0f, 1.0f));
+                y += 17.0f;
+            }
+        }
+    }});
+
+    // Dashboard-like text in many sizes
+    std::vector<gfx::Font> sized;
+    for (int size = 8; size < 40; size++) {
+        sized.push_back(gfx::Font(fonts[size % fonts.size()].getName(), size));
+    }
+    workloads.push_back({ "sizes", [sized](gfx::Painter& painter, int) mutable {
+        float y = 0.0f;
+        for (auto& font : sized) {
+            y += font.getSize() * 0.9f;
+            painter.drawText(gfx::Point(4.0f, y), "Pressure 1013.25 hPa", font, gfx::Color(1.0f, 1.0f, 1.0f, 1.0f));
+            painter.drawText(gfx::Point(640.0f, y), PARAGRAPH[0], font, gfx::Color(0.8f, 0.8f, 0.8f, 1.0f));
+        }
+    }});
+
+    // Text whose size keeps changing, which cycles through more glyphs than the font cache keeps
+    std::vector<gfx::Font> churning;
+    for (int size = 8; size < 72; size++) {
+        churning.push_back(gfx::Font(fonts[size % fonts.size()].getName(), size));
+    }
+    workloads.push_back({ "churn", [churning](gfx::Painter& painter, int frame) mutable {
+        float y = 0.0f;
+        for (int i = 0; i < 4; i++) {
+            gfx::Font& font = churning[(frame * 4 + i) % churning.size()];
+            y += font.getSize();
+            painter.drawText(gfx::Point(4.0f + (frame & 3) * 0.25f, y), PARAGRAPH[i], font, gfx::Color(1.0f, 1.0f, 1.0f, 1.0f));
+        }
+    }});
+
+    // Widget-like labels on backgrounds, alternating between shapes and text
+    workloads.push_back({ "labels", [&fonts](gfx::Painter& painter, int) {
+        for (int i = 0; i < 600; i++) {
+            gfx::Point pos((float)((i % 12) * 104), (float)((i / 12) * 14));
+            painter.fillRect(gfx::Rect(pos, gfx::Size(100, 13)), gfx::Color(0.15f, 0.15f, 0.15f, 1.0f));
+            painter.drawText(pos + gfx::Point(50, 6), "Refresh", fonts[2], gfx::Color(1.0f, 1.0f, 1.0f, 1.0f), gfx::H_REF_CENTER, gfx::V_REF_CENTER);
+        }
+    }});
+
+    // Large gauges
+    workloads.push_back({ "arcs", [](gfx::Painter& painter, int frame) {
+        for (int i = 0; i < 8; i++) {
+            gfx::Point center(160.0f + (i % 4) * 320.0f, 180.0f + (i / 4) * 360.0f);
+            float input = fmodf(frame * 0.01f + i * 0.125f, 1.0f);
+            painter.drawArc(center, 300, -30.0f*(M_PI/180.0f), 210.0f*(M_PI/180.0f), gfx::Color(0.15f, 0.15f, 0.15f, 1.0f), 20);
+            painter.drawArc(center, 300, -30.0f*(M_PI/180.0f), (input*240.0f - 30.0f)*(M_PI/180.0f), gfx::Color(0.08f, 0.52f, 0.88f, 1.0f), 20);
+            painter.fillArc(center, 200, 0, 2.0f*M_PI, gfx::Color(0.3f, 0.3f, 0.3f, 0.5f));
+        }
+        painter.drawArc(gfx::Point(640, 360), 1000, 0, 2.0f*M_PI, gfx::Color(1.0f, 1.0f, 1.0f, 0.5f), 4);
+    }});
+
+    // Checkmarks
+    workloads.push_back({ "polygons", [](gfx::Painter& painter, int) {
+        static const gfx::Polygon checkmark(std::vector<gfx::Point> {
+            gfx::Point(0.3671875, 0.8671875),
+            gfx::Point(0.0, 0.5234375),
+            gfx::Point(0.1328125, 0.3984375),
+            gfx::Point(0.3671875, 0.625),
+            gfx::Point(0.84375, 0.125),
+            gfx::Point(1.0, 0.25),
+        });
+        for (int i = 0; i < 2000; i++) {
+            gfx::Point pos((float)((i % 50) * 25), (float)((i / 50) * 17));
+            painter.fillPolygon(pos, checkmark, gfx::Size(17, 17), gfx::Color(0.08f, 0.52f, 0.88f, 1.0f));
+        }
+    }});
+
+    // Deeply nested stencils and offsets, as produced by scroll views in scroll views
+    workloads.push_back({ "nesting", [&fonts](gfx::Painter& painter, int) {
+        for (int n = 0; n < 20; n++) {
+            int depth = 32;
+            for (int i = 0; i < depth; i++) {
+                painter.pushOffset(gfx::Pointi(2, 1));
+                painter.pushStencil(gfx::Recti(gfx::Pointi(n * 60, 0), gfx::Pointi(n * 60 + 200, 700 - i)));
+                painter.fillRect(gfx::Rect(gfx::Point(n * 60.0f, i * 20.0f), gfx::Size(50, 18)), gfx::Color(0.15f, 0.15f, 0.15f, 1.0f));
+                painter.drawText(gfx::Point(n * 60.0f + 2, i * 20.0f + 13), "Item", fonts[3], gfx::Color(1.0f, 1.0f, 1.0f, 1.0f));
+            }
+            for (int i = 0; i < depth; i++) {
+                painter.popStencil();
+                painter.popOffset();
+            }
+        }
+    }});
+
+    return workloads;
+}
+
+void runWorkload(Backend& backend, const Workload& workload, int frames, bool retained) {
+    gfx::Painter& painter = backend.getPainter();
+
+    // In retained mode, record the first frame once and only replay it afterwards
+    gfx::RecordingPainter recording(&painter);
+    Workload w = workload;
+    if (retained) {
+        workload.draw(recording, 0);
+        backend.compile(recording);
+        w.draw = [&backend](gfx::Painter&, int) { backend.drawCompiled(); };
+    }
+
+    // Warm up caches
+    for (int i = 0; i < 5; i++) {
+        backend.beginFrame();
+        w.draw(painter, i);
+        backend.submitFrame();
+        backend.finishFrame();
+    }
+    backend.resetStats();
+
+    // Measure
+    double cpuTime = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++) {
+        auto frameStart = std::chrono::steady_clock::now();
+        backend.beginFrame();
+        w.draw(painter, i);
+        backend.submitFrame();
+        cpuTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - frameStart).count();
+        backend.finishFrame();
+    }
+    double totalTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Report
+    printf("%-8s %-10s %-9s %9.3f ms cpu %9.3f ms frame %9.1f fps %s\n",
+        backend.getName(), workload.name, retained ? "retained" : "immediate",
+        1e3 * cpuTime / frames, 1e3 * totalTime / frames, frames / totalTime,
+        backend.getStats(frames).c_str());
+}
+
+void runBackend(Backend& backend, const std::string& resDir, const std::string& only, int frames, bool retained) {
+    // Load all the bundled fonts
+    std::vector<gfx::Font> fonts;
+    for (const auto& ff : FONT_FILES) {
+        backend.loadFont(resDir + "/" + ff.file);
+        fonts.push_back(gfx::Font(ff.name, 14));
+    }
+
+    // Run the workloads
+    for (const auto& w : createWorkloads(fonts)) {
+        if (!only.empty() && only != w.name) { continue; }
+        runWorkload(backend, w, frames, retained);
+    }
+}
+
+void usage() {
+    printf("Usage: gfx_bench [-b opengl|software|all] [-f frames] [-t threads] [-w workload] [-r resource_dir] [-R] [-s] [-d]\n");
+}
+
+int main(int argc, char* argv[]) {
+    std::string backendName = "all";
+    std::string only;
+    std::string resDir = "../vendor/res";
+    int frames = 100;
+    int threads = 0;
+    bool retained = false;
+    bool streaming = true;
+    bool distanceFields = false;
+
+    // Parse arguments
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && !strcmp(argv[i], "-b")) { backendName = argv[++i]; }
+        else if (i + 1 < argc && !strcmp(argv[i], "-f")) { frames = std::max<int>(atoi(argv[++i]), 1); }
+        else if (i + 1 < argc && !strcmp(argv[i], "-t")) { threads = atoi(argv[++i]); }
+        else if (i + 1 < argc && !strcmp(argv[i], "-w")) { only = argv[++i]; }
+        else if (i + 1 < argc && !strcmp(argv[i], "-r")) { resDir = argv[++i]; }
+        else if (!strcmp(argv[i], "-R")) { retained = true; }
+        else if (!strcmp(argv[i], "-s")) { streaming = false; }
+        else if (!strcmp(argv[i], "-d")) { distanceFields = true; }
+        else {
+            usage();
+            return -1;
+        }
+    }
+
+    try {
+        if (backendName == "opengl" || backendName == "all") {
+#ifdef GFX_HAS_OFFSCREEN
+            OpenGLBackend backend(CANVAS_SIZE, streaming, distanceFields);
+            runBackend(backend, resDir, only, frames, retained);
+#else
+            flog::warn("The OpenGL backend can't be benchmarked without an offscreen context on this platform");
+#endif
+        }
+        if (backendName == "software" || backendName == "all") {
+            SoftwareBackend backend(CANVAS_SIZE, threads);
+            runBackend(backend, resDir, only, frames, retained);
+        }
+    }
+    catch (const std::exception& e) {
+        flog::error(e.what());
+        return -1;
+    }
+
+    return 0;
+}
\ No newline at end of file
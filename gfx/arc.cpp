@@ -0,0 +1,102 @@
+#include "arc.h"
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+#define ARC_2PI 6.283185307179586476925286766559005768394
+
+namespace gfx {
+    inline const std::vector<Vec2f>& getCircleTable(int segments) {
+        // Tables are shared by all painters and never change once computed
+        static std::mutex mtx;
+        static std::unordered_map<int, std::vector<Vec2f>> tables;
+        std::lock_guard<std::mutex> lck(mtx);
+        std::vector<Vec2f>& table = tables[segments];
+        if (!table.empty()) { return table; }
+
+        // Compute the points of the circle
+        table.resize(segments);
+        for (int i = 0; i < segments; i++) {
+            double theta = ARC_2PI * (double)i / (double)segments;
+            table[i] = Vec2f((float)cos(theta), (float)sin(theta));
+        }
+        return table;
+    }
+
+    int getCircleSegments(float radius) {
+        // A chord spanning an angle a is at most r * (1 - cos(a/2)) away from the arc, circles too small for that get the least segments
+        int segments = 0;
+        if (radius > GFX_ARC_TOLERANCE) {
+            double maxAngle = 2.0 * acos(1.0 - (double)GFX_ARC_TOLERANCE / (double)radius);
+            segments = (int)std::min<double>(ceil(ARC_2PI / maxAngle), 1 << 20);
+        }
+
+        // Round up to the step so that common angles fall on the points of the circle
+        return std::max<int>((segments + GFX_ARC_SEGMENT_STEP - 1) / GFX_ARC_SEGMENT_STEP, 1) * GFX_ARC_SEGMENT_STEP;
+    }
+
+    void getArcPoints(float radius, float startAngle, float endAngle, std::vector<Vec2f>& points) {
+        // Get the angle between points of the full circle
+        int segments = getCircleSegments(radius);
+        double step = ARC_2PI / (double)segments;
+        double first = (double)startAngle / step;
+        double last = (double)endAngle / step;
+
+        // Read arcs that start and end on points of the circle from its table
+        double firstPoint = round(first);
+        double lastPoint = round(last);
+        if (segments <= GFX_ARC_MAX_TABLE && fabs(first - firstPoint) < 1e-3 && fabs(last - lastPoint) < 1e-3 && fabs(lastPoint - firstPoint) < 1e6) {
+            const std::vector<Vec2f>& table = getCircleTable(segments);
+            int count = (int)fabs(lastPoint - firstPoint);
+            int dir = (lastPoint < firstPoint) ? -1 : 1;
+            int index = (int)fmod(firstPoint, (double)segments);
+            if (index < 0) { index += segments; }
+            points.resize(count + 1);
+            for (int i = 0; i <= count; i++) {
+                points[i] = table[index];
+                index += dir;
+                if (index >= segments) { index = 0; }
+                else if (index < 0) { index = segments - 1; }
+            }
+            return;
+        }
+
+        // Otherwise split the arc in as many segments as the circle would have over the same angle
+        int count = std::max<int>((int)ceil(fabs(last - first) - 1e-3), 1);
+        float dtheta = (endAngle - startAngle) / (float)count;
+        float cosStep = cosf(dtheta);
+        float sinStep = sinf(dtheta);
+
+        // Generate the points by rotating the first one, and end exactly on the end angle
+        points.resize(count + 1);
+        Vec2f p(cosf(startAngle), sinf(startAngle));
+        for (int i = 0; i < count; i++) {
+            points[i] = p;
+            p = Vec2f(p.x * cosStep - p.y * sinStep, p.x * sinStep + p.y * cosStep);
+        }
+        points[count] = Vec2f(cosf(endAngle), sinf(endAngle));
+    }
+
+    void getRoundedRectPoints(const Vec2f& tl, const Vec2f& br, float radius, const std::vector<Vec2f>& corner, std::vector<Vec2f>& points) {
+        // Get the center of each corner, in clockwise order from the top left
+        Vec2f centers[4] = {
+            Vec2f(tl.x + radius, tl.y + radius),
+            Vec2f(br.x - radius, tl.y + radius),
+            Vec2f(br.x - radius, br.y - radius),
+            Vec2f(tl.x + radius, br.y - radius)
+        };
+
+        // Each corner is the previous one turned by a quarter of a circle
+        points.resize(corner.size() * 4);
+        int n = 0;
+        for (int i = 0; i < 4; i++) {
+            for (const auto& p : corner) {
+                Vec2f phase = p;
+                for (int j = 0; j < i; j++) { phase = Vec2f(-phase.y, phase.x); }
+                points[n++] = centers[i] + phase*radius;
+            }
+        }
+    }
+}
\ No newline at end of file
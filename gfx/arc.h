@@ -0,0 +1,42 @@
+#pragma once
+#include "types.h"
+#include <vector>
+
+// Maximum distance in pixels between an arc and the segments approximating it
+#define GFX_ARC_TOLERANCE       0.1f
+
+// Full circles are split in a multiple of this many segments, so that arcs from and to multiples of 15 degrees line up with them
+#define GFX_ARC_SEGMENT_STEP    24
+
+// Largest number of segments of a full circle kept as a table of points
+#define GFX_ARC_MAX_TABLE       2048
+
+namespace gfx {
+    /**
+     * Get the number of segments of a full circle approximating it within GFX_ARC_TOLERANCE.
+     * @param radius Radius of the circle in pixels.
+     * @return Number of segments, a multiple of GFX_ARC_SEGMENT_STEP.
+    */
+    int getCircleSegments(float radius);
+
+    /**
+     * Compute the points of an arc on the unit circle, spaced so that the arc is approximated within GFX_ARC_TOLERANCE once
+     * scaled to its radius. Arcs from and to points of the full circle of that radius, like full circles and most gauges,
+     * are read from a table of the circle kept for the process. Other arcs are generated by rotating their first point.
+     * @param radius Radius of the arc in pixels.
+     * @param startAngle Angle at which the arc starts.
+     * @param endAngle Angle at which the arc ends.
+     * @param points Points of the arc as cosine and sine of their angle, from the start to the end. Previous content is discarded.
+    */
+    void getArcPoints(float radius, float startAngle, float endAngle, std::vector<Vec2f>& points);
+
+    /**
+     * Compute the outline of a rectangle with rounded corners, clockwise from the left end of its top left corner.
+     * @param tl Top left corner of the rectangle.
+     * @param br Bottom right corner of the rectangle.
+     * @param radius Rounding radius in pixels, at most half of the smallest side. Corners are square if it's zero.
+     * @param corner Points of the top left corner on the unit circle as given by getArcPoints from pi to 3pi/2.
+     * @param points Points of the outline, the same number for a given corner. Previous content is discarded.
+    */
+    void getRoundedRectPoints(const Vec2f& tl, const Vec2f& br, float radius, const std::vector<Vec2f>& corner, std::vector<Vec2f>& points);
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+#include "../../types.h"
+#include "../../font.h"
+#include "../../font_store.h"
+#include "glad/glad.h"
+#include <vector>
+#include <stdint.h>
+
+// Bit of the layer of a quad marking textures that hold signed distance fields
+#define GFX_OPENGL_QUAD_DISTANCE_FIELD  0x8000
+
+namespace gfx::OpenGL {
+#pragma pack(push, 1)
+    struct VertexAttrib {
+        // Position in pixels
+        float pos[2];
+
+        // Normalized RGBA8 color
+        uint8_t color[4];
+
+        // Normalized 16bit texture coordinates
+        uint16_t texCoord[2];
+
+        // Layer of the atlas texture array
+        uint16_t layer;
+
+        // Slot of the stencil in the clip table of the batch
+        uint16_t clip;
+    };
+
+    struct QuadInstance {
+        // Top left corner and size in 1/256th of a pixel
+        int32_t pos[2];
+        int32_t size[2];
+
+        // Normalized 16bit texture coordinates of the top left and bottom right corners
+        uint16_t texCoordA[2];
+        uint16_t texCoordB[2];
+
+        // Normalized RGBA8 color
+        uint8_t color[4];
+
+        // Layer of the atlas texture array, with GFX_OPENGL_QUAD_DISTANCE_FIELD set for distance field glyphs
+        uint16_t layer;
+
+        // Slot of the stencil in the clip table of the batch
+        uint16_t clip;
+    };
+#pragma pack(pop)
+
+    enum DisplayListOpType {
+        DISPLAY_LIST_OP_DRAW,
+        DISPLAY_LIST_OP_DRAW_QUADS,
+        DISPLAY_LIST_OP_PUSH_STENCIL,
+        DISPLAY_LIST_OP_POP_STENCIL
+    };
+
+    struct DisplayListOp {
+        DisplayListOpType type;
+
+        // Range of the geometry of a draw operation. Indices are relative to the first vertex.
+        int firstVertex;
+        int vertexCount;
+        int firstIndex;
+        int indexCount;
+
+        // Range of the quads of a quad draw operation
+        int firstQuad;
+        int quadCount;
+
+        // Stencil of a push operation, relative to the origin of the list
+        Recti stencil;
+    };
+
+    struct DisplayListGlyph {
+        // Quad of the glyph in the list
+        int quad;
+
+        // Font of the glyph in the fonts of the list, and its descriptor
+        int font;
+        GlyphDescriptor desc;
+
+        // Start of the baseline under the glyph in pixels, relative to the origin of the list
+        Pointi pen;
+    };
+
+    /**
+     * Geometry prebuilt by an OpenGL painter from a recording. Offsets are baked into the vertices
+     * and all geometry shares the atlas texture, so only stencil changes remain as operations.
+     * Clip slots are assigned when the list is drawn. The quads of the glyphs are updated when the list is drawn after
+     * glyphs were moved in the font atlas.
+    */
+    struct DisplayList {
+        /**
+         * Check if the display list draws nothing.
+         * @return True if the list is empty, false otherwise.
+        */
+        bool empty() const { return ops.empty(); }
+
+        /**
+         * Discard the content of the display list.
+        */
+        void clear() {
+            ops.clear();
+            vertices.clear();
+            indices.clear();
+            quads.clear();
+            glyphs.clear();
+            fonts.clear();
+            atlasGeneration = 0;
+        }
+
+        std::vector<DisplayListOp> ops;
+        std::vector<VertexAttrib> vertices;
+        std::vector<int> indices;
+        std::vector<QuadInstance> quads;
+
+        // Glyphs drawn by the quads, so that they can be kept in the cache and their quads updated when they move
+        std::vector<DisplayListGlyph> glyphs;
+        std::vector<Font> fonts;
+
+        // Generation of the glyphs of the font cache the texture coordinates refer to
+        uint64_t atlasGeneration = 0;
+    };
+}
\ No newline at end of file
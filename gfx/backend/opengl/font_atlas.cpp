@@ -1,66 +1,99 @@
 #include "font_atlas.h"
+#include "flog/flog.h"
+#include <algorithm>
+#include <limits.h>
+#include <string.h>
 
-#define FONT_ATLAS_MAX_SIZE 512
+#define FONT_ATLAS_MAX_SIZE     512
+#define FONT_ATLAS_MAX_PAGES    64
 
 namespace gfx::OpenGL {
-    FontAtlas::FontAtlas(const std::function<void(int)>& bindTexture) {
-        // Save texture bind function
-        this->bindTexture = bindTexture;
-
+    FontAtlas::FontAtlas() {
         // Determine size to use
         int maxTextureSize;
         glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
         texSize = std::min<int>(FONT_ATLAS_MAX_SIZE, maxTextureSize);
 
-        // Allocate the CPU-side texture
-        int elemCount = texSize*texSize;
-        bitmap = new uint32_t[elemCount];
-        for (int i = 0; i < elemCount; i++) {
-            bitmap[i] = 0x00FFFFFF; // White but zero opacity
-        }
+        // Determine the number of pages that can be used
+        int maxLayers;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        maxPages = std::min<int>(FONT_ATLAS_MAX_PAGES, maxLayers);
 
         // Create texture object
         glGenTextures(1, &textureId);
-        bindTexture(textureId);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // Create the buffer that uploads are staged through
+        glGenBuffers(1, &PBO);
+
+        // Start with a single empty page
+        addPage();
+        pushTexture();
 
-        // Initilaize the empty texture
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texSize, texSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, bitmap);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        // Reserve the first texel as opaque white for untextured geometry
+        uint8_t opaque = 0xFF;
+        GlyphCords white;
+        addGlyph(Sizei(1, 1), &opaque, white);
     }
 
     FontAtlas::~FontAtlas() {
-        delete[] bitmap;
         glDeleteTextures(1, &textureId);
+        glDeleteBuffers(1, &PBO);
     }
 
     GLuint FontAtlas::getTextureID() const {
         return textureId;
     }
 
-    bool FontAtlas::addGlyph(const Sizei& size, uint8_t* data, GlyphCords& coords) {
-        // Deal with missing space
-        bool notEnoughWidth = (texSize - cursor.x < size.x);
-        if (notEnoughWidth) {
-            // If there's no space left at all, give up
-            if (texSize - cursor.y < size.y) { return false; }
+    bool FontAtlas::addGlyph(const Sizei& size, const uint8_t* data, GlyphCords& coords) {
+        // Start with empty coordinates, which is all that empty glyphs and failed glyphs get
+        coords.TL = coords.BR = Vec2f(0, 0);
+        coords.layer = 0;
+        coords.position = Vec2i(0, 0);
+        coords.size = Sizei(0, 0);
+        if (size.x <= 0 || size.y <= 0) { return true; }
 
-            // If there's not enough space on a new line, give up as well
-            else if (notEnoughWidth && texSize - skyline < size.y) { return false; }
+        // Give up if the glyph can't fit in a page at all
+        if (size.x > texSize || size.y > texSize) { return false; }
 
-            // Then all we need to do is go to the next line
-            cursor = Vec2i(0, skyline);
+        // Find the first page with space for the glyph, adding a page if they're all full
+        Vec2i pos;
+        int index;
+        int page = 0;
+        while (page < (int)pages.size() && !findPosition(pages[page].skyline, size, pos, index)) { page++; }
+        if (page == (int)pages.size()) {
+            // Give up if no more page can be added
+            if ((int)pages.size() >= maxPages) { return false; }
+            addPage();
+            findPosition(pages[page].skyline, size, pos, index);
         }
 
+        // Reserve the area in the skyline of the page
+        AtlasPage& p = pages[page];
+        insertNode(p.skyline, index, pos, size);
+
         // Blit to the bitmap
-        uint8_t* bm = ((uint8_t*)&bitmap[cursor.y*texSize + cursor.x]) + 3;
-        
+        uint8_t* bm = &bitmap[(size_t)page*texSize*texSize + pos.y*texSize + pos.x];
         for (int i = 0; i < size.y; i++) {
-            for (int j = 0; j < size.x; j++) {
-                *bm = *(data++);
-                bm += 4;
-            }
-            bm += 4*(texSize - size.x);
+            memcpy(bm, data, size.x);
+            data += size.x;
+            bm += texSize;
+        }
+
+        // Add the glyph to the area of the page that needs to be uploaded
+        Vec2i end(pos.x + size.x, pos.y + size.y);
+        if (p.dirty) {
+            p.dirtyStart = Vec2i(std::min<int>(p.dirtyStart.x, pos.x), std::min<int>(p.dirtyStart.y, pos.y));
+            p.dirtyEnd = Vec2i(std::max<int>(p.dirtyEnd.x, end.x), std::max<int>(p.dirtyEnd.y, end.y));
+        }
+        else {
+            p.dirtyStart = pos;
+            p.dirtyEnd = end;
+            p.dirty = true;
         }
 
         // Mark texture as no longer up to date
@@ -68,34 +101,203 @@ namespace gfx::OpenGL {
 
         // Save area of glyph
         float ratio = 1.0f / (float)texSize;
-        Vec2i a = cursor;
-        Vec2i b(cursor.x + size.x, cursor.y + size.y);
+        Vec2i a = pos;
+        Vec2i b(pos.x + size.x, pos.y + size.y);
         coords.TL = Vec2f(a.x, a.y) * ratio;
-        coords.TR = Vec2f(b.x, a.y) * ratio;
-        coords.BL = Vec2f(a.x, b.y) * ratio;
         coords.BR = Vec2f(b.x, b.y) * ratio;
-
-        // Update the skyline
-        if (cursor.y + size.y > skyline) {
-            skyline = cursor.y + size.y;
-        }
-
-        // Update cursor
-        cursor.x += size.x;
+        coords.layer = page;
+        coords.position = pos;
+        coords.size = size;
 
         // Return successfully
         return true;
     }
 
+    void FontAtlas::compact(const std::vector<GlyphCords*>& glyphs) {
+        // Start over from a single empty page, keeping the old pages to copy the glyphs from
+        std::vector<uint8_t> oldBitmap;
+        std::swap(oldBitmap, bitmap);
+        pages.clear();
+        addPage();
+
+        // Reserve the white texel again
+        uint8_t opaque = 0xFF;
+        GlyphCords white;
+        addGlyph(Sizei(1, 1), &opaque, white);
+
+        // Add the tallest glyphs first since the skyline stays flatter that way
+        std::vector<GlyphCords*> sorted = glyphs;
+        std::sort(sorted.begin(), sorted.end(), [](const GlyphCords* a, const GlyphCords* b) { return a->size.y > b->size.y; });
+
+        // Copy each glyph to its new location
+        std::vector<uint8_t> data;
+        float ratio = 1.0f / (float)texSize;
+        for (GlyphCords* glyph : sorted) {
+            // Extract the glyph from the old pages
+            Sizei size = glyph->size;
+            data.resize(size.x * size.y);
+            const uint8_t* src = &oldBitmap[(size_t)glyph->layer*texSize*texSize + glyph->position.y*texSize + glyph->position.x];
+            for (int i = 0; i < size.y; i++) {
+                memcpy(&data[i * size.x], &src[i * texSize], size.x);
+            }
+
+            // Add it back
+            GlyphCords coords;
+            if (!addGlyph(size, data.data(), coords)) {
+                *glyph = coords;
+                continue;
+            }
+
+            // Move the texture coordinates by as much as the glyph moved, which keeps any inset applied to them
+            Vec2f delta = Vec2f(coords.position.x - glyph->position.x, coords.position.y - glyph->position.y) * ratio;
+            glyph->TL = glyph->TL + delta;
+            glyph->BR = glyph->BR + delta;
+            glyph->layer = coords.layer;
+            glyph->position = coords.position;
+        }
+
+        // Reallocate the texture on the next push since the number of pages may have shrunk
+        texturePages = 0;
+        textureUpToDate = false;
+        generation++;
+        flog::debug("Font atlas compacted {} glyphs into {} pages", glyphs.size(), pages.size());
+    }
+
     void FontAtlas::pushTexture() {
         // Don't do anything if the texture is already up to date
         if (textureUpToDate) { return; }
-        
-        // Push the texture to the GPU
-        bindTexture(textureId);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texSize, texSize, GL_RGBA, GL_UNSIGNED_BYTE, bitmap);
+
+        // Rows of a single channel texture aren't aligned to 4 bytes
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        // Reallocate the texture with all pages if pages were added, otherwise only push the modified areas
+        int pageCount = pages.size();
+        if (texturePages != pageCount) {
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, texSize, texSize, pageCount, 0, GL_RED, GL_UNSIGNED_BYTE, bitmap.data());
+            texturePages = pageCount;
+            for (auto& page : pages) { page.dirty = false; }
+        }
+        else {
+            for (int i = 0; i < pageCount; i++) {
+                if (!pages[i].dirty) { continue; }
+                uploadArea(i, pages[i].dirtyStart, pages[i].dirtyEnd);
+                pages[i].dirty = false;
+            }
+        }
 
         // Mark as up-to-date
         textureUpToDate = true;
     }
+
+    int FontAtlas::fit(const std::vector<SkylineNode>& skyline, int index, const Sizei& size) {
+        // Make sure the glyph doesn't go past the right of the page
+        int x = skyline[index].x;
+        if (x + size.x > texSize) { return -1; }
+
+        // The glyph rests on the highest segment under it
+        int y = 0;
+        int widthLeft = size.x;
+        for (int i = index; widthLeft > 0; i++) {
+            y = std::max<int>(y, skyline[i].y);
+            if (y + size.y > texSize) { return -1; }
+            widthLeft -= skyline[i].width;
+        }
+        return y;
+    }
+
+    bool FontAtlas::findPosition(const std::vector<SkylineNode>& skyline, const Sizei& size, Vec2i& pos, int& index) {
+        // Search for the position that leaves the glyph the lowest, using the narrowest segment to break ties
+        int bestBottom = INT_MAX;
+        int bestWidth = INT_MAX;
+        index = -1;
+        for (int i = 0; i < (int)skyline.size(); i++) {
+            int y = fit(skyline, i, size);
+            if (y < 0) { continue; }
+            int bottom = y + size.y;
+            if (bottom < bestBottom || (bottom == bestBottom && skyline[i].width < bestWidth)) {
+                bestBottom = bottom;
+                bestWidth = skyline[i].width;
+                pos = Vec2i(skyline[i].x, y);
+                index = i;
+            }
+        }
+        return index >= 0;
+    }
+
+    void FontAtlas::insertNode(std::vector<SkylineNode>& skyline, int index, const Vec2i& pos, const Sizei& size) {
+        // Add a segment on top of the glyph
+        SkylineNode node = { pos.x, pos.y + size.y, size.x };
+        skyline.insert(skyline.begin() + index, node);
+
+        // Shrink or remove the segments now covered by the glyph
+        int right = pos.x + size.x;
+        for (int i = index + 1; i < (int)skyline.size();) {
+            if (skyline[i].x >= right) { break; }
+            int shrink = right - skyline[i].x;
+            if (skyline[i].width > shrink) {
+                skyline[i].x += shrink;
+                skyline[i].width -= shrink;
+                break;
+            }
+            skyline.erase(skyline.begin() + i);
+        }
+
+        // Merge neighbouring segments of the same height
+        for (int i = 0; i + 1 < (int)skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + i + 1);
+            }
+            else {
+                i++;
+            }
+        }
+    }
+
+    void FontAtlas::addPage() {
+        // Start the page with a single empty segment
+        AtlasPage page = {};
+        page.skyline.push_back({ 0, 0, texSize });
+        pages.push_back(page);
+
+        // Allocate the CPU-side copy of the page, with zero coverage
+        bitmap.resize((size_t)pages.size()*texSize*texSize, 0);
+        textureUpToDate = false;
+        if (pages.size() > 1) { flog::debug("Font atlas grown to {} pages", pages.size()); }
+    }
+
+    void FontAtlas::uploadArea(int page, const Vec2i& start, const Vec2i& end) {
+        int width = end.x - start.x;
+        int height = end.y - start.y;
+        const uint8_t* src = &bitmap[(size_t)page*texSize*texSize + start.y*texSize + start.x];
+
+        // Stage the area through the PBO when it can be mapped so that the driver copies it to the texture asynchronously
+        if (glMapBufferRange) {
+            // Orphan the previous content of the PBO since the previous upload may not be done reading it
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+            PBOCapacity = std::max<int>(PBOCapacity, width * height);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, PBOCapacity, NULL, GL_STREAM_DRAW);
+
+            // Copy the rows of the area, tightly packed
+            uint8_t* dst = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, width * height, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (dst) {
+                for (int i = 0; i < height; i++) {
+                    memcpy(&dst[i * width], &src[i * texSize], width);
+                }
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+                // Upload from the PBO
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, start.x, start.y, page, width, height, 1, GL_RED, GL_UNSIGNED_BYTE, NULL);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                return;
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        // Otherwise upload straight from the CPU-side copy
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, texSize);
+        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, start.x, start.y, page, width, height, 1, GL_RED, GL_UNSIGNED_BYTE, src);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
 }
\ No newline at end of file
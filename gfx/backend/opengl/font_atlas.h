@@ -1,7 +1,8 @@
 #pragma once
 #include "glad/glad.h"
 #include "../../types.h"
-#include <functional>
+#include <vector>
+#include <stdint.h>
 
 namespace gfx::OpenGL {
     struct GlyphCords {
@@ -11,34 +12,58 @@ namespace gfx::OpenGL {
         Vec2f TL;
 
         /**
-         * Top-Right texture coordinate.
+         * Bottom-Right texture coordinate.
         */
-        Vec2f TR;
+        Vec2f BR;
 
         /**
-         * Bottom-Left texture coordinate.
+         * Layer of the texture array.
         */
-        Vec2f BL;
+        int layer;
 
         /**
-         * Bottom-Right texture coordinate.
+         * Area of the glyph in its layer, in texels. Empty if the glyph has no texture.
         */
-        Vec2f BR;
+        Vec2i position;
+        Sizei size;
+    };
+
+    struct SkylineNode {
+        // Left end of the segment
+        int x;
+
+        // Height of the packed area under the segment
+        int y;
+
+        // Width of the segment
+        int width;
+    };
+
+    struct AtlasPage {
+        // Skyline of the packed area
+        std::vector<SkylineNode> skyline;
+
+        // Area modified since the last upload, the end is exclusive
+        bool dirty;
+        Vec2i dirtyStart;
+        Vec2i dirtyEnd;
     };
 
     class FontAtlas {
     public:
         /**
-         * Create an atlas.
-         * @param bindTexture Function that will be called to change the currently active OpenGL texture.
+         * Create an atlas. The atlas is a texture array so that glyphs from all pages, and untextured geometry
+         * using the opaque white texel reserved at coordinate (0, 0) of layer 0, can be drawn without switching textures.
+         * Pages are added as layers of the array when the existing ones are full.
+         * Only coverage is stored, in a single channel. Shaders expand it to white with that opacity.
         */
-        FontAtlas(const std::function<void(int)>& bindTexture);
+        FontAtlas();
 
         // Destructor
         ~FontAtlas();
 
         /**
-         * Get the OpenGL texture object ID associated with this atlas.
+         * Get the OpenGL texture array object ID associated with this atlas.
          * @return OpenGL texture ID.
         */
         GLuint getTextureID() const;
@@ -50,28 +75,63 @@ namespace gfx::OpenGL {
         int getTextureSize() const { return texSize; }
 
         /**
-         * Add a glyph to the atlas.
+         * Get the number of pages in use, which is the number of layers of the texture array.
+         * @return Number of pages.
+        */
+        int getPageCount() const { return (int)pages.size(); }
+
+        /**
+         * Get the number of pages that the atlas can grow to, limited by the layers that the texture array can have.
+         * @return Maximum number of pages.
+        */
+        int getMaxPages() const { return maxPages; }
+
+        /**
+         * Get the generation of the atlas. It changes every time glyphs are moved, which invalidates all coordinates handed out before.
+         * @return Generation of the atlas.
+        */
+        uint64_t getGeneration() const { return generation; }
+
+        /**
+         * Add a glyph to the atlas. A new page is added if it doesn't fit in any existing page.
          * @param size Size of the glyph bitmap in pixels.
          * @param data Bitmap data of the glyph in 8bit per pixel format.
          * @param position Outputs the position that the glyph was added to in the atlas.
+         * @return True if the glyph was added, false if it's larger than a page or the maximum number of pages is reached.
+        */
+        bool addGlyph(const Sizei& size, const uint8_t* data, GlyphCords& position);
+
+        /**
+         * Repack the given glyphs into as few pages as possible, dropping all other glyphs. The coordinates of the glyphs are
+         * moved to their new location, and the generation of the atlas changes. Glyphs that can't be repacked are left empty.
+         * @param glyphs Coordinates of the glyphs to keep.
         */
-        bool addGlyph(const Sizei& size, uint8_t* data, GlyphCords& position);
+        void compact(const std::vector<GlyphCords*>& glyphs);
 
         /**
-         * Push the texture data to the GPU.
+         * Push the areas modified since the last call to the GPU. Called by the painter before it draws.
         */
         void pushTexture();
 
     private:
+        int fit(const std::vector<SkylineNode>& skyline, int index, const Sizei& size);
+        bool findPosition(const std::vector<SkylineNode>& skyline, const Sizei& size, Vec2i& pos, int& index);
+        void insertNode(std::vector<SkylineNode>& skyline, int index, const Vec2i& pos, const Sizei& size);
+        void addPage();
+        void uploadArea(int page, const Vec2i& start, const Vec2i& end);
+
         int texSize;
+        int maxPages;
         GLuint textureId;
+        GLuint PBO;
+        int PBOCapacity = 0;
 
-        Vec2i cursor = Vec2i(0);
-        int skyline = 0;
-
-        std::function<void(int)> bindTexture;
+        std::vector<AtlasPage> pages;
 
-        uint32_t* bitmap;
+        // CPU-side copy of all pages, one after the other
+        std::vector<uint8_t> bitmap;
+        int texturePages = 0;
         bool textureUpToDate = false;
+        uint64_t generation = 0;
     };
 }
\ No newline at end of file
@@ -1,195 +1,449 @@
 #include "font_cache.h"
 #include "flog/flog.h"
 #include <stdexcept>
-#include <fstream>
-#include <format>
+#include <algorithm>
+#include <limits.h>
 
 namespace gfx::OpenGL {
-    FT_Library FontCache::library;
-    bool FontCache::isInit = false;
+    struct EvictionCandidate {
+        uint32_t lastUsed;
+        FontData* font;
+        SDFFaceData* sdf;
+        uint32_t key;
+    };
+
+    inline bool fitsPage(const FontAtlas& atlas, const Sizei& size) {
+        return size.x <= atlas.getTextureSize() && size.y <= atlas.getTextureSize();
+    }
+
+    FontCache::FontCache() : store(FontStore::getInstance()) {}
 
-    FontCache::FontCache(const std::function<void(int)>& bindTexture) : atlas(bindTexture) {
-        // Init freetype if it isn't already initialized
-        initFreetype();
+    FontCache::~FontCache() {
+        // Give the glyphs back to the store so that it can free those no other cache uses
+        for (auto& [stored, data] : fonts) {
+            data.glyphs.forEach([&](GlyphDescriptor desc, GlyphInfo& info) {
+                if (!info.pending) { store.releaseGlyph(stored, desc >> 2, desc & 0b11); }
+            });
+        }
+        for (auto& [name, face] : sdfFaces) {
+            face.glyphs.forEach([&](GlyphDescriptor desc, GlyphInfo& info) {
+                if (!info.pending) { store.releaseSDFGlyph(name, desc >> 2); }
+            });
+        }
+        store.purge();
     }
 
     FontMetrics FontCache::getFontMetrics(const Font& font) {
-        // Get the font data
-        FontData& data = *(std::any_cast<FontData*>(font.backendTag));
-
-        // Return the metrics
-        return data.metrics;
+        // Return the metrics of the font in the store
+        return getData(font).font->metrics;
     }
 
     void FontCache::loadFont(const std::string& path) {
-        // Open the font file
-        std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
-
-        // Make sure it opened successfully
-        if (!file.is_open()) {
-            throw std::runtime_error("Could not open font file");
-        }
-
-        // Get its length
-        size_t len = file.tellg();
-        file.seekg(0);
-
-        // Allocate the buffer
-        uint8_t* data = new uint8_t[len];
-
-        // Load the font data into the buffer
-        file.read((char*)data, len);
-
-        // Close the font file
-        file.close();
-
-        // Load font data into Freetype
-        FT_Face face;
-        FT_New_Memory_Face(library, data, len, 0, &face);
-
-        // Make sure a font with that name is not already loaded
-        std::string name = std::format("{} {}", face->family_name, face->style_name);
-        if (fontFiles.find(name) != fontFiles.end()) { return; }
-        flog::debug("Loaded font: '{}'", name);
-
-        // TODO: The font file data list should be global to all font caches
-        // Actually a lot of objects should be global to avoid reloading in multiple windows
-        // Only the OpenGL objects, and thus atlas should belong to each instance
-
-        // Destroy freetype data
-        FT_Done_Face(face);
-
-        // Create an entry in the file list
-        FontFile ff = { data, len };
-        fontFiles[name] = ff;
+        store.loadFont(path);
     }
 
-    void FontCache::prepareFont(Font& font) {
-        // If the tag is already filled in, do nothing
-        if (font.backendTag.has_value()) { return; }
-
-        // Search for the font in the cache and add it if it's not available
-        auto it = fonts.find(font);
-        if (it == fonts.end()) {
-            admitFont(font);
-            it = fonts.find(font);
-        }
+    void FontCache::setBudget(int maxGlyphs, int maxPages) {
+        this->maxGlyphs = maxGlyphs;
+        this->maxPages = maxPages;
+    }
 
-        // Set the tag to the pointer to the font data
-        font.backendTag = &it->second;
+    void FontCache::newFrame() {
+        // Glyphs are only added from the background threads and moved between frames, when no geometry referencing them is pending
+        frame++;
+        collectGlyphs();
+        trim();
     }
 
     GlyphInfo FontCache::getGlyph(const Font& font, int glyphId, int alignment) {
         // Get the font data
-        FontData& data = *(std::any_cast<FontData*>(font.backendTag));
+        FontData& data = getData(font);
+
+        // Distance field glyphs are shared by all sizes and alignments of the face
+        if (mode == GLYPH_MODE_SDF) {
+            // Get the distance fields of the face
+            if (!data.sdf) { data.sdf = admitSDFFace(font.getName()); }
+
+            // Get the glyph at the reference size
+            GlyphInfo info;
+            GlyphInfo* cached = data.sdf->glyphs.find(glyphId << 2);
+
+            // A distance field handed out without a texture is rasterized now if that's no longer left to the background threads
+            if (cached && cached->pending && !asyncGlyphs) {
+                filledGeneration++;
+                cached = NULL;
+            }
+
+            // Use the cached glyph or add it
+            if (cached) {
+                cached->lastUsed = frame;
+                info = *cached;
+            }
+            else {
+                info = admitSDFGlyph(*data.sdf, glyphId);
+            }
+
+            // Scale it to the size of the font and apply the sub-pixel alignment
+            float scale = (float)font.getSize() / (float)GFX_SDF_SIZE;
+            info.size = Size(info.size.x * scale, info.size.y * scale);
+            info.offset = Vec2f(info.offset.x * scale + (float)alignment / (float)GFX_OPENGL_GLYPH_SUBPIXELS, info.offset.y * scale);
+            info.xAdvance *= scale;
+            return info;
+        }
 
         // Create the descriptor
         GlyphDescriptor desc = (glyphId << 2) | alignment;
 
+        // Look for the glyph in the cache
+        GlyphInfo* cached = data.glyphs.find(desc);
+
+        // A glyph handed out without a texture is rasterized now if that's no longer left to the background threads
+        if (cached && cached->pending && !asyncGlyphs) {
+            filledGeneration++;
+            cached = NULL;
+        }
+
         // If the glyph is cached, return its info immediately
-        auto itg = data.glyphs.find(desc);
-        if (itg != data.glyphs.end()) {
-            return itg->second;
+        if (cached) {
+            cached->lastUsed = frame;
+            return *cached;
         }
 
         // The glyph is not in cache, add it
         return admitGlyph(data, desc);
     }
 
-    Vec2f FontCache::getKerning(const Font& font, int leftId, int rightId) {
-        // Get the font data
-        FontData& data = *(std::any_cast<FontData*>(font.backendTag));
+    void FontCache::prewarm(const Font& font, const std::vector<CodepointRange>& ranges) {
+        // Get the font data, and the distance fields of its face in distance field mode
+        FontData& data = getData(font);
+        if (mode == GLYPH_MODE_SDF && !data.sdf) { data.sdf = admitSDFFace(font.getName()); }
+
+        // Request the glyphs that aren't cached yet, they are placed in the atlas once collected
+        for (const auto& range : ranges) {
+            for (int c = range.first; c <= range.last; c++) {
+                if (mode == GLYPH_MODE_SDF) {
+                    GlyphDescriptor desc = c << 2;
+                    if (data.sdf->glyphs.find(desc)) { continue; }
+                    store.requestSDFGlyph(data.sdf->name, c);
+                    pending.push_back({ NULL, data.sdf, desc });
+                    continue;
+                }
+                for (int a = 0; a < GFX_OPENGL_GLYPH_SUBPIXELS; a++) {
+                    GlyphDescriptor desc = (c << 2) | a;
+                    if (data.glyphs.find(desc)) { continue; }
+                    store.requestGlyph(data.font, c, a);
+                    pending.push_back({ &data, NULL, desc });
+                }
+            }
+        }
+    }
+
+    void FontCache::touchGlyph(const Font& font, GlyphDescriptor desc) {
+        // Distance field glyphs are shared by all alignments
+        FontData& data = getData(font);
+        GlyphInfo* info;
+        if (mode == GLYPH_MODE_SDF) {
+            info = data.sdf ? data.sdf->glyphs.find(desc & ~0b11) : NULL;
+        }
+        else {
+            info = data.glyphs.find(desc);
+        }
 
-        // Get the kerning info from Freetype
-        FT_Vector delta;
-        FT_Get_Kerning(data.face, leftId, rightId, FT_KERNING_UNFITTED, &delta);
-        
-        // Convert it to floating point and return it
-        return Vec2f((float)delta.x / (float)(1 << 6), (float)delta.y / (float)(1 << 6));
+        // Update its last use if it's cached
+        if (info) { info->lastUsed = frame; }
     }
 
-    void FontCache::initFreetype() {
-        // If already initialized, do nothing
-        if (isInit) { return; }
+    float FontCache::getKerning(const Font& font, int leftId, int rightId) {
+        // Get the pairs of the face from the store on first use, they never change afterwards
+        FontData& data = getData(font);
+        if (!data.kerning) { data.kerning = store.getKerningTable(data.font); }
 
-        // Initialize FreeType
-        int err = FT_Init_FreeType(&library);
-        if(err) {
-            throw std::runtime_error("Could not initialize FreeType");
-        }
+        // Scale the adjustment to the size of the font
+        return (float)data.kerning->get(leftId, rightId) * data.font->unitScale;
     }
 
-    void FontCache::admitFont(const Font& font) {
-        // Get the font and throw an error if not available
-        auto it = fontFiles.find(font.getName());
-        if (it == fontFiles.end()) {
-            throw std::runtime_error("The requested font is not loaded");
+    FontData& FontCache::getData(const Font& font) {
+        // Fonts are looked up directly by the ID of their handle
+        FontHandle handle = font.getHandle();
+        if (handle.id < slots.size()) {
+            const FontSlot& slot = slots[handle.id];
+            if (slot.data && slot.generation == handle.generation) { return *slot.data; }
         }
-        const FontFile& file = it->second;
+        else {
+            slots.resize(handle.id + 1, FontSlot{ 0, NULL });
+        }
+
+        // The handle wasn't resolved yet or its ID was recycled, get the font from the store
+        StoredFont* stored = store.getFont(font.getName(), font.getSize());
 
-        // Load font data into Freetype
-        FT_Face face;
-        FT_New_Memory_Face(library, file.data, file.size, 0, &face);
+        // Search for the font in the cache and add it if it's not available, fonts recycled with a new ID keep their glyphs
+        auto it = fonts.find(stored);
+        if (it == fonts.end()) {
+            it = fonts.emplace(stored, FontData()).first;
+            it->second.font = stored;
+            it->second.sdf = NULL;
+            it->second.kerning = NULL;
+        }
 
-        // Set font size
-        FT_Set_Pixel_Sizes(face, 0, font.getSize());
+        // Remember it for the next glyphs of the handle
+        slots[handle.id] = { handle.generation, &it->second };
+        return it->second;
+    }
 
-        // Compute font metrics
-        FontMetrics metrics = {
-            (float)face->size->metrics.ascender / (float)(1 << 6),
-            (float)face->size->metrics.descender / (float)(1 << 6)
-        };
+    void FontCache::trim() {
+        // Nothing to do if the cache is within budget
+        bool overGlyphs = glyphCount > maxGlyphs;
+        bool overPages = atlas.getPageCount() > maxPages || atlasFull;
+        atlasFull = false;
+        if (!overGlyphs && !overPages) { return; }
+
+        // Collect the glyphs that weren't used in the current or previous frame, and the atlas area used by all glyphs
+        std::vector<EvictionCandidate> candidates;
+        int64_t area = 0;
+        // The frame counter may wrap around, so ages are computed as differences
+        for (auto& [font, data] : fonts) {
+            data.glyphs.forEach([&](GlyphDescriptor desc, GlyphInfo& info) {
+                area += info.coords.size.x * info.coords.size.y;
+                if (!info.pending && frame - info.lastUsed > 1) { candidates.push_back({ info.lastUsed, &data, NULL, desc }); }
+            });
+        }
+        for (auto& [name, face] : sdfFaces) {
+            face.glyphs.forEach([&](GlyphDescriptor desc, GlyphInfo& info) {
+                area += info.coords.size.x * info.coords.size.y;
+                if (!info.pending && frame - info.lastUsed > 1) { candidates.push_back({ info.lastUsed, NULL, &face, desc }); }
+            });
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](const EvictionCandidate& a, const EvictionCandidate& b) {
+            return frame - a.lastUsed > frame - b.lastUsed;
+        });
+
+        // Evict the least recently used glyphs until well below budget so that the following frames don't have to evict again
+        int glyphTarget = overGlyphs ? maxGlyphs * 3 / 4 : INT_MAX;
+        int pageTarget = std::min<int>(maxPages, atlas.getMaxPages());
+        int64_t areaTarget = overPages ? (int64_t)pageTarget * atlas.getTextureSize() * atlas.getTextureSize() * 3 / 4 : INT64_MAX;
+        int evicted = 0;
+        for (const auto& c : candidates) {
+            if (glyphCount <= glyphTarget && area <= areaTarget) { break; }
+            const GlyphCords& coords = (c.sdf ? c.sdf->glyphs.find(c.key) : c.font->glyphs.find(c.key))->coords;
+            area -= coords.size.x * coords.size.y;
+            if (c.sdf) {
+                evictSDFGlyph(*c.sdf, c.key >> 2);
+            }
+            else {
+                evictGlyph(*c.font, c.key);
+            }
+            evicted++;
+        }
+        if (evicted) { flog::debug("Evicted {} glyphs from the font cache", evicted); }
+
+        // The space of the evicted glyphs can only be reclaimed by repacking the atlas, which moves all glyphs and uploads all pages.
+        // So only repack when out of pages or when a large part of the pages is wasted, the wasted area starting over from zero.
+        int64_t pageArea = (int64_t)atlas.getPageCount() * atlas.getTextureSize() * atlas.getTextureSize();
+        bool wasteful = (float)evictedArea > (float)pageArea * GFX_OPENGL_PAGE_WASTE;
+        if (!evictedArea || (!overPages && !wasteful)) {
+            if (evicted) { store.purge(); }
+            return;
+        }
 
-        // Create the data struct
-        FontData data = {
-            face,
-            face->glyph,
-            metrics,
-            std::map<GlyphDescriptor, GlyphInfo>()
+        // Repack the remaining glyphs
+        std::vector<GlyphCords*> live;
+        auto addLive = [&live](GlyphDescriptor, GlyphInfo& info) {
+            if (info.coords.size.x > 0) { live.push_back(&info.coords); }
         };
+        for (auto& [font, data] : fonts) { data.glyphs.forEach(addLive); }
+        for (auto& [name, face] : sdfFaces) { face.glyphs.forEach(addLive); }
+        atlas.compact(live);
+        evictedArea = 0;
+
+        // Drop the glyphs that didn't fit back so that they get added again when needed
+        for (auto& [font, data] : fonts) {
+            data.glyphs.forEach([&](GlyphDescriptor desc, GlyphInfo& info) {
+                if (info.size.x > 0 && info.coords.size.x <= 0) { evictGlyph(data, desc); }
+            });
+        }
+        for (auto& [name, face] : sdfFaces) {
+            face.glyphs.forEach([&](GlyphDescriptor desc, GlyphInfo& info) {
+                if (info.size.x > 0 && info.coords.size.x <= 0) { evictSDFGlyph(face, desc >> 2); }
+            });
+        }
 
-        // Add the data to the cache
-        fonts[font] = data;
+        // Let the store free the glyphs and faces that no cache uses anymore
+        store.purge();
     }
 
-    void FontCache::evictFont(const Font& font) {
-        // TODO
+    void FontCache::collectGlyphs() {
+        // Glyphs are rasterized about in the order they were requested, so stop looking once a few aren't ready
+        size_t kept = 0;
+        int misses = 0;
+        bool filled = false;
+        for (size_t i = 0; i < pending.size(); i++) {
+            PendingGlyph p = pending[i];
+            if (misses <= GFX_GLYPH_RASTERIZER_THREADS) {
+                // Skip the glyphs placed in the meantime
+                GlyphInfo* cached = p.sdf ? p.sdf->glyphs.find(p.desc) : p.font->glyphs.find(p.desc);
+                if (cached && !cached->pending) { continue; }
+
+                // Place the glyph if it's ready, replacing the glyph handed out without a texture if any
+                bool replaces = (cached != NULL);
+                const GlyphBitmap* glyph = p.sdf ? store.tryAcquireSDFGlyph(p.sdf->name, p.desc >> 2) : store.tryAcquireGlyph(p.font->font, p.desc >> 2, p.desc & 0b11);
+                if (glyph) {
+                    if (p.sdf) {
+                        placeSDFGlyph(*p.sdf, p.desc >> 2, *glyph);
+                    }
+                    else {
+                        placeGlyph(*p.font, p.desc, *glyph);
+                    }
+                    filled |= replaces;
+                    continue;
+                }
+                misses++;
+            }
+            pending[kept++] = p;
+        }
+        pending.resize(kept);
+
+        // Geometry built with the glyphs that had no texture has to be built again
+        if (filled) { filledGeneration++; }
     }
 
     GlyphInfo FontCache::admitGlyph(FontData& font, GlyphDescriptor desc) {
-        // Apply subpixel alignment
-        FT_Vector delta;
-        delta.x = (float)(desc & 0b11) * (64.0f/4.0f);
-        delta.y = 0;
-        FT_Set_Transform(font.face, NULL, &delta);
-
-        // Render the glyph
-        FT_Load_Char(font.face, desc >> 2, FT_LOAD_RENDER);
+        // Rasterize the glyph now, unless that's left to the background threads
+        if (!asyncGlyphs) { return placeGlyph(font, desc, store.acquireGlyph(font.font, desc >> 2, desc & 0b11)); }
+
+        // Use the glyph if it was already rasterized in the background
+        const GlyphBitmap* glyph = store.tryAcquireGlyph(font.font, desc >> 2, desc & 0b11);
+        if (glyph) { return placeGlyph(font, desc, *glyph); }
+
+        // Otherwise hand out the advance alone until the glyph is collected
+        GlyphInfo info;
+        info.size = Size(0, 0);
+        info.offset = Vec2f(0, 0);
+        info.coords.layer = 0;
+        info.coords.size = Sizei(0, 0);
+        info.distanceField = false;
+        info.xAdvance = store.getAdvance(font.font, desc >> 2);
+        info.lastUsed = frame;
+        info.pending = true;
+        font.glyphs.insert(desc, info);
+        pending.push_back({ &font, NULL, desc });
+        return info;
+    }
 
+    GlyphInfo FontCache::placeGlyph(FontData& font, GlyphDescriptor desc, const GlyphBitmap& glyph) {
         // Add to the atlas
+        // If it can't fit in a page or all pages are in use, the glyph is drawn empty and not cached so that it's added again after the next trim
         GlyphCords coords;
-        Sizei glyphSize(font.slot->bitmap.width, font.slot->bitmap.rows);
-        atlas.addGlyph(glyphSize, font.slot->bitmap.buffer, coords);
+        if (!atlas.addGlyph(glyph.size, glyph.bitmap.data(), coords)) {
+            atlasFull |= fitsPage(atlas, glyph.size);
+            font.glyphs.erase(desc);
+            store.releaseGlyph(font.font, desc >> 2, desc & 0b11);
+            return { Size(0, 0), Vec2f(glyph.offset.x, glyph.offset.y), coords, false, glyph.xAdvance, frame, false };
+        }
 
         // Create cache entry
-        float texSize = atlas.getTextureSize();
         GlyphInfo info = {
-            glyphSize,
-            Vec2i(font.slot->bitmap_left, font.slot->bitmap_top),
+            Size(glyph.size.x, glyph.size.y),
+            Vec2f(glyph.offset.x, glyph.offset.y),
             coords,
-            atlas.getTextureID(),
-            (float)font.face->glyph->linearHoriAdvance * (1.0f / (float)(1 << 16)),
-            -1
+            false,
+            glyph.xAdvance,
+            frame,
+            false
         };
 
         // Push entry to the cache
-        font.glyphs[desc] = info;
+        font.glyphs.insert(desc, info);
+        glyphCount++;
 
         // Return glyph info
         return info;
     }
 
     void FontCache::evictGlyph(FontData& font, GlyphDescriptor desc) {
-        // TODO
+        // Only forget the glyph, its area in the atlas is reclaimed when the atlas is compacted
+        const Sizei& size = font.glyphs.find(desc)->coords.size;
+        evictedArea += size.x * size.y;
+        font.glyphs.erase(desc);
+        store.releaseGlyph(font.font, desc >> 2, desc & 0b11);
+        glyphCount--;
+    }
+
+    SDFFaceData* FontCache::admitSDFFace(const std::string& name) {
+        // Create the face entry if the face has no distance fields yet
+        SDFFaceData& data = sdfFaces[name];
+        data.name = name;
+        return &data;
+    }
+
+    GlyphInfo FontCache::admitSDFGlyph(SDFFaceData& face, int glyphId) {
+        // Rasterize the distance field now, unless that's left to the background threads
+        if (!asyncGlyphs) { return placeSDFGlyph(face, glyphId, store.acquireSDFGlyph(face.name, glyphId)); }
+
+        // Use the distance field if it was already rasterized in the background
+        const GlyphBitmap* glyph = store.tryAcquireSDFGlyph(face.name, glyphId);
+        if (glyph) { return placeSDFGlyph(face, glyphId, *glyph); }
+
+        // Otherwise hand out the advance alone until the distance field is collected
+        GlyphInfo info;
+        info.size = Size(0, 0);
+        info.offset = Vec2f(0, 0);
+        info.coords.layer = 0;
+        info.coords.size = Sizei(0, 0);
+        info.distanceField = true;
+        info.xAdvance = store.getSDFAdvance(face.name, glyphId);
+        info.lastUsed = frame;
+        info.pending = true;
+        face.glyphs.insert(glyphId << 2, info);
+        pending.push_back({ NULL, &face, (GlyphDescriptor)(glyphId << 2) });
+        return info;
+    }
+
+    GlyphInfo FontCache::placeSDFGlyph(SDFFaceData& face, int glyphId, const GlyphBitmap& glyph) {
+        // Glyphs without an outline like spaces only have an advance
+        GlyphInfo info;
+        info.size = Size(0, 0);
+        info.offset = Vec2f(0, 0);
+        info.coords.layer = 0;
+        info.coords.size = Sizei(0, 0);
+        info.distanceField = true;
+        info.xAdvance = glyph.xAdvance;
+        info.lastUsed = frame;
+        info.pending = false;
+
+        // Add to the atlas
+        // If it can't fit in a page or all pages are in use, the glyph is drawn empty and not cached so that it's added again after the next trim
+        GlyphCords coords;
+        if (glyph.size.x > 1 && glyph.size.y > 1) {
+            if (!atlas.addGlyph(glyph.size, glyph.bitmap.data(), coords)) {
+                atlasFull |= fitsPage(atlas, glyph.size);
+                face.glyphs.erase(glyphId << 2);
+                store.releaseSDFGlyph(face.name, glyphId);
+                return info;
+            }
+
+            // Only span the centers of the outer texels so that filtering never reads the neighbouring glyphs.
+            // The outer texels are a full spread away from the outline so nothing visible is lost.
+            Vec2f inset = Vec2f(0.5f, 0.5f) * (1.0f / (float)atlas.getTextureSize());
+            coords.TL = coords.TL + inset;
+            coords.BR = coords.BR - inset;
+            info.coords = coords;
+            info.size = Size(glyph.size.x - 1, glyph.size.y - 1);
+            info.offset = Vec2f((float)glyph.offset.x + 0.5f, (float)glyph.offset.y - 0.5f);
+        }
+
+        // Push entry to the cache
+        face.glyphs.insert(glyphId << 2, info);
+        glyphCount++;
+
+        // Return glyph info
+        return info;
+    }
+
+    void FontCache::evictSDFGlyph(SDFFaceData& face, int glyphId) {
+        // Only forget the glyph, its area in the atlas is reclaimed when the atlas is compacted
+        const Sizei& size = face.glyphs.find(glyphId << 2)->coords.size;
+        evictedArea += size.x * size.y;
+        face.glyphs.erase(glyphId << 2);
+        store.releaseSDFGlyph(face.name, glyphId);
+        glyphCount--;
     }
 }
\ No newline at end of file
@@ -2,86 +2,175 @@
 #include "font_atlas.h"
 #include "../../types.h"
 #include "../../font.h"
-#include <map>
+#include "../../font_store.h"
+#include "../../glyph_table.h"
 #include <unordered_map>
+#include <vector>
 #include <memory>
-#include <functional>
-#include <ft2build.h>
-#include FT_FREETYPE_H
-#include FT_CACHE_H
 
 #define GFX_OPENGL_GLYPH_SUBPIXELS  4
+#define GFX_OPENGL_GLYPH_BUDGET     8192
+#define GFX_OPENGL_PAGE_BUDGET      8
+#define GFX_OPENGL_PAGE_WASTE       0.5f
 
 namespace gfx::OpenGL {
-    struct FontFile {
-        uint8_t* data;
-        size_t size;
-    };
-
-    struct FontMetrics {
-        float ascender;
-        float descender;
+    enum GlyphMode {
+        GLYPH_MODE_BITMAP,
+        GLYPH_MODE_SDF
     };
 
     struct GlyphInfo {
-        // Glyph geometry
-        Sizei size;
-        Vec2i offset;
+        // Glyph geometry in pixels
+        Size size;
+        Vec2f offset;
 
         // Texture location
         GlyphCords coords;
-        GLuint textureId;
+
+        // Whether the texture holds a signed distance field instead of the coverage of the glyph
+        bool distanceField;
 
         // Advance instructions
         float xAdvance;
 
-        // Usage statistics
-        int refCount;
+        // Frame in which the glyph was last used
+        uint32_t lastUsed;
+
+        // Whether the glyph is still being rasterized, in which case it only has an advance
+        bool pending;
     };
 
-    typedef uint32_t GlyphDescriptor;
+    struct SDFFaceData {
+        // Name of the font in the font store
+        std::string name;
+
+        // Glyphs by descriptor with no sub-pixel alignment, in pixels of the reference size
+        GlyphTable<GlyphInfo> glyphs;
+    };
 
     struct FontData {
-        FT_Face face;
-        FT_GlyphSlot slot;
-        FontMetrics metrics;
-        std::map<GlyphDescriptor, GlyphInfo> glyphs;
+        // Font in the font store
+        StoredFont* font;
+
+        // Glyphs placed in the atlas by descriptor
+        GlyphTable<GlyphInfo> glyphs;
+        SDFFaceData* sdf;
+
+        // Kerning pairs of the face, NULL until first needed
+        const KerningTable* kerning;
+    };
+
+    struct PendingGlyph {
+        // Font or distance fields of the face to which the glyph belongs
+        FontData* font;
+        SDFFaceData* sdf;
+
+        // Descriptor of the glyph, without sub-pixel alignment for distance fields
+        GlyphDescriptor desc;
     };
 
-    struct GlyphPair {
-        int leftId;
-        int rightId;
+    struct FontSlot {
+        // Generation of the font handle the slot was resolved for
+        uint32_t generation;
 
-        inline bool operator==(const GlyphPair& b) const {
-            return leftId == b.leftId && rightId == b.rightId;
-        }
+        // Data of the font, NULL if the slot was never resolved
+        FontData* data;
     };
 
+    /**
+     * Per-context cache of the glyphs placed in the font atlas. Font files and rasterized glyphs come from the
+     * process-wide FontStore, so painters of different windows don't load or rasterize them again.
+    */
     class FontCache {
     public:
-        FontCache(const std::function<void(int)>& bindTexture);
+        FontCache();
+
+        // Destructor
+        ~FontCache();
 
         /**
-         * Load a font from file.
-         * @param path Path to the font file.
+         * Get how glyphs are rasterized.
+         * @return Glyph mode of the cache.
         */
-        void loadFont(const std::string& path);
+        GlyphMode getGlyphMode() const { return mode; }
+
+        /**
+         * Select how glyphs are rasterized. Bitmap glyphs are rasterized for each size and sub-pixel alignment and look the sharpest.
+         * Distance field glyphs are rasterized once per face and scaled to any size and alignment, so the atlas doesn't grow with the number of sizes in use.
+         * Glyphs already handed out stay valid.
+         * @param mode Glyph mode to use for the glyphs fetched from now on.
+        */
+        void setGlyphMode(GlyphMode mode) { this->mode = mode; }
+
+        /**
+         * Check whether missing glyphs are rasterized in the background.
+         * @return True if rasterized in the background, false if rasterized when first fetched.
+        */
+        bool getAsyncGlyphs() const { return asyncGlyphs; }
+
+        /**
+         * Select whether missing glyphs are rasterized in the background. If so, a glyph fetched for the first time only has
+         * its advance until a later frame, so text keeps its layout but its characters pop in once rasterized.
+         * Disabled by default.
+         * @param enabled True to rasterize in the background, false to rasterize when first fetched.
+        */
+        void setAsyncGlyphs(bool enabled) { asyncGlyphs = enabled; }
+
+        /**
+         * Set how many glyphs and atlas pages the cache may hold before the least recently used glyphs are evicted.
+         * Glyphs used in the current or previous frame are never evicted, so the budget can be exceeded temporarily.
+         * @param maxGlyphs Maximum number of cached glyphs.
+         * @param maxPages Maximum number of atlas pages.
+        */
+        void setBudget(int maxGlyphs, int maxPages);
 
         /**
-         * Notify that cache that a font is about to be used so that its tag can be filled in for fast access.
-         * @param font Font to prepare.
+         * Get the number of glyphs currently cached, including those without a texture.
+         * @return Number of cached glyphs.
         */
-       void prepareFont(Font& font);
+        int getGlyphCount() const { return glyphCount; }
 
         /**
-         * Get the metrics of a font. The font must have been prepared first.
+         * Check if the cache holds more glyphs or atlas pages than its budget, in which case the next frame evicts glyphs.
+         * @return True if over budget, false otherwise.
+        */
+        bool isOverBudget() const { return glyphCount > maxGlyphs || atlas.getPageCount() > maxPages; }
+
+        /**
+         * Get the current frame, as counted by newFrame().
+         * @return Frame counter. Wraps around.
+        */
+        uint32_t getFrame() const { return frame; }
+
+        /**
+         * Get the generation of the glyphs handed out. It changes when the atlas moves glyphs and when glyphs rasterized in the
+         * background replace the ones handed out without a texture, so geometry built from older glyphs has to be built again.
+         * @return Generation of the glyphs.
+        */
+        uint64_t getGeneration() const { return atlas.getGeneration() + filledGeneration; }
+
+        /**
+         * Notify the cache that a new frame begins. Glyphs rasterized in the background since the previous frame are placed in the atlas.
+         * If the cache is over budget, the least recently used glyphs are evicted and the atlas is compacted, which moves the remaining glyphs.
+         * Glyphs fetched before this call must not be used after it.
+        */
+        void newFrame();
+
+        /**
+         * Load a font from file into the font store, making it available to all painters.
+         * @param path Path to the font file.
+        */
+        void loadFont(const std::string& path);
+
+        /**
+         * Get the metrics of a font.
          * @param font Font to get the metrics of.
          * @return Metrics of the font.
         */
         FontMetrics getFontMetrics(const Font& font);
 
         /**
-         * Get a glyph from a font by ID and alignement. Can only be called once OpenGL is set up. The font must have been prepared first.
+         * Get a glyph from a font by ID and alignement. Can only be called once OpenGL is set up.
          * @param font Font to which the glyphs belong.
          * @param glyphId Unicode ID of the glyph.
          * @param alignment Sub-pixel alignement. Must be between 0 and 3 inclusive.
@@ -89,28 +178,67 @@ namespace gfx::OpenGL {
         GlyphInfo getGlyph(const Font& font, int glyphId, int alignment);
 
         /**
-         * Get the kerning information for two adjacent glyphs by their IDs. Can only be called once OpenGL is set up. The font must have been prepared first.
+         * Rasterize the glyphs of ranges of codepoints in the background and place them in the atlas as they become ready,
+         * so that the first frames showing them don't have to. All sub-pixel alignments are prepared in bitmap mode.
+         * @param font Font to which the glyphs belong.
+         * @param ranges Codepoints to prepare.
+        */
+        void prewarm(const Font& font, const std::vector<CodepointRange>& ranges);
+
+        /**
+         * Mark a glyph as used in the current frame without fetching it, so that it isn't evicted. Does nothing if the glyph isn't cached.
+         * @param font Font to which the glyph belongs.
+         * @param desc Descriptor of the glyph.
+        */
+        void touchGlyph(const Font& font, GlyphDescriptor desc);
+
+        /**
+         * Get the kerning of two adjacent glyphs.
          * @param font Font to which the glyphs belong.
          * @param leftId Unicode ID of the left glyph.
          * @param rightId Unicode ID of the right glyph.
+         * @return Adjustment of the advance of the left glyph in pixels.
         */
-        Vec2f getKerning(const Font& font, int leftId, int rightId);
+        float getKerning(const Font& font, int leftId, int rightId);
 
         FontAtlas atlas;
 
     private:
-        static void initFreetype();
+        FontData& getData(const Font& font);
+        void trim();
+
+        void collectGlyphs();
 
-        void admitFont(const Font& font);
-        void evictFont(const Font& font);
-        
         GlyphInfo admitGlyph(FontData& font, GlyphDescriptor desc);
+        GlyphInfo placeGlyph(FontData& font, GlyphDescriptor desc, const GlyphBitmap& glyph);
         void evictGlyph(FontData& font, GlyphDescriptor desc);
 
-        std::unordered_map<std::string, FontFile> fontFiles;
-        std::unordered_map<Font, FontData> fonts;
-
-        static bool isInit;
-        static FT_Library library;
+        SDFFaceData* admitSDFFace(const std::string& name);
+        GlyphInfo admitSDFGlyph(SDFFaceData& face, int glyphId);
+        GlyphInfo placeSDFGlyph(SDFFaceData& face, int glyphId, const GlyphBitmap& glyph);
+        void evictSDFGlyph(SDFFaceData& face, int glyphId);
+
+        FontStore& store;
+        std::unordered_map<StoredFont*, FontData> fonts;
+        std::unordered_map<std::string, SDFFaceData> sdfFaces;
+        GlyphMode mode = GLYPH_MODE_BITMAP;
+        uint32_t frame = 0;
+        int glyphCount = 0;
+        int maxGlyphs = GFX_OPENGL_GLYPH_BUDGET;
+        int maxPages = GFX_OPENGL_PAGE_BUDGET;
+
+        // Atlas area of the glyphs evicted since the atlas was last compacted, in texels
+        int64_t evictedArea = 0;
+
+        // Whether a glyph didn't fit in the atlas since the last trim, which then makes room for it
+        bool atlasFull = false;
+
+        // Glyphs being rasterized in the background, and how many times they replaced glyphs already handed out
+        bool asyncGlyphs = false;
+        std::vector<PendingGlyph> pending;
+        uint64_t filledGeneration = 0;
+
+        // Data of the fonts by the ID of their handle, resolved once per handle
+        std::vector<FontSlot> slots;
     };
 }
\ No newline at end of file
@@ -0,0 +1,229 @@
+#include "offscreen.h"
+#include "flog/flog.h"
+#include <stdexcept>
+#include <string.h>
+
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+namespace gfx::OpenGL {
+    OffscreenContext::OffscreenContext(const Sizei& size, int samples) {
+        // Save parameters
+        this->size = size;
+        this->samples = samples;
+
+        // Get a display that doesn't need a windowing system if possible
+        EGLDisplay dpy = EGL_NO_DISPLAY;
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            dpy = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+        if (dpy == EGL_NO_DISPLAY) {
+            dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+
+        // Initialize EGL
+        EGLint major, minor;
+        if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, &major, &minor)) {
+            throw std::runtime_error("Could not initialize EGL");
+        }
+        display = dpy;
+
+        // Release whatever was created if anything fails from here on
+        try {
+            const char* extensions = eglQueryString(dpy, EGL_EXTENSIONS);
+            bool surfaceless = extensions && strstr(extensions, "EGL_KHR_surfaceless_context");
+            bool noConfig = extensions && strstr(extensions, "EGL_KHR_no_config_context");
+
+            // Select desktop OpenGL
+            if (!eglBindAPI(EGL_OPENGL_API)) {
+                throw std::runtime_error("EGL does not support desktop OpenGL");
+            }
+
+            // Choose a config, surfaceless displays might not have any
+            const EGLint configAttribs[] = {
+                EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+                EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                EGL_RED_SIZE, 8,
+                EGL_GREEN_SIZE, 8,
+                EGL_BLUE_SIZE, 8,
+                EGL_ALPHA_SIZE, 8,
+                EGL_NONE
+            };
+            EGLConfig config = NULL;
+            EGLint configCount = 0;
+            eglChooseConfig(dpy, configAttribs, &config, 1, &configCount);
+            if (!configCount) {
+                if (!noConfig || !surfaceless) { throw std::runtime_error("No usable EGL config"); }
+                config = EGL_NO_CONFIG_KHR;
+            }
+
+            // Create an OpenGL 3.0 context
+            const EGLint contextAttribs[] = {
+                EGL_CONTEXT_MAJOR_VERSION, 3,
+                EGL_CONTEXT_MINOR_VERSION, 0,
+                EGL_NONE
+            };
+            EGLContext ctx = eglCreateContext(dpy, config, EGL_NO_CONTEXT, contextAttribs);
+            if (ctx == EGL_NO_CONTEXT) {
+                throw std::runtime_error("Could not create EGL context");
+            }
+            context = ctx;
+
+            // Without surfaceless support, a dummy pbuffer is needed to make the context current
+            if (!surfaceless) {
+                const EGLint pbufferAttribs[] = {
+                    EGL_WIDTH, 1,
+                    EGL_HEIGHT, 1,
+                    EGL_NONE
+                };
+                EGLSurface surf = eglCreatePbufferSurface(dpy, config, pbufferAttribs);
+                if (surf == EGL_NO_SURFACE) {
+                    throw std::runtime_error("Could not create EGL pbuffer");
+                }
+                surface = surf;
+            }
+
+            // Bind the context
+            makeCurrent();
+
+            // Init GLAD
+            if (!gladLoadGLLoader((GLADloadproc)eglGetProcAddress)) {
+                throw std::runtime_error("Could not load OpenGL");
+            }
+            flog::debug("Offscreen context: EGL {}.{}, {}", major, minor, (const char*)glGetString(GL_RENDERER));
+
+            // Create the framebuffer to render into
+            createFramebuffer();
+
+            // Create the painter
+            painter = std::make_unique<Painter>(size);
+        }
+        catch (...) {
+            destroy();
+            throw;
+        }
+    }
+
+    OffscreenContext::~OffscreenContext() {
+        destroy();
+    }
+
+    void OffscreenContext::makeCurrent() {
+        if (!eglMakeCurrent(display, surface, surface, context)) {
+            throw std::runtime_error("Could not make the EGL context current");
+        }
+    }
+
+    void OffscreenContext::beginFrame(const Color& clearColor) {
+        // Bind the framebuffer and set the viewport
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glViewport(0, 0, size.x, size.y);
+
+        // Clear frame
+        glDisable(GL_SCISSOR_TEST);
+        glClearColor(clearColor.r, clearColor.g, clearColor.b, clearColor.a);
+        glClear(GL_COLOR_BUFFER_BIT);
+
+        // Begin the render
+        painter->beginRender();
+    }
+
+    void OffscreenContext::endFrame() {
+        // Finish the render
+        painter->endRender();
+
+        // Resolve the multisampled image if needed
+        if (resolveFbo) {
+            glDisable(GL_SCISSOR_TEST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFbo);
+            glBlitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+
+        // Wait for the GPU to be done
+        glFinish();
+    }
+
+    void OffscreenContext::readPixels(uint32_t* pixels) {
+        // Read from the framebuffer holding the final image
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFbo ? resolveFbo : fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+        // OpenGL returns the bottom line first, flip the image
+        std::vector<uint32_t> line(size.x);
+        for (int i = 0; i < size.y / 2; i++) {
+            uint32_t* top = &pixels[i * size.x];
+            uint32_t* bottom = &pixels[(size.y - 1 - i) * size.x];
+            memcpy(line.data(), top, size.x * sizeof(uint32_t));
+            memcpy(top, bottom, size.x * sizeof(uint32_t));
+            memcpy(bottom, line.data(), size.x * sizeof(uint32_t));
+        }
+    }
+
+    std::vector<uint32_t> OffscreenContext::readPixels() {
+        std::vector<uint32_t> pixels(size.x * size.y);
+        readPixels(pixels.data());
+        return pixels;
+    }
+
+    void OffscreenContext::destroy() {
+        // The GL objects can only exist if the context was made current, so destroy them while it still is
+        if (painter || fbo) {
+            eglMakeCurrent(display, surface, surface, context);
+            painter.reset();
+
+            // Destroy the framebuffers
+            if (fbo) {
+                glDeleteFramebuffers(1, &fbo);
+                glDeleteRenderbuffers(1, &colorRbo);
+            }
+            if (resolveFbo) {
+                glDeleteFramebuffers(1, &resolveFbo);
+                glDeleteRenderbuffers(1, &resolveRbo);
+            }
+        }
+
+        // Destroy the EGL objects
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface) { eglDestroySurface(display, surface); }
+        if (context) { eglDestroyContext(display, context); }
+        eglTerminate(display);
+    }
+
+    void OffscreenContext::createFramebuffer() {
+        // Create the framebuffer that the painter draws into
+        glGenFramebuffers(1, &fbo);
+        glGenRenderbuffers(1, &colorRbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRbo);
+        if (samples) {
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, size.x, size.y);
+        }
+        else {
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRbo);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("Could not create offscreen framebuffer");
+        }
+
+        // When multisampling, create a single-sampled framebuffer to resolve the image into
+        if (samples) {
+            glGenFramebuffers(1, &resolveFbo);
+            glGenRenderbuffers(1, &resolveRbo);
+            glBindRenderbuffer(GL_RENDERBUFFER, resolveRbo);
+            glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.x, size.y);
+            glBindFramebuffer(GL_FRAMEBUFFER, resolveFbo);
+            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolveRbo);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                throw std::runtime_error("Could not create offscreen resolve framebuffer");
+            }
+        }
+
+        // Leave the render framebuffer bound
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,81 @@
+#pragma once
+#include "painter.h"
+#include "../../color.h"
+#include <memory>
+#include <vector>
+
+namespace gfx::OpenGL {
+    class OffscreenContext {
+    public:
+        /**
+         * Create a headless OpenGL context rendering into a framebuffer object. No window or display server is needed.
+         * The context is made current on the calling thread and OpenGL is loaded.
+         * @param size Size of the canvas.
+         * @param samples Number of multisampling samples, zero to disable multisampling.
+        */
+        OffscreenContext(const Sizei& size, int samples = 0);
+
+        // Destructor
+        ~OffscreenContext();
+
+        /**
+         * Get the size of the canvas.
+         * @return Size of the canvas.
+        */
+        Sizei getSize() const { return size; }
+
+        /**
+         * Get the painter drawing into the offscreen framebuffer.
+         * @return Painter of the context.
+        */
+        Painter& getPainter() { return *painter; }
+
+        /**
+         * Make the context current on the calling thread.
+        */
+        void makeCurrent();
+
+        /**
+         * Clear the framebuffer and start rendering a frame with the painter.
+         * @param clearColor Color to clear the framebuffer with.
+        */
+        void beginFrame(const Color& clearColor = Color(0.0f, 0.0f, 0.0f, 1.0f));
+
+        /**
+         * Finish rendering a frame and wait for the GPU to be done with it.
+        */
+        void endFrame();
+
+        /**
+         * Read back the content of the framebuffer. Pixels are stored line by line from the top as R, G, B, A bytes.
+         * @param pixels Buffer of at least width*height pixels that the frame is written to.
+        */
+        void readPixels(uint32_t* pixels);
+
+        /**
+         * Read back the content of the framebuffer. Pixels are stored line by line from the top as R, G, B, A bytes.
+         * @return Pixels of the frame.
+        */
+        std::vector<uint32_t> readPixels();
+
+    private:
+        void createFramebuffer();
+        void destroy();
+
+        Sizei size;
+        int samples;
+
+        // EGL objects, kept opaque to avoid leaking EGL headers
+        void* display = NULL;
+        void* context = NULL;
+        void* surface = NULL;
+
+        // Framebuffer objects. When multisampling, the resolve framebuffer holds the final image.
+        GLuint fbo = 0;
+        GLuint colorRbo = 0;
+        GLuint resolveFbo = 0;
+        GLuint resolveRbo = 0;
+
+        std::unique_ptr<Painter> painter;
+    };
+}
\ No newline at end of file
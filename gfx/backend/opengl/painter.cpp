@@ -2,14 +2,36 @@
 #include "shader.h"
 #include "shader_source.h"
 #include "font_cache.h"
+#include "../../utf8.h"
+#include "../../arc.h"
+#include "flog/flog.h"
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
 #include <math.h>
+#include <float.h>
 #include <stdexcept>
 
 #define FL_M_PI 3.141592653589793238462643383279502884197f
 
-#define NULL_TEXTURE    0
-
 namespace gfx::OpenGL {
+    inline uint8_t unorm8(float value) {
+        return (uint8_t)(std::clamp<float>(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+
+    inline uint16_t unorm16(float value) {
+        return (uint16_t)(std::clamp<float>(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+
+    inline int getListFont(DisplayList& list, const Font& font) {
+        // Lists use few fonts, so they're simply searched
+        for (size_t i = 0; i < list.fonts.size(); i++) {
+            if (list.fonts[i] == font) { return (int)i; }
+        }
+        list.fonts.push_back(font);
+        return (int)list.fonts.size() - 1;
+    }
+
     Painter::Painter(const Sizei& canvasSize) {
         // Set canvas size which also generates the projection matrix
         setCanvasSize(canvasSize);
@@ -24,6 +46,9 @@ namespace gfx::OpenGL {
         posAttr = shader->getAttribute("posAttr");
         colorAttr = shader->getAttribute("colorAttr");
         texCoordAttr = shader->getAttribute("texCoordAttr");
+        layerAttr = shader->getAttribute("layerAttr");
+        clipAttr = shader->getAttribute("clipAttr");
+        clipRectsUnif = shader->getUniform("clipRects");
 
         // Allocate buffer objects
         glGenVertexArrays(1, &VAO);
@@ -34,28 +59,80 @@ namespace gfx::OpenGL {
         glBindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glVertexAttribPointer(posAttr, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(0 * sizeof(float)));
-        glVertexAttribPointer(colorAttr, 4, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(2 * sizeof(float)));
-        glVertexAttribPointer(texCoordAttr, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glVertexAttribPointer(posAttr, 2, GL_FLOAT, GL_FALSE, sizeof(VertexAttrib), (void*)offsetof(VertexAttrib, pos));
+        glVertexAttribPointer(colorAttr, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(VertexAttrib), (void*)offsetof(VertexAttrib, color));
+        glVertexAttribPointer(texCoordAttr, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(VertexAttrib), (void*)offsetof(VertexAttrib, texCoord));
+        glVertexAttribPointer(layerAttr, 1, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(VertexAttrib), (void*)offsetof(VertexAttrib, layer));
         glEnableVertexAttribArray(posAttr);
         glEnableVertexAttribArray(colorAttr);
         glEnableVertexAttribArray(texCoordAttr);
-
-        // Load null texture
-        uint32_t white = 0xFFFFFFFF;
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, NULL_TEXTURE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &white);
+        glVertexAttribPointer(clipAttr, 1, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(VertexAttrib), (void*)offsetof(VertexAttrib, clip));
+        glEnableVertexAttribArray(layerAttr);
+        glEnableVertexAttribArray(clipAttr);
+
+        // Load the quad shader
+        quadShader = std::make_shared<Shader>(QUAD_VERTEX_SHADER_SRC, FRAGMENT_SHADER_SRC);
+        quadScaleUnif = quadShader->getUniform("scaleUnif");
+        quadOffsetUnif = quadShader->getUniform("offsetUnif");
+        quadSamplerUnif = quadShader->getUniform("sampler");
+        quadTextureUnif = quadShader->getUniform("quadSampler");
+        quadBaseUnif = quadShader->getUniform("quadBaseUnif");
+        quadClipRectsUnif = quadShader->getUniform("clipRects");
+        quadTranslateUnif = quadShader->getUniform("quadTranslateUnif");
+        cornerAttr = quadShader->getAttribute("cornerAttr");
+
+        // Allocate the quad objects, the static buffers are filled when first needed
+        glGenVertexArrays(1, &quadVAO);
+        glGenBuffers(1, &cornerVBO);
+        glGenBuffers(1, &quadEBO);
+        glGenTextures(1, &quadTexture);
+
+        // Define the quad vertex format, only the corner of the unit quad is an attribute
+        glBindVertexArray(quadVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cornerVBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quadEBO);
+        glVertexAttribPointer(cornerAttr, 2, GL_UNSIGNED_BYTE, GL_FALSE, 2 * sizeof(uint8_t), (void*)0);
+        glEnableVertexAttribArray(cornerAttr);
+
+        // Limit the number of quads per batch to what fits in the tallest possible texture
+        GLint maxTextureSize;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+        maxQuads = maxTextureSize * (GFX_OPENGL_QUAD_TEXTURE_WIDTH / 2);
+
+        // Integer textures can only be sampled without filtering
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, quadTexture);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        activeTexture = NULL_TEXTURE;
 
-        // Init the font cache
-        fc = new FontCache([=](int id) { selectTexture(id); });
+        // Stream geometry through ring buffers when buffers can be mapped
+        streaming = (glMapBufferRange != NULL);
+
+        // Init the font cache, its atlas holds the texture of all geometry
+        glActiveTexture(GL_TEXTURE0);
+        fc = new FontCache();
     }
 
     Painter::~Painter() {
-        // TODO
+        // Free the records of the text grids
+        for (auto& [id, state] : grids) {
+            if (state.texture) { glDeleteTextures(1, &state.texture); }
+        }
+
+        // Free the font cache, which frees the atlas and gives the glyphs back to the font store
+        delete fc;
+        fc = NULL;
+
+        // Free the quad objects
+        glDeleteTextures(1, &quadTexture);
+        glDeleteBuffers(1, &quadEBO);
+        glDeleteBuffers(1, &cornerVBO);
+        glDeleteVertexArrays(1, &quadVAO);
+
+        // Free the buffer objects, which also hold the ring buffers when streaming
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteVertexArrays(1, &VAO);
     }
 
     Sizei Painter::getCanvasSize() const {
@@ -71,67 +148,144 @@ namespace gfx::OpenGL {
 
         // Update the stencil
         stencil = Recti(Pointi(0, 0), canvasSize - Sizei(1, 1));
-        updateStencil();
+        stencilVisible = true;
+        clipSlot = -1;
+    }
+
+    void Painter::setStreaming(bool enabled) {
+        // Nothing to do if the mode doesn't change
+        if (enabled == streaming) { return; }
+        streaming = enabled;
+
+        // The buffers are reallocated on the next flush in the format of the new mode
+        VBOCapacity = 0;
+        EBOCapacity = 0;
+        VBOHead = 0;
+        EBOHead = 0;
     }
 
     void Painter::beginRender() {
+        // Reset the statistics
+        stats = {};
+
+        // Glyphs drawn from text blobs aren't fetched, so mark those of the blobs drawn in the last frame as used before any gets evicted
+        if (fc->isOverBudget()) {
+            uint32_t frame = fc->getFrame();
+            blobs.forEach([this, frame](TextBlob& blob) {
+                if (blob.lastDrawn != frame || !isCurrent(blob)) { return; }
+                for (GlyphDescriptor desc : blob.glyphs) { fc->touchGlyph(blob.getFont(), desc); }
+            });
+            for (const auto& [id, state] : grids) {
+                if (state.lastDrawn != frame) { continue; }
+                for (GlyphDescriptor desc : state.glyphs) {
+                    if (desc) { fc->touchGlyph(state.font, desc); }
+                }
+            }
+        }
+
+        // Free the records of the grids that weren't drawn for a while, they were most likely destroyed
+        for (auto it = grids.begin(); it != grids.end();) {
+            if (fc->getFrame() - it->second.lastDrawn > GFX_OPENGL_GRID_RETENTION) {
+                glDeleteTextures(1, &it->second.texture);
+                it = grids.erase(it);
+            }
+            else {
+                it++;
+            }
+        }
+
+        // Let the font cache place the glyphs rasterized in the background and evict glyphs while nothing references them
+        fc->newFrame();
+
         // Reset the stencil and offset
         if (!stencils.empty()) { stencils = std::stack<Recti>(); }
+        if (!stencilVisibilities.empty()) { stencilVisibilities = std::stack<bool>(); }
+        if (!stencilSlots.empty()) { stencilSlots = std::stack<StencilSlot>(); }
         if (!offsets.empty()) { offsets = std::stack<Pointi>(); }
         stencil = Recti(Pointi(0, 0), Pointi(canvasSize.x - 1, canvasSize.y - 1));
+        stencilVisible = true;
         offset = Pointi(0, 0);
+        clipCount = 0;
+        clipSlot = -1;
+        batchSerial++;
 
-        // Setup OpenGL options
+        // Setup OpenGL options. Stencils are done with clip distances so that they don't break batches.
         glDisable(GL_DEPTH_TEST);
         glEnable(GL_BLEND);
-        glEnable(GL_SCISSOR_TEST);
+        glDisable(GL_SCISSOR_TEST);
+        for (int i = 0; i < 4; i++) { glEnable(GL_CLIP_DISTANCE0 + i); }
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        // Bind buffers
-        glBindVertexArray(VAO);
-
-        // Load shader and set uniform variables
+        // Load the shaders and set uniform variables
+        quadShader->use();
+        glUniform2fv(quadScaleUnif, 1, scaleVec.data);
+        glUniform2fv(quadOffsetUnif, 1, offsetVec.data);
+        glUniform1i(quadSamplerUnif, 0);
+        glUniform1i(quadTextureUnif, 1);
         shader->use();
         glUniform2fv(scaleUnif, 1, scaleVec.data);
+        glUniform2fv(offsetUnif, 1, offsetVec.data);
         glUniform1i(samplerUnif, 0);
-
-        // Set the stencil and offset
-        updateStencil();
-        updateOffset();
+        batchType = BATCH_TRIANGLES;
 
         // Configure textures to allow non-multiple of 4 widths
         // TODO: GET RID IF THIS WHEN FULL COLOR IS USED FOR FONTS
         glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
-        // Load texture
+        // Bind the quad records and the atlas. Shapes use the white texel of the atlas so it's the only texture ever needed
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, quadTexture);
         glActiveTexture(GL_TEXTURE0);
-        selectTexture(NULL_TEXTURE);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, fc->atlas.getTextureID());
     }
 
     void Painter::endRender() {
         // Flush remaining geometry
         flush();
+
+        // Restore the default clipping state
+        for (int i = 0; i < 4; i++) { glDisable(GL_CLIP_DISTANCE0 + i); }
     }
 
     void Painter::pushStencil(const Recti& stencil) {
-        // Flush any remaining draw commands
-        flush();
+        // Compute the stencil in absolute coordinates
+        Recti absStencil(stencil.A() + offset, stencil.B() + offset);
+
+        // When compiling, only record the stencil. The list is split there so that it can be replayed under any stencil.
+        if (capture) {
+            flush();
+            DisplayListOp op = {};
+            op.type = DISPLAY_LIST_OP_PUSH_STENCIL;
+            op.stencil = absStencil;
+            capture->ops.push_back(op);
+            captureStencilDepth++;
+            return;
+        }
 
         // Push the current stencil
         stencils.push(this->stencil);
+        stencilVisibilities.push(stencilVisible);
+        stencilSlots.push({ clipSlot, batchSerial });
 
-        // Compute the new stencil
-        Recti absStencil(stencil.A() + offset, stencil.B() + offset);
-        Recti newStencil = this->stencil & absStencil;
+        // Compute the new stencil, nothing is visible anymore if the stencils don't overlap
+        stencilVisible = stencilVisible && (this->stencil && absStencil);
+        if (stencilVisible) { this->stencil = this->stencil & absStencil; }
 
-        // Update the stencil
-        this->stencil = newStencil;
-        updateStencil();
+        // The stencil needs a new slot in the clip table
+        clipSlot = -1;
     }
 
     void Painter::popStencil() {
-        // Flush any remaining draw commands
-        flush();
+        // When compiling, only record the operation
+        if (capture) {
+            if (!captureStencilDepth) { throw std::runtime_error("Cannot pop stencil, no stencil was pushed"); }
+            flush();
+            DisplayListOp op = {};
+            op.type = DISPLAY_LIST_OP_POP_STENCIL;
+            capture->ops.push_back(op);
+            captureStencilDepth--;
+            return;
+        }
 
         // If no stencil was previous pushed, give up
         if (stencils.empty()) { throw std::runtime_error("Cannot pop stencil, no stencil was pushed"); }
@@ -139,41 +293,35 @@ namespace gfx::OpenGL {
         // Pop the stencil
         stencil = stencils.top();
         stencils.pop();
+        stencilVisible = stencilVisibilities.top();
+        stencilVisibilities.pop();
 
-        // Update the stencil GPU-size
-        updateStencil();
+        // The stencil keeps its slot in the clip table unless the table was emptied since it was pushed
+        const StencilSlot& slot = stencilSlots.top();
+        clipSlot = (slot.batch == batchSerial) ? slot.slot : -1;
+        stencilSlots.pop();
     }
 
     void Painter::pushOffset(const Pointi& offset) {
-        // Flush any remaining draw commands
-        flush();
-
         // Push the current offset
         offsets.push(this->offset);
 
-        // Update the offset
+        // Update the offset, it's applied to the geometry as it's generated
         this->offset = this->offset + offset;
-        updateOffset();
     }
 
     void Painter::popOffset() {
-        // Flush any remaining draw commands
-        flush();
-
         // If no stencil was previous pushed, give up
         if (offsets.empty()) { throw std::runtime_error("Cannot pop offset, no offset was pushed"); }
 
         // Pop the stencil
         offset = offsets.top();
         offsets.pop();
-
-        // Update the offset GPU-size
-        updateOffset();
     }
 
     void Painter::drawLine(const Point& a, const Point& b, const Color& color, float thickness) {
-        // Select the null texutre
-        selectTexture(NULL_TEXTURE);
+        // Skip if entirely stenciled out
+        if (!beginPrimitive(BATCH_TRIANGLES)) { return; }
 
         // Compute forward vector
         Vec2f forw = b - a;
@@ -195,65 +343,76 @@ namespace gfx::OpenGL {
     }
 
     void Painter::drawRect(const Rect& area, const Color& color, float thickness, float borderRadius) {
-        // Select the null texutre
-        selectTexture(NULL_TEXTURE);
-        
-        // The triangulation depends on whether the border is rounded
-        if (borderRadius > 0.0f) {
-            // TODO
+        // Compute the outer and inner edges
+        Vec2f tl = Vec2f(area.A().x, area.A().y) - Vec2f(0.5f, 0.5f);
+        Vec2f size = Vec2f(area.B().x - area.A().x, area.B().y - area.A().y) + Vec2f(1.0f, 1.0f);
+        Vec2f br = tl + size;
+        Vec2f itl = tl + Vec2f(thickness, thickness);
+        Vec2f ibr = br - Vec2f(thickness, thickness);
+
+        // If the border fills the whole rectangle, draw it as a filled one
+        if (itl.x >= ibr.x || itl.y >= ibr.y) {
+            fillRect(area, color, borderRadius);
+            return;
         }
-        else {
-            // Create vertices
-            float w = thickness - 1.0f;
-            int otl = addVertex(Vec2f(area.A().x, area.A().y) + Vec2f(-0.5f, -0.5f), color);
-            int otr = addVertex(Vec2f(area.B().x, area.A().y) + Vec2f(0.5f, -0.5f), color);
-            int obl = addVertex(Vec2f(area.A().x, area.B().y) + Vec2f(-0.5f, 0.5f), color);
-            int obr = addVertex(Vec2f(area.B().x, area.B().y) + Vec2f(0.5f, 0.5f), color);
-            int itl = addVertex(Vec2f(area.A().x, area.A().y) + Vec2f(0.5f + w, 0.5f + w), color);
-            int itr = addVertex(Vec2f(area.B().x, area.A().y) + Vec2f(-0.5f - w, 0.5f + w), color);
-            int ibl = addVertex(Vec2f(area.A().x, area.B().y) + Vec2f(0.5f + w, -0.5f - w), color);
-            int ibr = addVertex(Vec2f(area.B().x, area.B().y) + Vec2f(-0.5f - w, -0.5f - w), color);
-
-            // Create triangles
-            addTri(otl, otr, itl); // Top
-            addTri(otr, itl, itr);
-            addTri(otl, itl, obl); // Left
-            addTri(itl, obl, ibl);
-            addTri(ibl, ibr, obl); // Bottom
-            addTri(ibr, obl, obr);
-            addTri(itr, otr, ibr); // Right
-            addTri(otr, ibr, obr);
+
+        // A rounded border goes from the outline of the rectangle to that of the inner one, rounded by what is left of the radius
+        float radius = std::min<float>(borderRadius, std::min<float>(size.x, size.y) * 0.5f);
+        if (radius > 0.0f) {
+            getArcPoints(radius, FL_M_PI, 1.5f*FL_M_PI, arcPoints);
+            getRoundedRectPoints(tl, br, radius, arcPoints, outerPoints);
+            getRoundedRectPoints(itl, ibr, std::max<float>(radius - thickness, 0.0f), arcPoints, innerPoints);
+            addOutline(color);
+            return;
         }
+
+        // Draw the border as four non-overlapping bands
+        addQuad(tl, Vec2f(size.x, thickness), color); // Top
+        addQuad(tl + Vec2f(0, size.y - thickness), Vec2f(size.x, thickness), color); // Bottom
+        addQuad(tl + Vec2f(0, thickness), Vec2f(thickness, size.y - 2.0f*thickness), color); // Left
+        addQuad(tl + Vec2f(size.x - thickness, thickness), Vec2f(thickness, size.y - 2.0f*thickness), color); // Right
     }
 
     void Painter::fillRect(const Rect& area, const Color& color, float borderRadius) {
-        // Select the null texutre
-        selectTexture(NULL_TEXTURE);
-        
-        // The triangulation depends on whether the border is rounded
-        if (borderRadius) {
-            // TODO
+        // Get the corners of the rectangle
+        Vec2f tl = Vec2f(area.A().x, area.A().y) - Vec2f(0.5f, 0.5f);
+        Vec2f br = Vec2f(area.B().x, area.B().y) + Vec2f(0.5f, 0.5f);
+
+        // Without rounding, the rectangle is a single quad
+        float radius = std::min<float>(borderRadius, std::min<float>(br.x - tl.x, br.y - tl.y) * 0.5f);
+        if (radius <= 0.0f) {
+            addQuad(tl, br - tl, color);
+            return;
         }
-        else {
-            // Create vertices
-            int tl = addVertex(Vec2f(area.A().x, area.A().y) + Vec2f(-0.5f, -0.5f), color);
-            int tr = addVertex(Vec2f(area.B().x, area.A().y) + Vec2f(0.5f, -0.5f), color);
-            int bl = addVertex(Vec2f(area.A().x, area.B().y) + Vec2f(-0.5f, 0.5f), color);
-            int br = addVertex(Vec2f(area.B().x, area.B().y) + Vec2f(0.5f, 0.5f), color);
 
-            // Create triangles
-            addTri(tl, tr, bl);
-            addTri(tr, bl, br);
+        // Skip if entirely stenciled out
+        if (!beginPrimitive(BATCH_TRIANGLES)) { return; }
+
+        // Create vertices for the rounded outline and its center
+        getArcPoints(radius, FL_M_PI, 1.5f*FL_M_PI, arcPoints);
+        getRoundedRectPoints(tl, br, radius, arcPoints, outerPoints);
+        int c = addVertex((tl + br) * 0.5f, color);
+        int first = (int)vertices.size();
+        for (const auto& p : outerPoints) {
+            addVertex(p, color);
+        }
+
+        // Create triangles as a fan around the center
+        int count = (int)outerPoints.size();
+        for (int i = 0; i < count; i++) {
+            addTri(first + i, first + (i+1)%count, c);
         }
     }
 
     void Painter::drawPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color, float thickness) {
-        // TODO
+        // Draw the border between the outline of the polygon and its inner edge
+        polygon.getOutline(Point(position.x - 0.5f, position.y - 0.5f), size, thickness, outerPoints, innerPoints);
+        addOutline(color);
     }
 
     void Painter::fillPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color) {
-        // Select the null texutre
-        selectTexture(NULL_TEXTURE);
+        // Skip if entirely stenciled out
+        if (!beginPrimitive(BATCH_TRIANGLES)) { return; }
 
         // Create vertices
         int first = (int)vertices.size();
@@ -268,28 +427,24 @@ namespace gfx::OpenGL {
     }
 
     void Painter::drawArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color, float thickness) {
-        // Select the null texutre
-        selectTexture(NULL_TEXTURE);
-        
+        // Skip if entirely stenciled out
+        if (!beginPrimitive(BATCH_TRIANGLES)) { return; }
+
         // Compute external and internal radii
         float re = diameter / 2.0f;
         float ri = re - thickness;
 
-        // Compute angle interval
-        int vcount = (int)ceil(fabsf((endAngle - startAngle) * re));
-        float dtheta = (endAngle - startAngle) / vcount;
-        vcount++;
+        // Compute the points of the arc, spaced for the outer radius
+        getArcPoints(re, startAngle, endAngle, arcPoints);
+        int vcount = (int)arcPoints.size();
 
         // Convert center point to float
         Vec2f cf = Vec2f(center.x, center.y);
 
         // Create vertices
-        float theta = startAngle;
-        for (int i = 0; i < vcount; i++) {
-            Vec2f phase(cosf(theta), sinf(theta));
+        for (const auto& phase : arcPoints) {
             addVertex(cf - phase*re, color);
             addVertex(cf - phase*ri, color);
-            theta += dtheta;
         }
 
         // Create triangles
@@ -302,26 +457,23 @@ namespace gfx::OpenGL {
     }
 
     void Painter::fillArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color) {
-        // Select the null texutre
-        selectTexture(NULL_TEXTURE);
+        // Skip if entirely stenciled out
+        if (!beginPrimitive(BATCH_TRIANGLES)) { return; }
 
         // Compute radius
         float re = diameter / 2.0f;
 
-        // Compute angle interval
-        int vcount = (int)ceil(fabsf((endAngle - startAngle) * re));
-        float dtheta = (endAngle - startAngle) / vcount;
-        vcount++;
+        // Compute the points of the arc
+        getArcPoints(re, startAngle, endAngle, arcPoints);
+        int vcount = (int)arcPoints.size();
 
         // Create center vertex
         Vec2f cf = Vec2f(center.x, center.y);
         int c = addVertex(Vec2f(center.x, center.y), color);
 
         // Create vertices
-        float theta = startAngle;
-        for (int i = 0; i < vcount; i++) {
-            addVertex(cf - Vec2f(cosf(theta)*re, sinf(theta)*re), color);
-            theta += dtheta;
+        for (const auto& phase : arcPoints) {
+            addVertex(cf - phase*re, color);
         }
 
         // Create triangles
@@ -332,188 +484,786 @@ namespace gfx::OpenGL {
         }
     }
 
-    inline int getCodepoint(const char*& str) {
-        int len = 0;
-        int id = 0;
-        for (unsigned char c; c = *str, c; str++) {
-            // If null, this is the end of the string, give up
-            if (!c) { break; }
+    Size Painter::measureText(const Font& font, const char* str) {
+        // The width is that of the string laid out from a whole pixel
+        return Size(getTextBlob(font, str, 0)->getWidth(), font.getSize());
+    }
 
-            // If a start byte, set beginning of ID and length
-            if ((c >> 7) == 0) {
-                id = c;
-                break;
-            }
-            else if ((c >> 5) == 0b110) {
-                id = (int)(c & 0b11111) << 6;
-                len = 1;
+    void Painter::drawText(const Point& position, const char* str, const Font& font, const Color& color, HRef href, VRef vref) {
+        // The sub-pixel alignment of left aligned text is that of the position. Otherwise it depends on the width,
+        // which is given by the string laid out from a whole pixel.
+        int alignment = 0;
+        if (href == H_REF_LEFT) {
+            float x = roundf(position.x * 4.0f) * 0.25f;
+            alignment = (int)((x - floorf(x)) * 4.0f);
+        }
+        std::shared_ptr<TextBlob> blob = getTextBlob(font, str, alignment);
+        Vec2f origin = blob->getOrigin(position, href, vref);
+
+        // Use the layout matching the sub-pixel alignment of the origin
+        int originAlignment = (int)((origin.x - floorf(origin.x)) * 4.0f);
+        if (originAlignment != alignment) { blob = getTextBlob(font, str, originAlignment); }
+
+        // Draw the glyphs
+        addTextBlob(origin, *blob, color);
+    }
+
+    std::shared_ptr<const gfx::TextBlob> Painter::createTextBlob(const Font& font, const char* str) {
+        return getTextBlob(font, str, 0);
+    }
+
+    void Painter::drawTextBlob(const Point& position, const gfx::TextBlob& blob, const Color& color, HRef href, VRef vref) {
+        // Compute the start of the baseline
+        Vec2f origin = blob.getOrigin(position, href, vref);
+        int alignment = (int)((origin.x - floorf(origin.x)) * 4.0f);
+
+        // Draw the blob directly if it's current and was laid out for the alignment of the origin
+        const TextBlob* own = dynamic_cast<const TextBlob*>(&blob);
+        if (own && isCurrent(*own) && own->getAlignment() == alignment && !(capture && own->pending)) {
+            addTextBlob(origin, *own, color);
+            return;
+        }
+
+        // Otherwise, lay the string out again
+        addTextBlob(origin, *getTextBlob(blob.getFont(), blob.getText().c_str(), alignment), color);
+    }
+
+    void Painter::drawTextGrid(const Point& position, TextGrid& grid) {
+        // Get the records of the grid, they're built from scratch the first time it's drawn
+        auto it = grids.find(grid.getId());
+        if (it == grids.end()) {
+            GridState init = { 0, grid.getFont(), Sizei(0, 0), Sizei(0, 0), 0, 0, fc->getGlyphMode(), {}, {}, 0, 0 };
+            it = grids.emplace(grid.getId(), init).first;
+        }
+        GridState& state = it->second;
+        state.lastDrawn = fc->getFrame();
+
+        // Bring the records up to date. All are built again if changes were missed or the glyphs moved in the atlas.
+        bool missed = state.revision != grid.getRevision();
+        bool all = grid.takeChanges(changedCells);
+        state.revision = grid.getRevision();
+        if (all || missed || !state.texture || state.atlasGeneration != fc->getGeneration() || state.mode != fc->getGlyphMode()) {
+            buildGrid(state, grid);
+        }
+        else if (!changedCells.empty()) {
+            // Build the changed cells again and upload their background and character quads in runs of consecutive cells
+            std::sort(changedCells.begin(), changedCells.end());
+            for (int index : changedCells) { buildGridCell(state, grid, index); }
+            int cellCount = state.size.x * state.size.y;
+            for (size_t i = 0; i < changedCells.size();) {
+                size_t j = i + 1;
+                while (j < changedCells.size() && changedCells[j] == changedCells[j - 1] + 1) { j++; }
+                uploadGridRecords(state, changedCells[i], j - i);
+                uploadGridRecords(state, cellCount + changedCells[i], j - i);
+                i = j;
             }
-            else if ((c >> 4) == 0b1110) {
-                id = (int)(c & 0b1111) << 6;
-                len = 2;
+        }
+
+        // Nothing to draw if the grid has no cells
+        int count = state.size.x * state.size.y * 2;
+        if (!count) { return; }
+        Pointi origin((int)roundf(position.x) + offset.x, (int)roundf(position.y) + offset.y);
+
+        // When compiling, copy the quads into the list like those of any other primitive
+        if (capture) {
+            // Remember the glyph of each character quad so that the list can follow the glyphs when they move
+            int font = getListFont(*capture, state.font);
+            int listBase = (int)(capture->quads.size() + quads.size());
+            int cellCount = state.size.x * state.size.y;
+            for (int i = 0; i < cellCount; i++) {
+                if (!state.glyphs[i]) { continue; }
+                Pointi pen(origin.x + (i % state.size.x) * state.cellSize.x, origin.y + (i / state.size.x) * state.cellSize.y + state.baseline);
+                capture->glyphs.push_back({ listBase + cellCount + i, font, state.glyphs[i], pen });
             }
-            else if ((c >> 3) == 0b11110) {
-                id = (int)(c & 0b111) << 6;
-                len = 3;
+
+            int first = 0;
+            while (first < count) {
+                if (!beginPrimitive(BATCH_QUADS)) { return; }
+                int n = std::min<int>(count - first, maxQuads - quads.size());
+                size_t base = quads.size();
+                quads.insert(quads.end(), state.records.begin() + first, state.records.begin() + first + n);
+                for (size_t i = base; i < quads.size(); i++) {
+                    quads[i].pos[0] += origin.x << 8;
+                    quads[i].pos[1] += origin.y << 8;
+                    quads[i].clip = clipSlot;
+                }
+                first += n;
             }
-            
-            // If a continuation byte, 
-            else if ((c >> 6) == 0b10) {
-                // If there's nothing to read, ignore this byte
-                if (!len) { continue; }
+            return;
+        }
 
-                // Add bits to the ID
-                id |= c & 0b111111;
+        // Draw after the pending geometry, with the current stencil alone in the clip table
+        flush();
+        if (!beginPrimitive(BATCH_QUADS)) { return; }
+        fc->atlas.pushTexture();
+        glBindVertexArray(quadVAO);
+        quadShader->use();
+        glUniform4fv(quadClipRectsUnif, clipCount, &clipRects[0][0]);
+        reserveQuadCorners(count);
+
+        // Draw the quads straight from the texture of the grid, moved to its position
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, state.texture);
+        glUniform1i(quadBaseUnif, 0);
+        glUniform2i(quadTranslateUnif, origin.x << 8, origin.y << 8);
+        glDrawElements(GL_TRIANGLES, count * 6, GL_UNSIGNED_INT, NULL);
+
+        // Restore the state of the batches
+        glUniform2i(quadTranslateUnif, 0, 0);
+        glBindTexture(GL_TEXTURE_2D, quadTexture);
+        glActiveTexture(GL_TEXTURE0);
+        clipCount = 0;
+        clipSlot = -1;
+        batchSerial++;
 
-                // If there are remaining continuation bytes, shift bits up
-                if (--len) { id <<= 6; }
-            }
+        // Update statistics
+        stats.quads += count;
+        stats.flushes++;
+    }
 
-            // If we're done reading, break out
-            if (!len) { break; }
-        }
-        str++;
-        return id;
+    void Painter::prewarm(const Font& font, const std::vector<CodepointRange>& ranges) {
+        fc->prewarm(font, ranges);
     }
 
-    Size Painter::measureText(Font& font, const char* str) {
-        // Begin the cursor at 0
-        Size size(0.0f, font.getSize());
+    void Painter::compile(const RecordingPainter& recording, DisplayList& list) {
+        // Draw any geometry that's pending from the current render
+        flush();
 
-        // Prepare the font
-        fc->prepareFont(font);
+        // Start capturing the geometry into the list
+        list.clear();
+        capture = &list;
+        captureStencilDepth = 0;
 
-        // Iterate over all characters
-        while (true) {
-            // Get unicode ID
-            int id = getCodepoint(str);
-            if (!id) { break; }
+        // The list can't be built again once its glyphs are rasterized, so they're all rasterized now
+        bool asyncGlyphs = fc->getAsyncGlyphs();
+        fc->setAsyncGlyphs(false);
 
-            // Compute the sub-pixel alignment
-            int x = floorf(size.x);
-            int subx = floorf((size.x - x) * 4.0f);
+        // The geometry of the list is relative to its origin, so start from a clean offset
+        std::stack<Pointi> savedOffsets;
+        std::swap(savedOffsets, offsets);
+        Pointi savedOffset = offset;
+        offset = Pointi(0, 0);
 
-            // Fetch glyph info
-            GlyphInfo info = fc->getGlyph(font, id, subx);
+        // Generate the geometry of the recording
+        try {
+            recording.replay(*this);
+            flush();
+        }
+        catch (...) {
+            capture = NULL;
+            fc->setAsyncGlyphs(asyncGlyphs);
+            std::swap(savedOffsets, offsets);
+            offset = savedOffset;
+            throw;
+        }
 
-            // Update cursor
-            size.x += info.xAdvance;
+        // Stop capturing and restore the offset of the current render
+        capture = NULL;
+        fc->setAsyncGlyphs(asyncGlyphs);
+        list.atlasGeneration = fc->getGeneration();
+        bool unbalancedOffsets = !offsets.empty();
+        std::swap(savedOffsets, offsets);
+        offset = savedOffset;
+
+        // Make sure the list won't leave the painter in a different state
+        if (captureStencilDepth || unbalancedOffsets) {
+            throw std::runtime_error("Recording has unbalanced stencils or offsets");
         }
+    }
 
-        return size;
+    bool Painter::isCurrent(const DisplayList& list) const {
+        return list.atlasGeneration == fc->getGeneration();
     }
 
-    void Painter::drawText(const Point& position, const char* str, Font& font, const Color& color, HRef href, VRef vref) {
-        // Quantize the cursor position
-        Vec2f cursor(roundf(position.x * 4.0f) * 0.25f, roundf(position.y * 4.0f) * 0.25f);
+    bool Painter::isCurrent(const TextBlob& blob) const {
+        return blob.cache == fc && blob.atlasGeneration == fc->getGeneration() && blob.mode == fc->getGlyphMode();
+    }
 
-        // Do horizontal alignment
-        if (href == H_REF_LEFT) {
-            // Prepare the font since measureText (which would prepare it) isn't called
-            fc->prepareFont(font);
+    void Painter::drawDisplayList(DisplayList& list, const Pointi& offset) {
+        // Update the quads of the glyphs if they were moved since the list was last drawn, which also marks them as used.
+        // Otherwise they only need to be marked as used when glyphs are about to be evicted.
+        if (!isCurrent(list)) {
+            updateDisplayList(list);
+        }
+        else if (fc->isOverBudget()) {
+            for (const auto& glyph : list.glyphs) { fc->touchGlyph(list.fonts[glyph.font], glyph.desc); }
         }
-        else {
-            // Get the horizontal measurements of the text
-            Size tsize = measureText(font, str);
 
-            // Move cursor depending on the desired alignement
-            if (href == H_REF_CENTER) {
-                cursor.x -= tsize.x / 2;
+        // The list is drawn relative to the current offset
+        Pointi listOffset = this->offset + offset;
+        Vec2f off((float)listOffset.x, (float)listOffset.y);
+        for (const auto& op : list.ops) {
+            switch (op.type) {
+            case DISPLAY_LIST_OP_DRAW: {
+                // Skip if entirely stenciled out
+                if (!beginPrimitive(BATCH_TRIANGLES)) { break; }
+
+                // Copy the vertices, moved to their final position and clipped by the current stencil
+                int base = (int)vertices.size();
+                const VertexAttrib* src = &list.vertices[op.firstVertex];
+                vertices.insert(vertices.end(), src, src + op.vertexCount);
+                for (int i = base; i < base + op.vertexCount; i++) {
+                    vertices[i].pos[0] += off.x;
+                    vertices[i].pos[1] += off.y;
+                    vertices[i].clip = clipSlot;
+                }
+
+                // Copy the indices, rebased to the copied vertices
+                const int* ind = &list.indices[op.firstIndex];
+                for (int i = 0; i < op.indexCount; i++) {
+                    indices.push_back(base + ind[i]);
+                }
+                break;
             }
-            else if (href == H_REF_RIGHT) {
-                cursor.x -= tsize.x;
+            case DISPLAY_LIST_OP_DRAW_QUADS: {
+                // Skip if entirely stenciled out. A batch can't hold more quads than the record texture does.
+                if ((int)quads.size() + op.quadCount > maxQuads) { flush(); }
+                if (!beginPrimitive(BATCH_QUADS)) { break; }
+
+                // Copy the quads, moved to their final position and clipped by the current stencil
+                int base = (int)quads.size();
+                const QuadInstance* src = &list.quads[op.firstQuad];
+                quads.insert(quads.end(), src, src + op.quadCount);
+                for (int i = base; i < base + op.quadCount; i++) {
+                    quads[i].pos[0] += listOffset.x << 8;
+                    quads[i].pos[1] += listOffset.y << 8;
+                    quads[i].clip = clipSlot;
+                }
+                break;
+            }
+            case DISPLAY_LIST_OP_PUSH_STENCIL:
+                // The stencil is relative to the origin of the list
+                pushStencil(Recti(op.stencil.A() + offset, op.stencil.B() + offset));
+                break;
+            case DISPLAY_LIST_OP_POP_STENCIL:
+                popStencil();
+                break;
             }
         }
+    }
 
-        // Do vertical alignement
-        if (vref != V_REF_BASELINE) {
-            // Get the font metrics
-            FontMetrics metrics = fc->getFontMetrics(font);
+    void Painter::updateDisplayList(DisplayList& list) {
+        // Place the quad of each glyph again from its pen position, the glyph may even have been evicted and added back
+        for (const auto& glyph : list.glyphs) {
+            GlyphInfo info = fc->getGlyph(list.fonts[glyph.font], glyph.desc >> 2, glyph.desc & 0b11);
+            QuadInstance& quad = list.quads[glyph.quad];
+            quad.pos[0] = (glyph.pen.x << 8) + (int32_t)roundf((info.offset.x - 0.5f) * 256.0f);
+            quad.pos[1] = (glyph.pen.y << 8) + (int32_t)roundf((-info.offset.y - 0.5f) * 256.0f);
+            quad.size[0] = (int32_t)roundf(info.size.x * 256.0f);
+            quad.size[1] = (int32_t)roundf(info.size.y * 256.0f);
+            quad.texCoordA[0] = unorm16(info.coords.TL.x);
+            quad.texCoordA[1] = unorm16(info.coords.TL.y);
+            quad.texCoordB[0] = unorm16(info.coords.BR.x);
+            quad.texCoordB[1] = unorm16(info.coords.BR.y);
+            quad.layer = info.coords.layer | (info.distanceField ? GFX_OPENGL_QUAD_DISTANCE_FIELD : 0);
+        }
 
-            // Move the cursor depending on the desired alignement
-            if (vref == V_REF_BOTTOM) {
-                cursor.y += metrics.descender;
-            }
-            else if (vref == V_REF_CENTER) {
-                cursor.y += (metrics.descender + metrics.ascender) * 0.5f;
-            }
-            else if (vref == V_REF_TOP) {
-                cursor.y += metrics.ascender;
-            }
+        // Fetching glyphs handed out without a texture may have changed the generation, so read it last
+        list.atlasGeneration = fc->getGeneration();
+    }
+
+    void Painter::genProjMatrix() {
+        // Compute the scale and offset vectors
+        scaleVec = Vec2f(2.0f / (float)canvasSize.x, -2.0f / (float)canvasSize.y);
+        offsetVec = scaleVec * 0.5f + Vec2f(-1.0f, 1.0f);
+    }
+
+    int Painter::addVertex(const Vec2f& pos, const Color& color, const Vec2f& texCoord, int layer) {
+        // The caller must have started the primitive with beginPrimitive()
+        VertexAttrib vert;
+        vert.pos[0] = pos.x + (float)offset.x;
+        vert.pos[1] = pos.y + (float)offset.y;
+        vert.color[0] = unorm8(color.r);
+        vert.color[1] = unorm8(color.g);
+        vert.color[2] = unorm8(color.b);
+        vert.color[3] = unorm8(color.a);
+        vert.texCoord[0] = unorm16(texCoord.x);
+        vert.texCoord[1] = unorm16(texCoord.y);
+        vert.layer = layer;
+        vert.clip = clipSlot;
+        vertices.push_back(vert);
+        return vertices.size() - 1;
+    }
+
+    void Painter::addTri(int a, int b, int c) {
+        indices.push_back(a);
+        indices.push_back(b);
+        indices.push_back(c);
+    }
+
+    void Painter::addOutline(const Color& color) {
+        // Skip if entirely stenciled out
+        if (!beginPrimitive(BATCH_TRIANGLES)) { return; }
+
+        // Create a pair of outer and inner vertices per point
+        int first = (int)vertices.size();
+        int count = (int)outerPoints.size();
+        for (int i = 0; i < count; i++) {
+            addVertex(outerPoints[i], color);
+            addVertex(innerPoints[i], color);
         }
 
-        // Quantize the starting cursor to the available subpixel increment
-        cursor = Vec2f(roundf(cursor.x * 4.0f) * 0.25f, roundf(cursor.y));
-        
-        // Iterate over all characters
-        while (true) {
+        // Join each pair to the next with two triangles
+        for (int i = 0; i < count; i++) {
+            int a = first + i*2;
+            int b = first + ((i+1)%count)*2;
+            addTri(a, b, a+1);
+            addTri(b, b+1, a+1);
+        }
+    }
+
+    void Painter::addQuad(const Vec2f& pos, const Vec2f& size, const Color& color, const Vec2f& texCoordA, const Vec2f& texCoordB, int layer) {
+        // Skip if entirely stenciled out
+        if (!beginPrimitive(BATCH_QUADS)) { return; }
+
+        QuadInstance quad;
+        quad.pos[0] = (int32_t)roundf(pos.x * 256.0f) + (offset.x << 8);
+        quad.pos[1] = (int32_t)roundf(pos.y * 256.0f) + (offset.y << 8);
+        quad.size[0] = (int32_t)roundf(size.x * 256.0f);
+        quad.size[1] = (int32_t)roundf(size.y * 256.0f);
+        quad.texCoordA[0] = unorm16(texCoordA.x);
+        quad.texCoordA[1] = unorm16(texCoordA.y);
+        quad.texCoordB[0] = unorm16(texCoordB.x);
+        quad.texCoordB[1] = unorm16(texCoordB.y);
+        quad.color[0] = unorm8(color.r);
+        quad.color[1] = unorm8(color.g);
+        quad.color[2] = unorm8(color.b);
+        quad.color[3] = unorm8(color.a);
+        quad.layer = layer;
+        quad.clip = clipSlot;
+        quads.push_back(quad);
+    }
+
+    std::shared_ptr<TextBlob> Painter::getTextBlob(const Font& font, const char* str, int alignment) {
+        // If the string was laid out recently and its glyphs haven't moved since, reuse it
+        std::string_view text(str);
+        // When compiling, blobs missing glyphs are laid out again so that the list gets all of them
+        std::shared_ptr<TextBlob> blob = blobs.find(font, text, alignment);
+        if (blob && isCurrent(*blob) && !(capture && blob->pending)) { return blob; }
+
+        // Create the blob
+        blob = std::make_shared<TextBlob>(font, text, alignment, fc);
+        FontMetrics metrics = fc->getFontMetrics(font);
+        blob->ascender = metrics.ascender;
+        blob->descender = metrics.descender;
+        blob->mode = fc->getGlyphMode();
+
+        // Decode the whole string at once
+        codepoints.resize(text.size());
+        size_t count = decodeUTF8(text.data(), text.size(), codepoints.data());
+
+        // Iterate over all characters, starting from the sub-pixel alignment
+        float cursor = (float)alignment * 0.25f;
+        int prevId = 0;
+        Vec2f boundsMin(FLT_MAX, FLT_MAX);
+        Vec2f boundsMax(-FLT_MAX, -FLT_MAX);
+        for (size_t i = 0; i < count; i++) {
             // Get unicode ID
-            int id = getCodepoint(str);
-            if (!id) { break; }
+            int id = codepoints[i];
 
-            // TODO: Optimise away spaces
+            // Apply the kerning with the previous glyph
+            if (prevId) { cursor += fc->getKerning(font, prevId, id); }
+            prevId = id;
 
             // Compute the sub-pixel alignment
-            int x = floorf(cursor.x);
-            int subx = floorf((cursor.x - x) * 4.0f);
+            int x = floorf(cursor);
+            int subx = floorf((cursor - x) * 4.0f);
 
             // Fetch glyph info
             GlyphInfo info = fc->getGlyph(font, id, subx);
+            blob->glyphs.push_back((id << 2) | subx);
+            blob->pending |= info.pending;
+
+            // Create the quad, skipping empty glyphs such as spaces
+            if (info.size.x > 0 && info.size.y > 0) {
+                Vec2f tlp = Vec2f(x + info.offset.x - 0.5f, -info.offset.y - 0.5f);
+                QuadInstance quad;
+                quad.pos[0] = (int32_t)roundf(tlp.x * 256.0f);
+                quad.pos[1] = (int32_t)roundf(tlp.y * 256.0f);
+                quad.size[0] = (int32_t)roundf(info.size.x * 256.0f);
+                quad.size[1] = (int32_t)roundf(info.size.y * 256.0f);
+                quad.texCoordA[0] = unorm16(info.coords.TL.x);
+                quad.texCoordA[1] = unorm16(info.coords.TL.y);
+                quad.texCoordB[0] = unorm16(info.coords.BR.x);
+                quad.texCoordB[1] = unorm16(info.coords.BR.y);
+                quad.layer = info.coords.layer | (info.distanceField ? GFX_OPENGL_QUAD_DISTANCE_FIELD : 0);
+                quad.clip = 0;
+                blob->quads.push_back(quad);
+                blob->quadGlyphs.push_back((int)i);
+                blob->quadPens.push_back(x);
+                // Quads are half a pixel up and left of the pixels they cover
+                Vec2f covered = tlp + Vec2f(0.5f, 0.5f);
+                boundsMin = Vec2f(std::min<float>(boundsMin.x, covered.x), std::min<float>(boundsMin.y, covered.y));
+                boundsMax = Vec2f(std::max<float>(boundsMax.x, covered.x + info.size.x), std::max<float>(boundsMax.y, covered.y + info.size.y));
+            }
 
-            // Select the texture of the atlas
-            selectTexture(info.textureId);
+            // Update cursor
+            cursor += info.xAdvance;
+        }
+        blob->width = cursor - (float)alignment * 0.25f;
+        if (!blob->quads.empty()) {
+            blob->bounds = Rect(Point(boundsMin.x, boundsMin.y), Size(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y));
+        }
 
-            // Create vertices
-            Vec2f tlp = Vec2f(x + info.offset.x - 0.5f, cursor.y - info.offset.y - 0.5f);
-            int tl = addVertex(tlp, color, info.coords.TL);
-            int tr = addVertex(tlp + Vec2f(info.size.x, 0), color, info.coords.TR);
-            int bl = addVertex(tlp + Vec2f(0, info.size.y), color, info.coords.BL);
-            int br = addVertex(tlp + Vec2f(info.size.x, info.size.y), color, info.coords.BR);
+        // The texture coordinates are only valid until the atlas is compacted
+        blob->atlasGeneration = fc->getGeneration();
 
-            // Create triangles
-            addTri(tl, tr, bl);
-            addTri(tr, bl, br);
+        // Keep it for the next time the string is drawn
+        blobs.insert(blob);
+        return blob;
+    }
 
-            // TODO: Kerning
+    void Painter::addTextBlob(const Vec2f& origin, const TextBlob& blob, const Color& color) {
+        // The blob was laid out from the sub-pixel part of the origin, so the quads only move by whole pixels
+        int32_t dx = ((int32_t)floorf(origin.x) + offset.x) << 8;
+        int32_t dy = ((int32_t)origin.y + offset.y) << 8;
+        uint8_t c[4] = { unorm8(color.r), unorm8(color.g), unorm8(color.b), unorm8(color.a) };
+        blob.lastDrawn = fc->getFrame();
+
+        // When compiling, remember the glyph of each quad so that the list can follow the glyphs when they move.
+        // The quads end up in the list in the order they're added, flushes included.
+        if (capture) {
+            int font = getListFont(*capture, blob.getFont());
+            int listBase = (int)(capture->quads.size() + quads.size());
+            Pointi pen((int)floorf(origin.x) + offset.x, (int)origin.y + offset.y);
+            for (size_t i = 0; i < blob.quads.size(); i++) {
+                capture->glyphs.push_back({ listBase + (int)i, font, blob.glyphs[blob.quadGlyphs[i]], Pointi(pen.x + blob.quadPens[i], pen.y) });
+            }
+        }
 
-            // Update cursor
-            cursor.x += info.xAdvance;
+        // Copy the quads in as few chunks as the batches allow
+        size_t first = 0;
+        while (first < blob.quads.size()) {
+            // Skip if entirely stenciled out
+            if (!beginPrimitive(BATCH_QUADS)) { return; }
+
+            // Copy as many quads as the batch can take, then move them into place
+            size_t count = std::min<size_t>(blob.quads.size() - first, maxQuads - quads.size());
+            size_t base = quads.size();
+            quads.insert(quads.end(), blob.quads.begin() + first, blob.quads.begin() + first + count);
+            for (size_t i = base; i < quads.size(); i++) {
+                QuadInstance& quad = quads[i];
+                quad.pos[0] += dx;
+                quad.pos[1] += dy;
+                memcpy(quad.color, c, sizeof(c));
+                quad.clip = clipSlot;
+            }
+            first += count;
         }
     }
 
-    void Painter::genProjMatrix() {
-        // Compute the scale and offset vectors
-        scaleVec = Vec2f(2.0f / (float)canvasSize.x, -2.0f / (float)canvasSize.y);
-        offsetVec = scaleVec * 0.5f + Vec2f(-1.0f, 1.0f);
+    void Painter::buildGrid(GridState& state, const TextGrid& grid) {
+        // Measure the cells in the current font
+        state.font = grid.getFont();
+        state.size = grid.getSize();
+        state.cellSize = getCellSize(state.font);
+        state.baseline = (int)roundf(fc->getFontMetrics(state.font).ascender);
+        state.mode = fc->getGlyphMode();
+
+        // Build the quads of all cells, padded to whole rows of the texture
+        const int quadsPerRow = GFX_OPENGL_QUAD_TEXTURE_WIDTH / 2;
+        int cellCount = state.size.x * state.size.y;
+        int oldRows = state.records.size() / quadsPerRow;
+        int rows = std::max<int>((cellCount * 2 + quadsPerRow - 1) / quadsPerRow, 1);
+        state.records.assign(rows * quadsPerRow, QuadInstance{});
+        state.glyphs.assign(cellCount, 0);
+        for (int i = 0; i < cellCount; i++) { buildGridCell(state, grid, i); }
+        state.atlasGeneration = fc->getGeneration();
+
+        // Upload them, the texture is only reallocated if the number of rows changed
+        glActiveTexture(GL_TEXTURE1);
+        if (!state.texture) {
+            // Integer textures can only be sampled without filtering
+            glGenTextures(1, &state.texture);
+            glBindTexture(GL_TEXTURE_2D, state.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            oldRows = 0;
+        }
+        else {
+            glBindTexture(GL_TEXTURE_2D, state.texture);
+        }
+        if (rows != oldRows) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32I, GFX_OPENGL_QUAD_TEXTURE_WIDTH, rows, 0, GL_RGBA_INTEGER, GL_INT, state.records.data());
+        }
+        else {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GFX_OPENGL_QUAD_TEXTURE_WIDTH, rows, GL_RGBA_INTEGER, GL_INT, state.records.data());
+        }
+        glBindTexture(GL_TEXTURE_2D, quadTexture);
+        glActiveTexture(GL_TEXTURE0);
     }
 
-    int Painter::addVertex(const Vec2f& pos, const Color& color, const Vec2f& texCoord) {
-        VertexAttrib vert;
-        vert.pos[0] = pos.x;
-        vert.pos[1] = pos.y;
-        vert.color[0] = color.r;
-        vert.color[1] = color.g;
-        vert.color[2] = color.b;
-        vert.color[3] = color.a;
-        vert.texCoord[0] = texCoord.x;
-        vert.texCoord[1] = texCoord.y;
-        vertices.push_back(vert);
-        return vertices.size() - 1;
+    void Painter::buildGridCell(GridState& state, const TextGrid& grid, int index) {
+        // Get the top left corner of the cell
+        const TextCell& cell = grid.getCell(index);
+        int x = (index % state.size.x) * state.cellSize.x;
+        int y = (index / state.size.x) * state.cellSize.y;
+
+        // The background covers the pixels of the cell like a filled rectangle, using the white texel of the atlas
+        QuadInstance& bg = state.records[index];
+        bg = QuadInstance{};
+        bg.pos[0] = (x << 8) - 128;
+        bg.pos[1] = (y << 8) - 128;
+        bg.size[0] = state.cellSize.x << 8;
+        bg.size[1] = state.cellSize.y << 8;
+        bg.color[0] = unorm8(cell.background.r);
+        bg.color[1] = unorm8(cell.background.g);
+        bg.color[2] = unorm8(cell.background.b);
+        bg.color[3] = unorm8(cell.background.a);
+
+        // The character is placed like a string drawn from the top of the cell, cells without one get an empty quad
+        QuadInstance& quad = state.records[state.size.x * state.size.y + index];
+        quad = QuadInstance{};
+        state.glyphs[index] = 0;
+        if (!cell.codepoint) { return; }
+        GlyphInfo info = fc->getGlyph(state.font, cell.codepoint, 0);
+        state.glyphs[index] = cell.codepoint << 2;
+        if (info.size.x <= 0 || info.size.y <= 0) { return; }
+        Vec2f tlp = Vec2f(x + info.offset.x - 0.5f, y + state.baseline - info.offset.y - 0.5f);
+        quad.pos[0] = (int32_t)roundf(tlp.x * 256.0f);
+        quad.pos[1] = (int32_t)roundf(tlp.y * 256.0f);
+        quad.size[0] = (int32_t)roundf(info.size.x * 256.0f);
+        quad.size[1] = (int32_t)roundf(info.size.y * 256.0f);
+        quad.texCoordA[0] = unorm16(info.coords.TL.x);
+        quad.texCoordA[1] = unorm16(info.coords.TL.y);
+        quad.texCoordB[0] = unorm16(info.coords.BR.x);
+        quad.texCoordB[1] = unorm16(info.coords.BR.y);
+        quad.color[0] = unorm8(cell.foreground.r);
+        quad.color[1] = unorm8(cell.foreground.g);
+        quad.color[2] = unorm8(cell.foreground.b);
+        quad.color[3] = unorm8(cell.foreground.a);
+        quad.layer = info.coords.layer | (info.distanceField ? GFX_OPENGL_QUAD_DISTANCE_FIELD : 0);
     }
 
-    void Painter::addTri(int a, int b, int c) {
-        indices.push_back(a);
-        indices.push_back(b);
-        indices.push_back(c);
+    void Painter::uploadGridRecords(const GridState& state, int first, int count) {
+        // Each record is two texels, a range spanning several rows is uploaded one row at a time
+        const int quadsPerRow = GFX_OPENGL_QUAD_TEXTURE_WIDTH / 2;
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, state.texture);
+        while (count > 0) {
+            int row = first / quadsPerRow;
+            int col = first % quadsPerRow;
+            int n = std::min<int>(count, quadsPerRow - col);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, col * 2, row, n * 2, 1, GL_RGBA_INTEGER, GL_INT, &state.records[first]);
+            first += n;
+            count -= n;
+        }
+        glBindTexture(GL_TEXTURE_2D, quadTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    bool Painter::beginPrimitive(BatchType type) {
+        // Quads can't be mixed with triangles in a batch, and can't outgrow the record texture
+        if (type != batchType || (type == BATCH_QUADS && (int)quads.size() >= maxQuads)) {
+            flush();
+            batchType = type;
+        }
+
+        // When compiling, the stencil is applied when the list is drawn
+        if (capture) {
+            clipSlot = 0;
+            return true;
+        }
+
+        // Nothing is drawn if the stencil is empty
+        if (!stencilVisible) { return false; }
+
+        // Give the current stencil a slot in the clip table of the batch. Only a full table forces a flush.
+        if (clipSlot < 0) {
+            if (clipCount >= GFX_OPENGL_CLIP_RECTS) { flush(); }
+            float* rect = clipRects[clipCount];
+            rect[0] = (float)stencil.A().x - 0.5f;
+            rect[1] = (float)stencil.A().y - 0.5f;
+            rect[2] = (float)stencil.B().x + 0.5f;
+            rect[3] = (float)stencil.B().y + 0.5f;
+            clipSlot = clipCount++;
+        }
+        return true;
     }
 
     void Painter::flush() {
+        // Only the geometry of the current batch type can be pending
+        if (batchType == BATCH_QUADS) {
+            flushQuads();
+        }
+        else {
+            flushTriangles();
+        }
+
+        // Nothing is pending anymore, so the next batch starts with an empty clip table
+        clipCount = 0;
+        clipSlot = -1;
+        batchSerial++;
+    }
+
+    void Painter::flushTriangles() {
         // If there's nothing to draw, flush vertices and return
         if (indices.empty()) {
             vertices.clear();
             return;
         }
 
+        // When compiling, move the geometry to the display list instead of drawing it
+        if (capture) {
+            DisplayListOp op = {};
+            op.type = DISPLAY_LIST_OP_DRAW;
+            op.firstVertex = (int)capture->vertices.size();
+            op.vertexCount = (int)vertices.size();
+            op.firstIndex = (int)capture->indices.size();
+            op.indexCount = (int)indices.size();
+            capture->ops.push_back(op);
+
+            capture->vertices.insert(capture->vertices.end(), vertices.begin(), vertices.end());
+            capture->indices.insert(capture->indices.end(), indices.begin(), indices.end());
+
+            vertices.clear();
+            indices.clear();
+            return;
+        }
+
+        // Make sure the atlas has all the glyphs being drawn
+        fc->atlas.pushTexture();
+
+        // Select the triangle pipeline
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        shader->use();
+        glUniform4fv(clipRectsUnif, clipCount, &clipRects[0][0]);
+
+        // Upload the geometry, streaming it into the ring buffers if possible
+        int vertCount = vertices.size();
+        int indCount = indices.size();
+        if (streaming) {
+            int firstIndex = streamGeometry();
+            if (firstIndex >= 0) {
+                // Draw the triangles from their range of the ring
+                glDrawElements(GL_TRIANGLES, indCount, GL_UNSIGNED_INT, (void*)(firstIndex * sizeof(int)));
+            }
+            else {
+                // Mapping failed, permanently go back to plain uploads
+                flog::warn("Could not map the vertex buffers, disabling streaming");
+                setStreaming(false);
+            }
+        }
+        if (!streaming) {
+            uploadGeometry();
+
+            // Draw triangles using indices
+            glDrawElements(GL_TRIANGLES, indCount, GL_UNSIGNED_INT, NULL);
+        }
+
+        // Update statistics
+        stats.vertices += vertCount;
+        stats.indices += indCount;
+        stats.flushes++;
+
+        // Flush buffers
+        vertices.clear();
+        indices.clear();
+    }
+
+    void Painter::flushQuads() {
+        // If there's nothing to draw, return
+        if (quads.empty()) { return; }
+
+        // When compiling, move the quads to the display list instead of drawing them
+        if (capture) {
+            DisplayListOp op = {};
+            op.type = DISPLAY_LIST_OP_DRAW_QUADS;
+            op.firstQuad = (int)capture->quads.size();
+            op.quadCount = (int)quads.size();
+            capture->ops.push_back(op);
+
+            capture->quads.insert(capture->quads.end(), quads.begin(), quads.end());
+
+            quads.clear();
+            return;
+        }
+
+        // Make sure the atlas has all the glyphs being drawn
+        fc->atlas.pushTexture();
+
+        // Select the quad pipeline
+        int count = quads.size();
+        glBindVertexArray(quadVAO);
+        quadShader->use();
+        glUniform4fv(quadClipRectsUnif, clipCount, &clipRects[0][0]);
+
+        // Make sure the static unit quads cover all the quads to draw
+        reserveQuadCorners(count);
+
+        // Upload the quad records and draw them
+        glUniform1i(quadBaseUnif, uploadQuads());
+        glDrawElements(GL_TRIANGLES, count * 6, GL_UNSIGNED_INT, NULL);
+
+        // Update statistics
+        stats.quads += count;
+        stats.flushes++;
+
+        // Flush quads
+        quads.clear();
+    }
+
+    void Painter::reserveQuadCorners(int count) {
+        // Nothing to do if the static unit quads already cover enough quads
+        if (count <= quadBufferCapacity) { return; }
+
+        // Grow the static unit quads
+        quadBufferCapacity = std::max<int>(count, std::max<int>(quadBufferCapacity * 2, 1024));
+        std::vector<uint8_t> corners(quadBufferCapacity * 8);
+        std::vector<int> quadIndices(quadBufferCapacity * 6);
+        for (int i = 0; i < quadBufferCapacity; i++) {
+            // Corners are in top-left, top-right, bottom-left, bottom-right order
+            for (int j = 0; j < 4; j++) {
+                corners[i*8 + j*2] = j & 1;
+                corners[i*8 + j*2 + 1] = j >> 1;
+            }
+
+            // Same triangulation as the indexed quads
+            int v = i * 4;
+            int* ind = &quadIndices[i * 6];
+            ind[0] = v; ind[1] = v + 1; ind[2] = v + 2;
+            ind[3] = v + 1; ind[4] = v + 2; ind[5] = v + 3;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, cornerVBO);
+        glBufferData(GL_ARRAY_BUFFER, corners.size(), corners.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, quadIndices.size() * sizeof(int), quadIndices.data(), GL_STATIC_DRAW);
+    }
+
+    int Painter::uploadQuads() {
+        const int quadsPerRow = GFX_OPENGL_QUAD_TEXTURE_WIDTH / 2;
+        int count = quads.size();
+        int rows = (count + quadsPerRow - 1) / quadsPerRow;
+
+        // The records are written to the texture like a ring. When it wraps, the texture is respecified
+        // which lets the driver orphan the storage still in use by previous draws instead of waiting on them.
+        glActiveTexture(GL_TEXTURE1);
+        if (quadHead + rows * quadsPerRow > quadTextureCapacity) {
+            int capacityRows = std::max<int>(rows, std::max<int>(quadTextureCapacity / quadsPerRow, 64));
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32I, GFX_OPENGL_QUAD_TEXTURE_WIDTH, capacityRows, 0, GL_RGBA_INTEGER, GL_INT, NULL);
+            quadTextureCapacity = capacityRows * quadsPerRow;
+            quadHead = 0;
+        }
+
+        // Upload the full rows, then the partial last row
+        int firstRow = quadHead / quadsPerRow;
+        int fullRows = count / quadsPerRow;
+        int remaining = count % quadsPerRow;
+        if (fullRows) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow, GFX_OPENGL_QUAD_TEXTURE_WIDTH, fullRows, GL_RGBA_INTEGER, GL_INT, quads.data());
+        }
+        if (remaining) {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, firstRow + fullRows, remaining * 2, 1, GL_RGBA_INTEGER, GL_INT, &quads[fullRows * quadsPerRow]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+
+        // Advance the head to the next row
+        int first = quadHead;
+        quadHead += rows * quadsPerRow;
+        return first;
+    }
+
+    void Painter::uploadGeometry() {
         // Replace or reallocate vertex/index buffers with new data
         int vertCount = vertices.size();
         
@@ -539,36 +1289,42 @@ namespace gfx::OpenGL {
             // Data can simply be substituted
             glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indCount * sizeof(int), indices.data());
         }
-
-        // Draw triangles using indices
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, NULL);
-
-        // Flush buffers
-        vertices.clear();
-        indices.clear();
-    }
-
-    void Painter::updateStencil() {
-        glScissor(stencil.A().x, canvasSize.y - stencil.B().y - 1, stencil.size().x, stencil.size().y);
     }
 
-    void Painter::updateOffset() {
-        // Compute total offset
-        Vec2f total = offsetVec + Vec2f((float)offset.x * (1.0f / (float)canvasSize.x), -(float)offset.y * (1.0f / (float)canvasSize.y));
-
-        // Send the value to OpenGL
-        glUniform2fv(offsetUnif, 1, total.data);
-    }
+    int Painter::streamGeometry() {
+        int vertCount = vertices.size();
+        int indCount = indices.size();
 
-    void Painter::selectTexture(GLuint id) {
-        // If the texture is already active, do nothing
-        if (id == activeTexture) { return; }
+        // If the geometry doesn't fit in what's left of the rings, orphan them and start over.
+        // The driver hands out new storage while the GPU finishes reading the old one, so no fence is needed.
+        if (VBOHead + vertCount > VBOCapacity || EBOHead + indCount > EBOCapacity) {
+            VBOCapacity = std::max<int>(VBOCapacity, std::max<int>(vertCount, GFX_OPENGL_STREAM_VERTICES));
+            EBOCapacity = std::max<int>(EBOCapacity, std::max<int>(indCount, GFX_OPENGL_STREAM_VERTICES * 3));
+            glBufferData(GL_ARRAY_BUFFER, VBOCapacity * sizeof(VertexAttrib), NULL, GL_STREAM_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, EBOCapacity * sizeof(int), NULL, GL_STREAM_DRAW);
+            VBOHead = 0;
+            EBOHead = 0;
+        }
 
-        // Flush all current triangles
-        flush();
+        // Write the vertices to the free range. It was never used since the last orphaning, so no sync is needed.
+        const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+        void* vdst = glMapBufferRange(GL_ARRAY_BUFFER, VBOHead * sizeof(VertexAttrib), vertCount * sizeof(VertexAttrib), access);
+        if (!vdst) { return -1; }
+        memcpy(vdst, vertices.data(), vertCount * sizeof(VertexAttrib));
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+
+        // Write the indices, rebased onto the range of the vertices since GL 3.0 has no base vertex
+        int* idst = (int*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, EBOHead * sizeof(int), indCount * sizeof(int), access);
+        if (!idst) { return -1; }
+        for (int i = 0; i < indCount; i++) {
+            idst[i] = indices[i] + VBOHead;
+        }
+        glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER);
 
-        // Update selected texture
-        glBindTexture(GL_TEXTURE_2D, id);
-        activeTexture = id;
+        // Advance the heads
+        int firstIndex = EBOHead;
+        VBOHead += vertCount;
+        EBOHead += indCount;
+        return firstIndex;
     }
 }
\ No newline at end of file
@@ -1,19 +1,70 @@
 #pragma once
 #include "../../painter.h"
+#include "../../recording_painter.h"
 #include "shader.h"
 #include "font_cache.h"
+#include "display_list.h"
+#include "text_blob.h"
 #include <memory>
 #include <vector>
 #include <stack>
+#include <unordered_map>
+
+#define GFX_OPENGL_STREAM_VERTICES  65536
+#define GFX_OPENGL_QUAD_TEXTURE_WIDTH   1024
+#define GFX_OPENGL_CLIP_RECTS           64
+
+// Number of frames a text grid can go without being drawn before its records are freed
+#define GFX_OPENGL_GRID_RETENTION       600
 
 namespace gfx::OpenGL {
-#pragma pack(push, 1)
-    struct VertexAttrib {
-        float pos[2];
-        float color[4];
-        float texCoord[2];
+    struct RenderStats {
+        // Number of vertices sent to the GPU
+        int vertices;
+
+        // Number of indices sent to the GPU
+        int indices;
+
+        // Number of quads sent to the GPU
+        int quads;
+
+        // Number of draw calls issued
+        int flushes;
+    };
+
+    enum BatchType {
+        BATCH_TRIANGLES,
+        BATCH_QUADS
+    };
+
+    struct StencilSlot {
+        // Slot of the stencil in the clip table, and the batch the table belonged to
+        int slot;
+        uint64_t batch;
+    };
+
+    struct GridState {
+        // Revision of the grid the records were built from, a different one means changes were missed
+        uint64_t revision;
+
+        // Layout of the grid and state of the font cache the records were built against
+        Font font;
+        Sizei size;
+        Sizei cellSize;
+        int baseline;
+        uint64_t atlasGeneration;
+        GlyphMode mode;
+
+        // Background quads of all cells followed by their character quads, padded to whole rows of the texture
+        std::vector<QuadInstance> records;
+
+        // Glyph of each cell, to keep them in the atlas. Cells without a character use zero.
+        std::vector<GlyphDescriptor> glyphs;
+
+        // Texture holding the records and the frame it was last drawn in
+        GLuint texture;
+        uint32_t lastDrawn;
     };
-#pragma pack(pop)
 
     class Painter : public gfx::Painter {
     public:
@@ -39,7 +90,39 @@ namespace gfx::OpenGL {
         void setCanvasSize(const Sizei& canvasSize);
 
         /**
-         * Start the rendering procedure.
+         * Get statistics about the current or last render.
+         * @return Render statistics. Reset by beginRender().
+        */
+        const RenderStats& getStats() const { return stats; }
+
+        /**
+         * Check whether geometry is streamed through ring buffers.
+         * @return True if streaming, false if the buffers are re-uploaded on every flush.
+        */
+        bool getStreaming() const { return streaming; }
+
+        /**
+         * Select how geometry is sent to the GPU. Streaming is enabled by default if buffers can be mapped.
+         * @param enabled True to stream geometry through ring buffers, false to re-upload the buffers on every flush.
+        */
+        void setStreaming(bool enabled);
+
+        /**
+         * Check whether glyphs missing from the font cache are rasterized in the background.
+         * @return True if rasterized in the background, false if rasterized when first drawn.
+        */
+        bool getAsyncGlyphs() const { return fc->getAsyncGlyphs(); }
+
+        /**
+         * Select whether glyphs missing from the font cache are rasterized in the background. If so, the frame first drawing
+         * a glyph doesn't wait for it: its text is laid out with the right advances, and its characters appear in a later frame.
+         * Disabled by default.
+         * @param enabled True to rasterize in the background, false to rasterize when first drawn.
+        */
+        void setAsyncGlyphs(bool enabled) { fc->setAsyncGlyphs(enabled); }
+
+        /**
+         * Start the rendering procedure. The font cache may evict glyphs and compact its atlas at this point.
         */
         void beginRender();
 
@@ -126,7 +209,7 @@ namespace gfx::OpenGL {
          * @param str String to draw.
          * @param font Font to use to draw the string.
         */
-        Size measureText(Font& font, const char* str);
+        Size measureText(const Font& font, const char* str);
 
         /**
          * Draw a string.
@@ -137,27 +220,123 @@ namespace gfx::OpenGL {
          * @param href Horizontal reference point.
          * @param vref Vertical reference point.
         */
-        void drawText(const Point& position, const char* str, Font& font, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE);
+        void drawText(const Point& position, const char* str, const Font& font, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE);
+
+        /**
+         * Lay out a string so that it can be drawn many times without looking up its glyphs again.
+         * @param font Font to lay the string out in.
+         * @param str String to lay out.
+         * @return Text blob, which can only be drawn directly by this painter.
+        */
+        std::shared_ptr<const gfx::TextBlob> createTextBlob(const Font& font, const char* str);
+
+        /**
+         * Draw a text blob. Blobs of other painters, laid out for another sub-pixel alignment of the origin,
+         * or no longer current are laid out again.
+         * @param position Position at which the blob will be drawn.
+         * @param blob Text blob to draw.
+         * @param color Color of the text.
+         * @param href Horizontal reference point.
+         * @param vref Vertical reference point.
+        */
+        void drawTextBlob(const Point& position, const gfx::TextBlob& blob, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE);
+
+        /**
+         * Draw a text grid. The quads of its cells are kept in a texture of their own and drawn in a single draw call,
+         * only the cells that changed since the grid was last drawn are updated. They are all built again if the grid
+         * was drawn by another painter in between or the font atlas was compacted.
+         * @param position Position of the top left corner of the grid, rounded to whole pixels.
+         * @param grid Text grid to draw. Its changes are taken.
+        */
+        void drawTextGrid(const Point& position, TextGrid& grid);
+
+        /**
+         * Rasterize the glyphs of ranges of codepoints in the background and place them in the font atlas as they become ready,
+         * at the start of the following renders. In bitmap mode all sub-pixel alignments are prepared.
+         * @param font Font to which the glyphs belong.
+         * @param ranges Codepoints to prepare.
+        */
+        void prewarm(const Font& font, const std::vector<CodepointRange>& ranges);
+
+        /**
+         * Build the geometry of a recording once so that it can be drawn again cheaply. Can be called outside of a render.
+         * Glyphs still being rasterized in the background are rasterized right away so that the list has all of them.
+         * @param recording Recording to build the geometry of.
+         * @param list Display list to write the geometry to. Its previous content is discarded.
+        */
+        void compile(const RecordingPainter& recording, DisplayList& list);
+
+        /**
+         * Check if the quads of the glyphs of a display list match the current layout of the font atlas.
+         * @param list Display list to check.
+         * @return True if the list refers to the current layout of the font atlas, false if its quads are updated when next drawn.
+        */
+        bool isCurrent(const DisplayList& list) const;
+
+        /**
+         * Check if a text blob can be drawn directly, which is only the case for blobs of this painter laid out
+         * against the current layout of the font atlas and in the current glyph mode.
+         * @param blob Text blob to check.
+         * @return True if the blob can be drawn directly, false if it must be laid out again.
+        */
+        bool isCurrent(const TextBlob& blob) const;
+
+        /**
+         * Draw a display list built by compile(). The quads of its glyphs are updated first if glyphs moved in the font atlas.
+         * @param list Display list to draw.
+         * @param offset Position at which to draw the list.
+        */
+        void drawDisplayList(DisplayList& list, const Pointi& offset = Pointi(0, 0));
 
         FontCache* fc = NULL;
 
     private:
         void genProjMatrix();
         // TODO: The default texcoord should probably be 0.5f, 0.5f to make sure even linear selection gets full color
-        int addVertex(const Vec2f& pos, const Color& color, const Vec2f& texCoord = Vec2f(0, 0));
+        int addVertex(const Vec2f& pos, const Color& color, const Vec2f& texCoord = Vec2f(0, 0), int layer = 0);
         void addTri(int a, int b, int c);
+        void addOutline(const Color& color);
+        void addQuad(const Vec2f& pos, const Vec2f& size, const Color& color, const Vec2f& texCoordA = Vec2f(0, 0), const Vec2f& texCoordB = Vec2f(0, 0), int layer = 0);
+        std::shared_ptr<TextBlob> getTextBlob(const Font& font, const char* str, int alignment);
+        void addTextBlob(const Vec2f& origin, const TextBlob& blob, const Color& color);
+        void buildGrid(GridState& state, const TextGrid& grid);
+        void buildGridCell(GridState& state, const TextGrid& grid, int index);
+        void updateDisplayList(DisplayList& list);
+        void uploadGridRecords(const GridState& state, int first, int count);
+        void reserveQuadCorners(int count);
+        bool beginPrimitive(BatchType type);
         void flush();
-        void selectTexture(GLuint id);
-        void updateStencil();
-        void updateOffset();
+        void flushTriangles();
+        void flushQuads();
+        void uploadGeometry();
+        int streamGeometry();
+        int uploadQuads();
         // TODO: Function to load the texture
 
         Sizei canvasSize;
         int VBOCapacity = 0;
         int EBOCapacity = 0;
+        int VBOHead = 0;
+        int EBOHead = 0;
+        bool streaming = false;
+        int quadBufferCapacity = 0;
+        int quadTextureCapacity = 0;
+        int quadHead = 0;
+        int maxQuads = 0;
+        BatchType batchType = BATCH_TRIANGLES;
         std::stack<Recti> stencils;
+        std::stack<bool> stencilVisibilities;
+        std::stack<StencilSlot> stencilSlots;
         std::stack<Pointi> offsets;
 
+        // Clip rectangles of the stencils used by the current batch, indexed by each primitive
+        float clipRects[GFX_OPENGL_CLIP_RECTS][4];
+        int clipCount = 0;
+        int clipSlot = -1;
+
+        // Serial of the batch, it changes every time the clip table is emptied
+        uint64_t batchSerial = 0;
+
         // GPU-side variables
         std::shared_ptr<Shader> shader;
         GLuint scaleUnif;
@@ -166,19 +345,58 @@ namespace gfx::OpenGL {
         GLuint posAttr;
         GLuint colorAttr;
         GLuint texCoordAttr;
-        GLuint activeTexture;
+        GLuint layerAttr;
+        GLuint clipAttr;
+        GLuint clipRectsUnif;
+        std::shared_ptr<Shader> quadShader;
+        GLuint quadScaleUnif;
+        GLuint quadOffsetUnif;
+        GLuint quadSamplerUnif;
+        GLuint quadTextureUnif;
+        GLuint quadBaseUnif;
+        GLuint quadClipRectsUnif;
+        GLuint quadTranslateUnif;
+        GLuint cornerAttr;
 
         // CPU-side OpenGL variables
         Vec2f scaleVec;
         Vec2f offsetVec;
         std::vector<VertexAttrib> vertices;
         std::vector<int> indices;
+        std::vector<QuadInstance> quads;
         Recti stencil;
+        bool stencilVisible = true;
         Pointi offset;
+        RenderStats stats = {};
+
+        // Recently drawn strings, laid out, and the decoded codepoints of the string being laid out
+        TextBlobCache<TextBlob> blobs;
+        std::vector<int> codepoints;
+
+        // Points of the arc being drawn, on the unit circle
+        std::vector<Vec2f> arcPoints;
+
+        // Outer and inner edges of the border being drawn
+        std::vector<Vec2f> outerPoints;
+        std::vector<Vec2f> innerPoints;
+
+        // Records of the text grids drawn recently by ID, and the cells of the grid being drawn that changed
+        std::unordered_map<uint64_t, GridState> grids;
+        std::vector<int> changedCells;
+
+        // Display list being compiled and the number of stencils it has pushed
+        DisplayList* capture = NULL;
+        int captureStencilDepth = 0;
 
         // OpenGL buffers objects
         GLuint VAO;
         GLuint VBO;
         GLuint EBO;
+
+        // Quad objects: static unit quads and the texture holding the quad records
+        GLuint quadVAO;
+        GLuint cornerVBO;
+        GLuint quadEBO;
+        GLuint quadTexture;
     };
 }
\ No newline at end of file
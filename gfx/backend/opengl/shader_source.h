@@ -1,35 +1,107 @@
 #pragma once
+#include "../../font_store.h"
+
+// Expand a macro into a string literal to build shader sources from the constants they depend on
+#define GFX_OPENGL_STRINGIFY(x)         #x
+#define GFX_OPENGL_SHADER_CONST(x)      GFX_OPENGL_STRINGIFY(x)
 
 namespace gfx::OpenGL {
     /**
-     * Vertex shader source code.
+     * Vertex shader source code. Each vertex is clipped against the rectangle of its slot in the clip table,
+     * which must be as large as GFX_OPENGL_CLIP_RECTS.
     */
     const char* VERTEX_SHADER_SRC =
-        "#version 120\n"
+        "#version 130\n"
         "uniform vec2 scaleUnif;\n"
         "uniform vec2 offsetUnif;\n"
-        "attribute vec2 posAttr;\n"
-        "attribute vec4 colorAttr;\n"
-        "attribute vec2 texCoordAttr;\n"
-        "varying vec4 color;\n"
-        "varying vec2 texCoord;\n"
+        "in vec2 posAttr;\n"
+        "in vec4 colorAttr;\n"
+        "in vec2 texCoordAttr;\n"
+        "uniform vec4 clipRects[64];\n"
+        "in float layerAttr;\n"
+        "in float clipAttr;\n"
+        "out vec4 color;\n"
+        "out vec3 texCoord;\n"
+        "flat out int distanceField;\n"
+        "out float gl_ClipDistance[4];\n"
         "void main() {\n"
+        "    vec4 clip = clipRects[int(clipAttr)];\n"
+        "    gl_ClipDistance[0] = posAttr.x - clip.x;\n"
+        "    gl_ClipDistance[1] = posAttr.y - clip.y;\n"
+        "    gl_ClipDistance[2] = clip.z - posAttr.x;\n"
+        "    gl_ClipDistance[3] = clip.w - posAttr.y;\n"
         "    gl_Position = vec4(posAttr*scaleUnif + offsetUnif, 0.5, 1.0);\n"
         "    color = colorAttr;\n"
-        "    texCoord = texCoordAttr;\n"
+        "    texCoord = vec3(texCoordAttr, layerAttr);\n"
+        "    distanceField = 0;\n"
+        "}"
+    ;
+
+    /**
+     * Vertex shader source code for quads. Quad records are fetched from an integer texture, two texels per quad,
+     * and expanded from the corner of the static unit quad of each vertex, then moved by a translation in 1/256th of a pixel.
+     * Clipped like the triangles.
+    */
+    const char* QUAD_VERTEX_SHADER_SRC =
+        "#version 130\n"
+        "uniform vec2 scaleUnif;\n"
+        "uniform vec2 offsetUnif;\n"
+        "uniform isampler2D quadSampler;\n"
+        "uniform int quadBaseUnif;\n"
+        "uniform ivec2 quadTranslateUnif;\n"
+        "uniform vec4 clipRects[64];\n"
+        "in vec2 cornerAttr;\n"
+        "out vec4 color;\n"
+        "out vec3 texCoord;\n"
+        "flat out int distanceField;\n"
+        "out float gl_ClipDistance[4];\n"
+        "void main() {\n"
+        "    int texel = (quadBaseUnif + (gl_VertexID >> 2)) * 2;\n"
+        "    ivec2 loc = ivec2(texel % textureSize(quadSampler, 0).x, texel / textureSize(quadSampler, 0).x);\n"
+        "    ivec4 geom = texelFetch(quadSampler, loc, 0);\n"
+        "    ivec4 attr = texelFetch(quadSampler, loc + ivec2(1, 0), 0);\n"
+        "    vec2 pos = (vec2(geom.xy + quadTranslateUnif) + vec2(geom.zw) * cornerAttr) * (1.0 / 256.0);\n"
+        "    vec2 uvA = vec2(attr.x & 0xFFFF, (attr.x >> 16) & 0xFFFF);\n"
+        "    vec2 uvB = vec2(attr.y & 0xFFFF, (attr.y >> 16) & 0xFFFF);\n"
+        "    vec4 clip = clipRects[(attr.w >> 16) & 0xFFFF];\n"
+        "    gl_ClipDistance[0] = pos.x - clip.x;\n"
+        "    gl_ClipDistance[1] = pos.y - clip.y;\n"
+        "    gl_ClipDistance[2] = clip.z - pos.x;\n"
+        "    gl_ClipDistance[3] = clip.w - pos.y;\n"
+        "    gl_Position = vec4(pos*scaleUnif + offsetUnif, 0.5, 1.0);\n"
+        "    color = vec4(attr.z & 0xFF, (attr.z >> 8) & 0xFF, (attr.z >> 16) & 0xFF, (attr.z >> 24) & 0xFF) * (1.0 / 255.0);\n"
+        "    texCoord = vec3(mix(uvA, uvB, cornerAttr) * (1.0 / 65535.0), float(attr.w & 0x7FFF));\n"
+        "    distanceField = (attr.w >> 15) & 1;\n"
         "}"
     ;
 
     /**
-     * Fragment shader source code.
+     * Fragment shader source code. The atlas only holds coverage, which is expanded to white with that opacity.
+     * It's sampled without filtering, so distance fields are filtered by hand, scaled by GFX_SDF_SPREAD.
     */
     const char* FRAGMENT_SHADER_SRC =
-        "#version 120\n"
-        "uniform sampler2D sampler;\n"
-        "varying vec4 color;\n"
-        "varying vec2 texCoord;\n"
+        "#version 130\n"
+        "uniform sampler2DArray sampler;\n"
+        "in vec4 color;\n"
+        "in vec3 texCoord;\n"
+        "flat in int distanceField;\n"
+        "out vec4 fragColor;\n"
         "void main() {\n"
-        "    gl_FragColor = texture2D(sampler, texCoord) * color;\n"
+        "    vec2 texels = vec2(textureSize(sampler, 0).xy);\n"
+        "    vec2 texelsPerPixel = fwidth(texCoord.xy) * texels;\n"
+        "    if (distanceField == 0) {\n"
+        "        fragColor = vec4(1.0, 1.0, 1.0, texture(sampler, texCoord).r) * color;\n"
+        "        return;\n"
+        "    }\n"
+        "    vec2 p = texCoord.xy * texels - 0.5;\n"
+        "    ivec2 i = clamp(ivec2(floor(p)), ivec2(0), ivec2(texels) - 2);\n"
+        "    vec2 f = clamp(p - vec2(i), 0.0, 1.0);\n"
+        "    int layer = int(texCoord.z);\n"
+        "    float top = mix(texelFetch(sampler, ivec3(i, layer), 0).r, texelFetch(sampler, ivec3(i.x + 1, i.y, layer), 0).r, f.x);\n"
+        "    float bottom = mix(texelFetch(sampler, ivec3(i.x, i.y + 1, layer), 0).r, texelFetch(sampler, ivec3(i + 1, layer), 0).r, f.x);\n"
+        "    float dist = (mix(top, bottom, f.y) * 255.0 - 128.0) * (float(" GFX_OPENGL_SHADER_CONST(GFX_SDF_SPREAD) ") / 128.0);\n"
+        "    float pixels = dist / max(0.5 * (texelsPerPixel.x + texelsPerPixel.y), 1e-4);\n"
+        "    fragColor = vec4(color.rgb, color.a * clamp(pixels + 0.5, 0.0, 1.0));\n"
         "}"
     ;
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+#include "../../text_blob.h"
+#include "display_list.h"
+#include "font_cache.h"
+#include <stdint.h>
+#include <vector>
+
+namespace gfx::OpenGL {
+    /**
+     * Text blob holding the quads of its glyphs, ready to be copied into a batch. It is tied to the font cache of the
+     * painter that created it and to the layout of its atlas, and is laid out again once glyphs were moved.
+    */
+    class TextBlob : public gfx::TextBlob {
+    public:
+        /**
+         * Create an empty blob, filled in by the painter.
+         * @param font Font of the blob.
+         * @param text String of the blob.
+         * @param alignment Sub-pixel alignment of the origin, in quarter pixels.
+         * @param cache Font cache holding the glyphs.
+        */
+        TextBlob(const Font& font, std::string_view text, int alignment, const FontCache* cache) :
+            gfx::TextBlob(font, text, alignment), cache(cache) {}
+
+        // Font cache holding the glyphs, the generation of its glyphs and its glyph mode when the blob was laid out
+        const FontCache* cache;
+        uint64_t atlasGeneration = 0;
+        GlyphMode mode = GLYPH_MODE_BITMAP;
+
+        // Quads of the glyphs relative to the start of the baseline. Color and clip slot are filled in when drawn.
+        std::vector<QuadInstance> quads;
+
+        // Descriptors of the glyphs, so that they can be kept in the cache while the blob is drawn
+        std::vector<GlyphDescriptor> glyphs;
+
+        // Index in the glyphs of the glyph drawn by each quad, and the start of the baseline under it in whole pixels
+        std::vector<int> quadGlyphs;
+        std::vector<int> quadPens;
+
+        // Whether some glyphs were still being rasterized when the blob was laid out, and so have no quad
+        bool pending = false;
+
+        // Frame of the font cache in which the blob was last drawn
+        mutable uint32_t lastDrawn = 0;
+
+    private:
+        friend class Painter;
+    };
+}
\ No newline at end of file
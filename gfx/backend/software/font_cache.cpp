@@ -0,0 +1,146 @@
+#include "font_cache.h"
+#include "flog/flog.h"
+#include <algorithm>
+
+namespace gfx::Software {
+    struct EvictionCandidate {
+        uint32_t lastUsed;
+        FontData* font;
+        GlyphDescriptor desc;
+    };
+
+    FontCache::FontCache() : store(FontStore::getInstance()) {}
+
+    FontCache::~FontCache() {
+        // Give the glyphs back to the store so that it can free those no other cache uses
+        for (auto& [stored, data] : fonts) {
+            data.glyphs.forEach([&](GlyphDescriptor desc, CachedGlyph&) {
+                store.releaseGlyph(stored, desc >> 2, desc & 0b11);
+            });
+        }
+        store.purge();
+    }
+
+    void FontCache::loadFont(const std::string& path) {
+        store.loadFont(path);
+    }
+
+    FontMetrics FontCache::getFontMetrics(const Font& font) {
+        // Return the metrics of the font in the store
+        return getData(font).font->metrics;
+    }
+
+    void FontCache::newFrame() {
+        // Glyphs are only released between frames, once the tiles of the previous frame were rasterized
+        frame++;
+        if (glyphCount > maxGlyphs) { trim(); }
+    }
+
+    const GlyphBitmap& FontCache::getGlyph(const Font& font, int glyphId, int alignment) {
+        // Get the font data
+        FontData& data = getData(font);
+
+        // Create the descriptor
+        GlyphDescriptor desc = (glyphId << 2) | alignment;
+
+        // If the glyph is cached, return it immediately
+        CachedGlyph* cached = data.glyphs.find(desc);
+        if (cached) {
+            cached->lastUsed = frame;
+            return *cached->glyph;
+        }
+
+        // The glyph is not in cache, get it from the store. It's only released between frames since the
+        // rasterizer reads the bitmaps until the end of the render.
+        const GlyphBitmap& glyph = store.acquireGlyph(data.font, glyphId, alignment);
+        data.glyphs.insert(desc, { &glyph, frame });
+        glyphCount++;
+        return glyph;
+    }
+
+    void FontCache::touchGlyph(const Font& font, GlyphDescriptor desc) {
+        // Update its last use if it's cached
+        CachedGlyph* cached = getData(font).glyphs.find(desc);
+        if (cached) { cached->lastUsed = frame; }
+    }
+
+    void FontCache::prewarm(const Font& font, const std::vector<CodepointRange>& ranges) {
+        // Request the glyphs that aren't cached yet, the store keeps them until fetched
+        FontData& data = getData(font);
+        for (const auto& range : ranges) {
+            for (int c = range.first; c <= range.last; c++) {
+                for (int a = 0; a < GFX_SOFTWARE_GLYPH_SUBPIXELS; a++) {
+                    if (data.glyphs.find((c << 2) | a)) { continue; }
+                    store.requestGlyph(data.font, c, a);
+                }
+            }
+        }
+    }
+
+    float FontCache::getKerning(const Font& font, int leftId, int rightId) {
+        // Get the pairs of the face from the store on first use, they never change afterwards
+        FontData& data = getData(font);
+        if (!data.kerning) { data.kerning = store.getKerningTable(data.font); }
+
+        // Scale the adjustment to the size of the font
+        return (float)data.kerning->get(leftId, rightId) * data.font->unitScale;
+    }
+
+    FontData& FontCache::getData(const Font& font) {
+        // Fonts are looked up directly by the ID of their handle
+        FontHandle handle = font.getHandle();
+        if (handle.id < slots.size()) {
+            const FontSlot& slot = slots[handle.id];
+            if (slot.data && slot.generation == handle.generation) { return *slot.data; }
+        }
+        else {
+            slots.resize(handle.id + 1, FontSlot{ 0, NULL });
+        }
+
+        // The handle wasn't resolved yet or its ID was recycled, get the font from the store
+        StoredFont* stored = store.getFont(font.getName(), font.getSize());
+
+        // Search for the font in the cache and add it if it's not available, fonts recycled with a new ID keep their glyphs
+        auto it = fonts.find(stored);
+        if (it == fonts.end()) {
+            it = fonts.emplace(stored, FontData()).first;
+            it->second.font = stored;
+            it->second.kerning = NULL;
+        }
+
+        // Remember it for the next glyphs of the handle
+        slots[handle.id] = { handle.generation, &it->second };
+        return it->second;
+    }
+
+    void FontCache::trim() {
+        // Collect the glyphs that weren't used in the current or previous frame.
+        // The frame counter may wrap around, so ages are computed as differences.
+        std::vector<EvictionCandidate> candidates;
+        for (auto& [stored, data] : fonts) {
+            data.glyphs.forEach([&](GlyphDescriptor desc, CachedGlyph& glyph) {
+                if (frame - glyph.lastUsed > 1) { candidates.push_back({ glyph.lastUsed, &data, desc }); }
+            });
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](const EvictionCandidate& a, const EvictionCandidate& b) {
+            return frame - a.lastUsed > frame - b.lastUsed;
+        });
+
+        // Release the least recently used glyphs until well below budget so that the following frames don't have to release again
+        int glyphTarget = maxGlyphs * 3 / 4;
+        int released = 0;
+        for (const auto& c : candidates) {
+            if (glyphCount <= glyphTarget) { break; }
+            c.font->glyphs.erase(c.desc);
+            store.releaseGlyph(c.font->font, c.desc >> 2, c.desc & 0b11);
+            glyphCount--;
+            released++;
+        }
+        if (!released) { return; }
+        flog::debug("Released {} glyphs from the font cache", released);
+
+        // Blobs laid out with the released glyphs have to be laid out again, then let the store free the glyphs no cache uses anymore
+        generation++;
+        store.purge();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,144 @@
+#pragma once
+#include "../../types.h"
+#include "../../font.h"
+#include "../../font_store.h"
+#include "../../glyph_table.h"
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#define GFX_SOFTWARE_GLYPH_SUBPIXELS    4
+#define GFX_SOFTWARE_GLYPH_BUDGET       8192
+
+namespace gfx::Software {
+    struct CachedGlyph {
+        // Glyph acquired from the store
+        const GlyphBitmap* glyph;
+
+        // Frame in which the glyph was last used
+        uint32_t lastUsed;
+    };
+
+    struct FontData {
+        // Font in the font store
+        StoredFont* font;
+
+        // Glyphs acquired from the store by descriptor
+        GlyphTable<CachedGlyph> glyphs;
+
+        // Kerning pairs of the face, NULL until first needed
+        const KerningTable* kerning;
+    };
+
+    struct FontSlot {
+        // Generation of the font handle the slot was resolved for
+        uint32_t generation;
+
+        // Data of the font, NULL if the slot was never resolved
+        FontData* data;
+    };
+
+    /**
+     * Glyphs used by a software painter. Font files and rasterized glyphs come from the process-wide FontStore,
+     * which this cache only keeps track of for fast access.
+    */
+    class FontCache {
+    public:
+        FontCache();
+
+        // Destructor
+        ~FontCache();
+
+        /**
+         * Load a font from file into the font store, making it available to all painters.
+         * @param path Path to the font file.
+        */
+        void loadFont(const std::string& path);
+
+        /**
+         * Get the metrics of a font.
+         * @param font Font to get the metrics of.
+         * @return Metrics of the font.
+        */
+        FontMetrics getFontMetrics(const Font& font);
+
+        /**
+         * Start a new frame, releasing the least recently used glyphs if the cache is over budget.
+         * Must only be called once nothing reads the glyphs handed out anymore, since they may be freed.
+        */
+        void newFrame();
+
+        /**
+         * Get the current frame, used to know which glyphs were used recently.
+         * @return Frame counter.
+        */
+        uint32_t getFrame() const { return frame; }
+
+        /**
+         * Get the generation of the glyphs. It changes every time glyphs are released, which invalidates all glyphs handed out before.
+         * @return Generation of the glyphs.
+        */
+        uint64_t getGeneration() const { return generation; }
+
+        /**
+         * Set how many glyphs the cache may hold before the least recently used glyphs are released.
+         * Glyphs used in the current or previous frame are never released, so the budget can be exceeded temporarily.
+         * @param maxGlyphs Maximum number of cached glyphs.
+        */
+        void setBudget(int maxGlyphs) { this->maxGlyphs = maxGlyphs; }
+
+        /**
+         * Check whether glyphs will be released at the start of the next frame, in which case glyphs drawn without
+         * being fetched must be marked as used with touchGlyph().
+         * @return True if over budget, false otherwise.
+        */
+        bool isOverBudget() const { return glyphCount > maxGlyphs; }
+
+        /**
+         * Get a glyph from a font by ID and alignement.
+         * The returned reference stays valid until the generation of the cache changes.
+         * @param font Font to which the glyphs belong.
+         * @param glyphId Unicode ID of the glyph.
+         * @param alignment Sub-pixel alignement. Must be between 0 and 3 inclusive.
+        */
+        const GlyphBitmap& getGlyph(const Font& font, int glyphId, int alignment);
+
+        /**
+         * Mark a cached glyph as used in the current frame without fetching it.
+         * @param font Font to which the glyph belongs.
+         * @param desc Descriptor of the glyph.
+        */
+        void touchGlyph(const Font& font, GlyphDescriptor desc);
+
+        /**
+         * Have the glyphs of ranges of codepoints rasterized in the background by the font store, for all sub-pixel alignments.
+         * Glyphs fetched once ready don't have to be rasterized.
+         * @param font Font to which the glyphs belong.
+         * @param ranges Codepoints to prepare.
+        */
+        void prewarm(const Font& font, const std::vector<CodepointRange>& ranges);
+
+        /**
+         * Get the kerning of two adjacent glyphs.
+         * @param font Font to which the glyphs belong.
+         * @param leftId Unicode ID of the left glyph.
+         * @param rightId Unicode ID of the right glyph.
+         * @return Adjustment of the advance of the left glyph in pixels.
+        */
+        float getKerning(const Font& font, int leftId, int rightId);
+
+    private:
+        FontData& getData(const Font& font);
+        void trim();
+
+        FontStore& store;
+        std::unordered_map<StoredFont*, FontData> fonts;
+        uint32_t frame = 0;
+        uint64_t generation = 0;
+        int glyphCount = 0;
+        int maxGlyphs = GFX_SOFTWARE_GLYPH_BUDGET;
+
+        // Data of the fonts by the ID of their handle, resolved once per handle
+        std::vector<FontSlot> slots;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,510 @@
+#include "painter.h"
+#include "../../utf8.h"
+#include "../../arc.h"
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+#include <stdexcept>
+
+#define FL_M_PI 3.141592653589793238462643383279502884197f
+
+namespace gfx::Software {
+    Painter::Painter(const Sizei& canvasSize, int threadCount) : pool(threadCount) {
+        // Set canvas size which also allocates the framebuffer and tile bins
+        setCanvasSize(canvasSize);
+    }
+
+    Sizei Painter::getCanvasSize() const {
+        return canvasSize;
+    }
+
+    void Painter::setCanvasSize(const Sizei& canvasSize) {
+        // Update size
+        this->canvasSize = canvasSize;
+
+        // Reallocate the framebuffer
+        framebuffer.assign(canvasSize.x * canvasSize.y, 0);
+
+        // Reallocate the tile bins
+        tileCountX = (canvasSize.x + GFX_SOFTWARE_TILE_SIZE - 1) / GFX_SOFTWARE_TILE_SIZE;
+        tileCountY = (canvasSize.y + GFX_SOFTWARE_TILE_SIZE - 1) / GFX_SOFTWARE_TILE_SIZE;
+        bins.clear();
+        bins.resize(tileCountX * tileCountY);
+        activeTiles.clear();
+        commands.clear();
+
+        // Update the stencil
+        stencil = Recti(Pointi(0, 0), canvasSize - Sizei(1, 1));
+    }
+
+    void Painter::beginRender() {
+        // Reset the statistics
+        stats = {};
+
+        // Reset the stencil and offset
+        if (!stencils.empty()) { stencils = std::stack<Recti>(); }
+        if (!stencilVisibilities.empty()) { stencilVisibilities = std::stack<bool>(); }
+        if (!offsets.empty()) { offsets = std::stack<Pointi>(); }
+        stencil = Recti(Pointi(0, 0), Pointi(canvasSize.x - 1, canvasSize.y - 1));
+        stencilVisible = true;
+        offset = Pointi(0, 0);
+
+        // Drop any command left over from an unfinished render
+        for (int t : activeTiles) { bins[t].clear(); }
+        activeTiles.clear();
+        commands.clear();
+    }
+
+    void Painter::endRender() {
+        // Update statistics
+        stats.commands += (int)commands.size();
+        stats.tiles += (int)activeTiles.size();
+
+        // Rasterize all tiles that have work to do in parallel
+        pool.run((int)activeTiles.size(), [this](int i) { renderTile(activeTiles[i]); });
+
+        // The tiles are done reading the glyphs, so the font cache can release those not used recently
+        fc.newFrame();
+
+        // Reset the bins for the next frame, keeping their allocations
+        for (int t : activeTiles) { bins[t].clear(); }
+        activeTiles.clear();
+        commands.clear();
+    }
+
+    void Painter::clear(const Color& color) {
+        Command cmd;
+        cmd.type = COMMAND_CLEAR;
+        cmd.color = packColor(color);
+        cmd.bounds = Recti(Pointi(0, 0), Pointi(canvasSize.x - 1, canvasSize.y - 1));
+        addCommand(cmd);
+    }
+
+    void Painter::pushStencil(const Recti& stencil) {
+        // Push the current stencil
+        stencils.push(this->stencil);
+        stencilVisibilities.push(stencilVisible);
+
+        // Compute the new stencil
+        Recti absStencil(stencil.A() + offset, stencil.B() + offset);
+        if (stencilVisible && (this->stencil && absStencil)) {
+            this->stencil = this->stencil & absStencil;
+        }
+        else {
+            stencilVisible = false;
+        }
+    }
+
+    void Painter::popStencil() {
+        // If no stencil was previous pushed, give up
+        if (stencils.empty()) { throw std::runtime_error("Cannot pop stencil, no stencil was pushed"); }
+
+        // Pop the stencil
+        stencil = stencils.top();
+        stencilVisible = stencilVisibilities.top();
+        stencils.pop();
+        stencilVisibilities.pop();
+    }
+
+    void Painter::pushOffset(const Pointi& offset) {
+        // Push the current offset
+        offsets.push(this->offset);
+
+        // Update the offset
+        this->offset = this->offset + offset;
+    }
+
+    void Painter::popOffset() {
+        // If no offset was previous pushed, give up
+        if (offsets.empty()) { throw std::runtime_error("Cannot pop offset, no offset was pushed"); }
+
+        // Pop the offset
+        offset = offsets.top();
+        offsets.pop();
+    }
+
+    void Painter::drawLine(const Point& a, const Point& b, const Color& color, float thickness) {
+        // Compute forward vector
+        Vec2f forw = b - a;
+        forw = forw * 0.5f / forw.N();
+
+        // Compute normal vector
+        Vec2f norm(forw.y, -forw.x);
+        norm = norm * thickness;
+
+        // Create triangles
+        uint32_t c = packColor(color);
+        Vec2f tl = a - forw - norm;
+        Vec2f tr = b + forw - norm;
+        Vec2f bl = a - forw + norm;
+        Vec2f br = b + forw + norm;
+        addTri(tl, tr, bl, c);
+        addTri(tr, bl, br, c);
+    }
+
+    void Painter::drawRect(const Rect& area, const Color& color, float thickness, float borderRadius) {
+        uint32_t c = packColor(color);
+
+        // Compute the outer and inner edges
+        float w = thickness - 1.0f;
+        float ox0 = area.A().x - 0.5f, oy0 = area.A().y - 0.5f;
+        float ox1 = area.B().x + 0.5f, oy1 = area.B().y + 0.5f;
+        float ix0 = area.A().x + 0.5f + w, iy0 = area.A().y + 0.5f + w;
+        float ix1 = area.B().x - 0.5f - w, iy1 = area.B().y - 0.5f - w;
+
+        // If the border fills the whole rectangle, draw it as a filled one
+        if (ix0 >= ix1 || iy0 >= iy1) {
+            fillRect(area, color, borderRadius);
+            return;
+        }
+
+        // A rounded border goes from the outline of the rectangle to that of the inner one, rounded by what is left of the radius
+        float radius = std::min<float>(borderRadius, std::min<float>(ox1 - ox0, oy1 - oy0) * 0.5f);
+        if (radius > 0.0f) {
+            getArcPoints(radius, FL_M_PI, 1.5f*FL_M_PI, arcPoints);
+            getRoundedRectPoints(Vec2f(ox0, oy0), Vec2f(ox1, oy1), radius, arcPoints, outerPoints);
+            getRoundedRectPoints(Vec2f(ix0, iy0), Vec2f(ix1, iy1), std::max<float>(radius - thickness, 0.0f), arcPoints, innerPoints);
+            addOutline(c);
+            return;
+        }
+
+        // Draw the four sides without overlap
+        addRect(ox0, oy0, ox1, iy0, c); // Top
+        addRect(ox0, iy1, ox1, oy1, c); // Bottom
+        addRect(ox0, iy0, ix0, iy1, c); // Left
+        addRect(ix1, iy0, ox1, iy1, c); // Right
+    }
+
+    void Painter::fillRect(const Rect& area, const Color& color, float borderRadius) {
+        uint32_t c = packColor(color);
+
+        // Get the edges of the rectangle
+        float x0 = area.A().x - 0.5f, y0 = area.A().y - 0.5f;
+        float x1 = area.B().x + 0.5f, y1 = area.B().y + 0.5f;
+
+        // Without rounding, the rectangle can use the span fill
+        float radius = std::min<float>(borderRadius, std::min<float>(x1 - x0, y1 - y0) * 0.5f);
+        if (radius <= 0.0f) {
+            addRect(x0, y0, x1, y1, c);
+            return;
+        }
+
+        // Otherwise fill the rounded outline as a fan around its center
+        getArcPoints(radius, FL_M_PI, 1.5f*FL_M_PI, arcPoints);
+        getRoundedRectPoints(Vec2f(x0, y0), Vec2f(x1, y1), radius, arcPoints, outerPoints);
+        Vec2f center((x0 + x1) * 0.5f, (y0 + y1) * 0.5f);
+        int count = (int)outerPoints.size();
+        for (int i = 0; i < count; i++) {
+            addTri(outerPoints[i], outerPoints[(i+1)%count], center, c);
+        }
+    }
+
+    void Painter::drawPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color, float thickness) {
+        // Draw the border between the outline of the polygon and its inner edge
+        polygon.getOutline(Point(position.x - 0.5f, position.y - 0.5f), size, thickness, outerPoints, innerPoints);
+        addOutline(packColor(color));
+    }
+
+    void Painter::fillPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color) {
+        // Compute the position of the vertices
+        const auto& verts = polygon.getVertices();
+        std::vector<Vec2f> points;
+        points.reserve(verts.size());
+        for (const auto& v : verts) {
+            points.push_back(Vec2f(position.x + v.x*size.x - 0.5f, position.y + v.y*size.y - 0.5f));
+        }
+
+        // Create triangles
+        uint32_t c = packColor(color);
+        for (const auto& t : polygon.getTriangles()) {
+            addTri(points[t[0]], points[t[1]], points[t[2]], c);
+        }
+    }
+
+    void Painter::drawArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color, float thickness) {
+        // Compute external and internal radii
+        float re = diameter / 2.0f;
+        float ri = re - thickness;
+
+        // Compute the points of the arc, spaced for the outer radius
+        getArcPoints(re, startAngle, endAngle, arcPoints);
+
+        // Create triangles
+        uint32_t c = packColor(color);
+        Vec2f cf = Vec2f(center.x, center.y);
+        Vec2f lastOuter = cf - arcPoints[0]*re;
+        Vec2f lastInner = cf - arcPoints[0]*ri;
+        for (size_t i = 1; i < arcPoints.size(); i++) {
+            const Vec2f& phase = arcPoints[i];
+            Vec2f outer = cf - phase*re;
+            Vec2f inner = cf - phase*ri;
+            addTri(lastOuter, lastInner, outer, c);
+            addTri(lastInner, outer, inner, c);
+            lastOuter = outer;
+            lastInner = inner;
+        }
+    }
+
+    void Painter::fillArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color) {
+        // Compute radius
+        float re = diameter / 2.0f;
+
+        // Compute the points of the arc
+        getArcPoints(re, startAngle, endAngle, arcPoints);
+
+        // Create triangles
+        uint32_t c = packColor(color);
+        Vec2f cf = Vec2f(center.x, center.y);
+        Vec2f last = cf - arcPoints[0]*re;
+        for (size_t i = 1; i < arcPoints.size(); i++) {
+            Vec2f next = cf - arcPoints[i]*re;
+            addTri(last, next, cf, c);
+            last = next;
+        }
+    }
+
+    Size Painter::measureText(const Font& font, const char* str) {
+        // The width is that of the string laid out from a whole pixel
+        return Size(getTextBlob(font, str, 0)->getWidth(), font.getSize());
+    }
+
+    void Painter::drawText(const Point& position, const char* str, const Font& font, const Color& color, HRef href, VRef vref) {
+        // The sub-pixel alignment of left aligned text is that of the position. Otherwise it depends on the width,
+        // which is given by the string laid out from a whole pixel.
+        int alignment = 0;
+        if (href == H_REF_LEFT) {
+            float x = roundf(position.x * 4.0f) * 0.25f;
+            alignment = (int)((x - floorf(x)) * 4.0f);
+        }
+        std::shared_ptr<TextBlob> blob = getTextBlob(font, str, alignment);
+        Vec2f origin = blob->getOrigin(position, href, vref);
+
+        // Use the layout matching the sub-pixel alignment of the origin
+        int originAlignment = (int)((origin.x - floorf(origin.x)) * 4.0f);
+        if (originAlignment != alignment) { blob = getTextBlob(font, str, originAlignment); }
+
+        // Draw the glyphs
+        addTextBlob(origin, *blob, packColor(color));
+    }
+
+    std::shared_ptr<const gfx::TextBlob> Painter::createTextBlob(const Font& font, const char* str) {
+        return getTextBlob(font, str, 0);
+    }
+
+    void Painter::drawTextBlob(const Point& position, const gfx::TextBlob& blob, const Color& color, HRef href, VRef vref) {
+        // Compute the start of the baseline
+        Vec2f origin = blob.getOrigin(position, href, vref);
+        int alignment = (int)((origin.x - floorf(origin.x)) * 4.0f);
+
+        // Draw the blob directly if its glyphs belong to this painter, are still cached, and it was laid out for the alignment of the origin
+        const TextBlob* own = dynamic_cast<const TextBlob*>(&blob);
+        if (own && own->cache == &fc && own->generation == fc.getGeneration() && own->getAlignment() == alignment) {
+            addTextBlob(origin, *own, packColor(color));
+            return;
+        }
+
+        // Otherwise, lay the string out again
+        addTextBlob(origin, *getTextBlob(blob.getFont(), blob.getText().c_str(), alignment), packColor(color));
+    }
+
+    void Painter::prewarm(const Font& font, const std::vector<CodepointRange>& ranges) {
+        fc.prewarm(font, ranges);
+    }
+
+    void Painter::addRect(float x0, float y0, float x1, float y1, uint32_t color) {
+        // Apply the offset
+        x0 += offset.x; x1 += offset.x;
+        y0 += offset.y; y1 += offset.y;
+
+        // Compute the pixels whose center is inside the rectangle
+        int px0 = (int)ceilf(x0);
+        int py0 = (int)ceilf(y0);
+        int px1 = (int)ceilf(x1) - 1;
+        int py1 = (int)ceilf(y1) - 1;
+        if (px1 < px0 || py1 < py0) { return; }
+
+        // Create the command
+        Command cmd;
+        cmd.type = COMMAND_RECT;
+        cmd.color = color;
+        cmd.bounds = Recti(Pointi(px0, py0), Pointi(px1, py1));
+        addCommand(cmd);
+    }
+
+    void Painter::addTri(const Vec2f& a, const Vec2f& b, const Vec2f& c, uint32_t color) {
+        // Convert the vertices to fixed point and apply the offset
+        const float scale = (float)(1 << GFX_SOFTWARE_SUBPIXEL_BITS);
+        const Vec2f* v[3] = { &a, &b, &c };
+        Command cmd;
+        cmd.type = COMMAND_TRIANGLE;
+        cmd.color = color;
+        for (int i = 0; i < 3; i++) {
+            cmd.tri.x[i] = (int32_t)lroundf((v[i]->x + offset.x) * scale);
+            cmd.tri.y[i] = (int32_t)lroundf((v[i]->y + offset.y) * scale);
+        }
+
+        // Compute the bounding box in pixels
+        int shift = GFX_SOFTWARE_SUBPIXEL_BITS;
+        int x0 = std::min<int>(cmd.tri.x[0], std::min<int>(cmd.tri.x[1], cmd.tri.x[2])) >> shift;
+        int y0 = std::min<int>(cmd.tri.y[0], std::min<int>(cmd.tri.y[1], cmd.tri.y[2])) >> shift;
+        int x1 = (std::max<int>(cmd.tri.x[0], std::max<int>(cmd.tri.x[1], cmd.tri.x[2])) >> shift) + 1;
+        int y1 = (std::max<int>(cmd.tri.y[0], std::max<int>(cmd.tri.y[1], cmd.tri.y[2])) >> shift) + 1;
+        cmd.bounds = Recti(Pointi(x0, y0), Pointi(x1, y1));
+        addCommand(cmd);
+    }
+
+    void Painter::addOutline(uint32_t color) {
+        // Join each pair of outer and inner points to the next with two triangles
+        int count = (int)outerPoints.size();
+        for (int i = 0; i < count; i++) {
+            int j = (i+1)%count;
+            addTri(outerPoints[i], outerPoints[j], innerPoints[i], color);
+            addTri(outerPoints[j], innerPoints[j], innerPoints[i], color);
+        }
+    }
+
+    void Painter::addBitmap(const Pointi& pos, const Sizei& size, const uint8_t* data, uint32_t color) {
+        Command cmd;
+        cmd.type = COMMAND_BITMAP;
+        cmd.color = color;
+        cmd.bitmap.data = data;
+        cmd.bitmap.x = pos.x + offset.x;
+        cmd.bitmap.y = pos.y + offset.y;
+        cmd.bitmap.width = size.x;
+        cmd.bitmap.height = size.y;
+        cmd.bounds = Recti(Pointi(cmd.bitmap.x, cmd.bitmap.y), size);
+        addCommand(cmd);
+    }
+
+    std::shared_ptr<TextBlob> Painter::getTextBlob(const Font& font, const char* str, int alignment) {
+        // If the string was laid out recently and its glyphs weren't released since, reuse it
+        std::string_view text(str);
+        std::shared_ptr<TextBlob> blob = blobs.find(font, text, alignment);
+        if (blob && blob->generation == fc.getGeneration()) { return blob; }
+
+        // Create the blob
+        blob = std::make_shared<TextBlob>(font, text, alignment, &fc);
+        blob->generation = fc.getGeneration();
+        FontMetrics metrics = fc.getFontMetrics(font);
+        blob->ascender = metrics.ascender;
+        blob->descender = metrics.descender;
+
+        // Decode the whole string at once
+        codepoints.resize(text.size());
+        size_t count = decodeUTF8(text.data(), text.size(), codepoints.data());
+
+        // Iterate over all characters, starting from the sub-pixel alignment
+        float cursor = (float)alignment * 0.25f;
+        int prevId = 0;
+        Pointi boundsMin(INT_MAX, INT_MAX);
+        Pointi boundsMax(INT_MIN, INT_MIN);
+        for (size_t i = 0; i < count; i++) {
+            // Get unicode ID
+            int id = codepoints[i];
+
+            // Apply the kerning with the previous glyph
+            if (prevId) { cursor += fc.getKerning(font, prevId, id); }
+            prevId = id;
+
+            // Compute the sub-pixel alignment
+            int x = floorf(cursor);
+            int subx = floorf((cursor - x) * 4.0f);
+
+            // Fetch glyph info
+            const GlyphBitmap& info = fc.getGlyph(font, id, subx);
+
+            // Place the glyph, skipping empty ones such as spaces
+            if (info.size.x && info.size.y) {
+                Pointi pos(x + info.offset.x, -info.offset.y);
+                blob->glyphs.push_back({ &info, (GlyphDescriptor)((id << 2) | subx), pos });
+                boundsMin = Pointi(std::min<int>(boundsMin.x, pos.x), std::min<int>(boundsMin.y, pos.y));
+                boundsMax = Pointi(std::max<int>(boundsMax.x, pos.x + info.size.x), std::max<int>(boundsMax.y, pos.y + info.size.y));
+            }
+
+            // Update cursor
+            cursor += info.xAdvance;
+        }
+        blob->width = cursor - (float)alignment * 0.25f;
+        if (!blob->glyphs.empty()) {
+            blob->bounds = Rect(Point(boundsMin.x, boundsMin.y), Size(boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y));
+        }
+
+        // Keep it for the next time the string is drawn
+        blobs.insert(blob);
+        return blob;
+    }
+
+    void Painter::addTextBlob(const Vec2f& origin, const TextBlob& blob, uint32_t color) {
+        // Blit the glyphs from the start of the baseline
+        Pointi base((int)floorf(origin.x), (int)origin.y);
+        for (const auto& g : blob.glyphs) {
+            addBitmap(base + g.position, g.glyph->size, g.glyph->bitmap.data(), color);
+        }
+
+        // Glyphs drawn from blobs aren't fetched, so mark them as used when glyphs are about to be released
+        if (fc.isOverBudget()) {
+            for (const auto& g : blob.glyphs) { fc.touchGlyph(blob.getFont(), g.desc); }
+        }
+    }
+
+    void Painter::addCommand(const Command& cmd) {
+        // Clip the command to the stencil, clears ignore it
+        Recti bounds = cmd.bounds;
+        if (cmd.type != COMMAND_CLEAR) {
+            // Drop the command if it's fully transparent or the stencil hides it
+            if (!(cmd.color >> 24) || !stencilVisible || !(bounds && stencil)) { return; }
+            bounds = bounds & stencil;
+        }
+
+        // Save the command
+        int id = (int)commands.size();
+        commands.push_back(cmd);
+        commands.back().bounds = bounds;
+
+        // Add it to the bin of every tile it touches
+        int tx0 = bounds.A().x / GFX_SOFTWARE_TILE_SIZE;
+        int ty0 = bounds.A().y / GFX_SOFTWARE_TILE_SIZE;
+        int tx1 = bounds.B().x / GFX_SOFTWARE_TILE_SIZE;
+        int ty1 = bounds.B().y / GFX_SOFTWARE_TILE_SIZE;
+        for (int ty = ty0; ty <= ty1; ty++) {
+            for (int tx = tx0; tx <= tx1; tx++) {
+                int t = ty*tileCountX + tx;
+                if (bins[t].empty()) { activeTiles.push_back(t); }
+                bins[t].push_back(id);
+            }
+        }
+    }
+
+    void Painter::renderTile(int tile) {
+        // Compute the area of the tile
+        Pointi ta((tile % tileCountX) * GFX_SOFTWARE_TILE_SIZE, (tile / tileCountX) * GFX_SOFTWARE_TILE_SIZE);
+        Pointi tb(std::min<int>(ta.x + GFX_SOFTWARE_TILE_SIZE, canvasSize.x) - 1, std::min<int>(ta.y + GFX_SOFTWARE_TILE_SIZE, canvasSize.y) - 1);
+        Recti tileArea(ta, tb);
+        Target target = { framebuffer.data(), canvasSize.x };
+
+        // Execute the commands in order, restricted to the tile
+        for (int id : bins[tile]) {
+            const Command& cmd = commands[id];
+            Recti clip = cmd.bounds & tileArea;
+            switch (cmd.type) {
+            case COMMAND_CLEAR:
+                for (int y = clip.A().y; y <= clip.B().y; y++) {
+                    uint32_t* row = &framebuffer[y * canvasSize.x];
+                    std::fill(&row[clip.A().x], &row[clip.B().x + 1], cmd.color);
+                }
+                break;
+            case COMMAND_RECT:
+                rasterizeRect(target, clip, cmd.color);
+                break;
+            case COMMAND_TRIANGLE:
+                rasterizeTriangle(target, cmd.tri, clip, cmd.color);
+                break;
+            case COMMAND_BITMAP:
+                rasterizeBitmap(target, Pointi(cmd.bitmap.x, cmd.bitmap.y), Sizei(cmd.bitmap.width, cmd.bitmap.height), cmd.bitmap.data, clip, cmd.color);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,260 @@
+#pragma once
+#include "../../painter.h"
+#include "font_cache.h"
+#include "text_blob.h"
+#include "rasterizer.h"
+#include <memory>
+#include "worker_pool.h"
+#include <vector>
+#include <stack>
+
+#define GFX_SOFTWARE_TILE_SIZE  64
+
+namespace gfx::Software {
+    enum CommandType {
+        COMMAND_CLEAR,
+        COMMAND_RECT,
+        COMMAND_TRIANGLE,
+        COMMAND_BITMAP
+    };
+
+    struct BitmapCommand {
+        const uint8_t* data;
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    struct Command {
+        CommandType type;
+        uint32_t color;
+
+        // Area that the command can touch, already clipped to the stencil and canvas
+        Recti bounds;
+
+        union {
+            Triangle tri;
+            BitmapCommand bitmap;
+        };
+    };
+
+    struct RenderStats {
+        // Number of commands recorded
+        int commands;
+
+        // Number of tiles that had commands to rasterize
+        int tiles;
+    };
+
+    class Painter : public gfx::Painter {
+    public:
+        /**
+         * Create a CPU-based painter rendering into its own framebuffer.
+         * @param canvasSize Size of the canvas.
+         * @param threadCount Number of threads used to rasterize. Zero selects the number of hardware threads.
+        */
+        Painter(const Sizei& canvasSize, int threadCount = 0);
+
+        /**
+         * Get the size of the canvas.
+         * @return Size of the canvas.
+        */
+        Sizei getCanvasSize() const;
+
+        /**
+         * Set the size of the canvas. The content of the framebuffer is lost.
+         * @param canvasSize Size of the canvas.
+        */
+        void setCanvasSize(const Sizei& canvasSize);
+
+        /**
+         * Get the framebuffer. Pixels are stored line by line as R, G, B, A bytes.
+         * Its content is only valid after endRender() returns.
+         * @return Pointer to the first pixel of the framebuffer.
+        */
+        const uint32_t* getFramebuffer() const { return framebuffer.data(); }
+
+        /**
+         * Get statistics about the current or last render.
+         * @return Render statistics. Reset by beginRender().
+        */
+        const RenderStats& getStats() const { return stats; }
+
+        /**
+         * Start the rendering procedure.
+        */
+        void beginRender();
+
+        /**
+         * Stop the rendering procedure. Rasterizes all commands issued since beginRender().
+        */
+        void endRender();
+
+        /**
+         * Fill the whole canvas with a color, ignoring the stencil.
+         * @param color Color to fill the canvas with.
+        */
+        void clear(const Color& color);
+
+        void pushStencil(const Recti& stencil);
+
+        void popStencil();
+
+        void pushOffset(const Pointi& offset);
+
+        void popOffset();
+
+        /**
+         * Draw a line.
+         * @param a Starting point.
+         * @param b Ending point.
+         * @param color Color of the line.
+         * @param thickness Thickness of the line in pixels
+        */
+        void drawLine(const Point& a, const Point& b, const Color& color, float thickness = 1);
+
+        /**
+         * Draw a hollow rectangle.
+         * @param area Area of rectangle including border.
+         * @param color Color of the rectangle.
+         * @param thickness Thickness of the border in pixels.
+         * @param borderRadius Rounding radius in pixels.
+        */
+        void drawRect(const Rect& area, const Color& color, float thickness = 1, float borderRadius = 0);
+
+        /**
+         * Draw a filled rectangle.
+         * @param area Area of rectangle including border.
+         * @param color Color of the rectangle.
+         * @param borderRadius Rounding radius in pixels.
+        */
+        void fillRect(const Rect& area, const Color& color, float borderRadius = 0);
+
+        /**
+         * Draw a hollow polygon.
+         * @param position Position of the top left corner of the polygon.
+         * @param polygon The polygon to draw.
+         * @param size Size of the bounding box of the polygon.
+         * @param color Color of the polygon.
+         * @param thickness Thickness of the border in pixels.
+        */
+        void drawPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color, float thickness = 1);
+
+        /**
+         * Draw a filled polygon.
+         * @param position Position of the top left corner of the polygon.
+         * @param polygon The polygon to draw.
+         * @param size Size of the bounding box of the polygon.
+         * @param color Color of the polygon.
+        */
+        void fillPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color);
+
+        /**
+         * Draw a hollow arc. The arc is drawn in a clockwise direction with the reference point being on the left.
+         * @param center Center point.
+         * @param diameter Diameter of the arc in pixels.
+         * @param startAngle Angle at which the arc start.
+         * @param endAngle Angle at which the arc ends.
+         * @param color  Color of the arc.
+        */
+        void drawArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color, float thickness = 1);
+
+        /**
+         * Draw a filled arc. The arc is drawn in a clockwise direction with the reference point being on the left.
+         * @param center Center point.
+         * @param diameter Diameter of the arc in pixels.
+         * @param startAngle Angle at which the arc start.
+         * @param endAngle Angle at which the arc ends.
+         * @param color  Color of the arc.
+        */
+        void fillArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color);
+
+        /**
+         * Measure the size of a string.
+         * @param str String to draw.
+         * @param font Font to use to draw the string.
+        */
+        Size measureText(const Font& font, const char* str);
+
+        /**
+         * Draw a string.
+         * @param position Position at which the string will be draw.
+         * @param str String to draw.
+         * @param font Font to use to draw the string.
+         * @param color Color of the text.
+         * @param href Horizontal reference point.
+         * @param vref Vertical reference point.
+        */
+        void drawText(const Point& position, const char* str, const Font& font, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE);
+
+        /**
+         * Lay out a string so that it can be drawn many times without looking up its glyphs again.
+         * @param font Font to lay the string out in.
+         * @param str String to lay out.
+         * @return Text blob, which can only be drawn directly by this painter and only while it exists.
+        */
+        std::shared_ptr<const gfx::TextBlob> createTextBlob(const Font& font, const char* str);
+
+        /**
+         * Draw a text blob. Blobs of other painters, or laid out for another sub-pixel alignment of the origin, are laid out again.
+         * @param position Position at which the blob will be drawn.
+         * @param blob Text blob to draw.
+         * @param color Color of the text.
+         * @param href Horizontal reference point.
+         * @param vref Vertical reference point.
+        */
+        void drawTextBlob(const Point& position, const gfx::TextBlob& blob, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE);
+
+        /**
+         * Rasterize the glyphs of ranges of codepoints in the background, for all sub-pixel alignments, so that drawing them doesn't have to.
+         * @param font Font to which the glyphs belong.
+         * @param ranges Codepoints to prepare.
+        */
+        void prewarm(const Font& font, const std::vector<CodepointRange>& ranges);
+
+        FontCache fc;
+
+    private:
+        void addRect(float x0, float y0, float x1, float y1, uint32_t color);
+        void addTri(const Vec2f& a, const Vec2f& b, const Vec2f& c, uint32_t color);
+        void addOutline(uint32_t color);
+        void addBitmap(const Pointi& pos, const Sizei& size, const uint8_t* data, uint32_t color);
+        std::shared_ptr<TextBlob> getTextBlob(const Font& font, const char* str, int alignment);
+        void addTextBlob(const Vec2f& origin, const TextBlob& blob, uint32_t color);
+        void addCommand(const Command& cmd);
+        void renderTile(int tile);
+
+        Sizei canvasSize;
+        std::vector<uint32_t> framebuffer;
+
+        // Stencil and offset state
+        std::stack<Recti> stencils;
+        std::stack<bool> stencilVisibilities;
+        std::stack<Pointi> offsets;
+        Recti stencil;
+        bool stencilVisible = true;
+        Pointi offset;
+
+        // Commands and the list of commands touching each tile
+        std::vector<Command> commands;
+        std::vector<std::vector<int>> bins;
+        std::vector<int> activeTiles;
+        int tileCountX = 0;
+        int tileCountY = 0;
+        RenderStats stats = {};
+
+        // Recently drawn strings, laid out, and the decoded codepoints of the string being laid out
+        TextBlobCache<TextBlob> blobs;
+        std::vector<int> codepoints;
+
+        // Points of the arc being drawn, on the unit circle
+        std::vector<Vec2f> arcPoints;
+
+        // Outer and inner edges of the border being drawn
+        std::vector<Vec2f> outerPoints;
+        std::vector<Vec2f> innerPoints;
+
+        WorkerPool pool;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "rasterizer.h"
+#include <algorithm>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GFX_SOFTWARE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define SUBPIXEL_SCALE  (1 << GFX_SOFTWARE_SUBPIXEL_BITS)
+
+namespace gfx::Software {
+    uint32_t packColor(const Color& color) {
+        // Convert each channel to an 8bit integer, clamping out of range values
+        auto conv = [](float v) { return (uint32_t)(std::clamp<float>(v, 0.0f, 1.0f) * 255.0f + 0.5f); };
+        return conv(color.r) | (conv(color.g) << 8) | (conv(color.b) << 16) | (conv(color.a) << 24);
+    }
+
+    // Exact division by 255 with rounding, valid for x <= 255*255
+    inline uint32_t div255(uint32_t x) {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+    inline uint32_t blendPixel(uint32_t dst, uint32_t src, uint32_t alpha) {
+        uint32_t inv = 255 - alpha;
+        uint32_t r = div255((src & 0xFF) * alpha + (dst & 0xFF) * inv);
+        uint32_t g = div255(((src >> 8) & 0xFF) * alpha + ((dst >> 8) & 0xFF) * inv);
+        uint32_t b = div255(((src >> 16) & 0xFF) * alpha + ((dst >> 16) & 0xFF) * inv);
+        uint32_t a = div255((src >> 24) * alpha + (dst >> 24) * inv);
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+#ifdef GFX_SOFTWARE_SSE2
+    // Same as div255 but on eight 16bit lanes
+    inline __m128i div255x8(__m128i x) {
+        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+#endif
+
+    void blendSpan(uint32_t* dst, int count, uint32_t color) {
+        // Fully transparent colors don't change anything
+        uint32_t alpha = color >> 24;
+        if (!alpha) { return; }
+        int i = 0;
+
+        // Opaque colors can simply be stored
+        if (alpha == 255) {
+#ifdef GFX_SOFTWARE_SSE2
+            __m128i c = _mm_set1_epi32(color);
+            for (; i + 4 <= count; i += 4) {
+                _mm_storeu_si128((__m128i*)&dst[i], c);
+            }
+#endif
+            for (; i < count; i++) { dst[i] = color; }
+            return;
+        }
+
+#ifdef GFX_SOFTWARE_SSE2
+        // Blend four pixels at a time
+        __m128i zero = _mm_setzero_si128();
+        __m128i inv = _mm_set1_epi16(255 - alpha);
+        __m128i src = _mm_mullo_epi16(_mm_unpacklo_epi8(_mm_set1_epi32(color), zero), _mm_set1_epi16(alpha));
+        for (; i + 4 <= count; i += 4) {
+            __m128i d = _mm_loadu_si128((__m128i*)&dst[i]);
+            __m128i lo = div255x8(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv), src));
+            __m128i hi = div255x8(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv), src));
+            _mm_storeu_si128((__m128i*)&dst[i], _mm_packus_epi16(lo, hi));
+        }
+#endif
+
+        // Blend the remaining pixels
+        for (; i < count; i++) {
+            dst[i] = blendPixel(dst[i], color, alpha);
+        }
+    }
+
+    void blendSpanCoverage(uint32_t* dst, const uint8_t* coverage, int count, uint32_t color) {
+        uint32_t colorAlpha = color >> 24;
+        uint32_t rgb = color & 0x00FFFFFF;
+        int i = 0;
+
+#ifdef GFX_SOFTWARE_SSE2
+        // Blend four pixels at a time
+        __m128i zero = _mm_setzero_si128();
+        __m128i ff = _mm_set1_epi16(255);
+        __m128i ca = _mm_set1_epi16(colorAlpha);
+        __m128i amask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+        __m128i src = _mm_andnot_si128(amask, _mm_unpacklo_epi8(_mm_set1_epi32(rgb), zero));
+        for (; i + 4 <= count; i += 4) {
+            // Skip groups of pixels that aren't covered at all
+            uint32_t cov4;
+            memcpy(&cov4, &coverage[i], 4);
+            if (!cov4) { continue; }
+
+            // Compute the blending factor of each pixel and spread it to its four channels
+            __m128i a = div255x8(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(cov4), zero), ca));
+            a = _mm_unpacklo_epi16(a, a);
+            __m128i aLo = _mm_unpacklo_epi32(a, a);
+            __m128i aHi = _mm_unpackhi_epi32(a, a);
+
+            // The source alpha channel is the blending factor itself
+            __m128i sLo = _mm_or_si128(src, _mm_and_si128(amask, aLo));
+            __m128i sHi = _mm_or_si128(src, _mm_and_si128(amask, aHi));
+
+            // Blend
+            __m128i d = _mm_loadu_si128((__m128i*)&dst[i]);
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(ff, aLo)), _mm_mullo_epi16(sLo, aLo));
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(ff, aHi)), _mm_mullo_epi16(sHi, aHi));
+            _mm_storeu_si128((__m128i*)&dst[i], _mm_packus_epi16(div255x8(lo), div255x8(hi)));
+        }
+#endif
+
+        // Blend the remaining pixels
+        for (; i < count; i++) {
+            if (!coverage[i]) { continue; }
+            uint32_t alpha = div255(colorAlpha * coverage[i]);
+            dst[i] = blendPixel(dst[i], rgb | (alpha << 24), alpha);
+        }
+    }
+
+    void rasterizeRect(const Target& target, const Recti& area, uint32_t color) {
+        uint32_t* row = &target.pixels[area.A().y * target.stride + area.A().x];
+        for (int y = area.A().y; y <= area.B().y; y++) {
+            blendSpan(row, area.size().x, color);
+            row += target.stride;
+        }
+    }
+
+    inline int64_t floorDiv(int64_t n, int64_t d) {
+        int64_t q = n / d;
+        if ((n % d) && ((n < 0) != (d < 0))) { q--; }
+        return q;
+    }
+
+    inline int64_t ceilDiv(int64_t n, int64_t d) {
+        return -floorDiv(-n, d);
+    }
+
+    void rasterizeTriangle(const Target& target, const Triangle& tri, const Recti& clip, uint32_t color) {
+        // Get vertices and make sure the winding is such that the inside is positive
+        int64_t x[3] = { tri.x[0], tri.x[1], tri.x[2] };
+        int64_t y[3] = { tri.y[0], tri.y[1], tri.y[2] };
+        int64_t area = (x[1] - x[0])*(y[2] - y[0]) - (y[1] - y[0])*(x[2] - x[0]);
+        if (!area) { return; }
+        if (area < 0) {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+        }
+
+        // Compute the rows covered by the triangle
+        int64_t minY = std::min<int64_t>(y[0], std::min<int64_t>(y[1], y[2]));
+        int64_t maxY = std::max<int64_t>(y[0], std::max<int64_t>(y[1], y[2]));
+        int y0 = (int)std::max<int64_t>(ceilDiv(minY, SUBPIXEL_SCALE), clip.A().y);
+        int y1 = (int)std::min<int64_t>(floorDiv(maxY, SUBPIXEL_SCALE), clip.B().y);
+        if (y1 < y0) { return; }
+
+        // Setup the edge functions. A sample exactly on an edge is only drawn if the edge is a top-left one,
+        // so that two triangles sharing an edge never both draw it.
+        int64_t dx[3], dy[3], k[3], minE[3];
+        for (int i = 0; i < 3; i++) {
+            int j = (i + 1) % 3;
+            dx[i] = x[j] - x[i];
+            dy[i] = y[j] - y[i];
+            k[i] = dx[i]*((int64_t)y0*SUBPIXEL_SCALE - y[i]) + dy[i]*x[i];
+            minE[i] = (dy[i] < 0 || (dy[i] == 0 && dx[i] < 0)) ? 0 : 1;
+        }
+
+        // Draw each row
+        uint32_t* row = &target.pixels[y0 * target.stride];
+        for (int py = y0; py <= y1; py++) {
+            // Intersect the half-planes of the three edges with the row
+            int64_t xs = clip.A().x;
+            int64_t xe = clip.B().x;
+            for (int i = 0; i < 3; i++) {
+                int64_t a = -dy[i]*SUBPIXEL_SCALE;
+                int64_t r = minE[i] - k[i];
+                if (a > 0) {
+                    xs = std::max<int64_t>(xs, ceilDiv(r, a));
+                }
+                else if (a < 0) {
+                    xe = std::min<int64_t>(xe, floorDiv(r, a));
+                }
+                else if (r > 0) {
+                    xe = xs - 1;
+                }
+                k[i] += dx[i]*SUBPIXEL_SCALE;
+            }
+
+            // Fill the span
+            if (xe >= xs) { blendSpan(&row[xs], (int)(xe - xs + 1), color); }
+            row += target.stride;
+        }
+    }
+
+    void rasterizeBitmap(const Target& target, const Pointi& pos, const Sizei& size, const uint8_t* bitmap, const Recti& clip, uint32_t color) {
+        // Compute the visible area of the bitmap
+        int x0 = std::max<int>(pos.x, clip.A().x);
+        int y0 = std::max<int>(pos.y, clip.A().y);
+        int x1 = std::min<int>(pos.x + size.x - 1, clip.B().x);
+        int y1 = std::min<int>(pos.y + size.y - 1, clip.B().y);
+        if (x1 < x0 || y1 < y0) { return; }
+
+        // Blend each row
+        const uint8_t* src = &bitmap[(y0 - pos.y) * size.x + (x0 - pos.x)];
+        uint32_t* row = &target.pixels[y0 * target.stride + x0];
+        for (int y = y0; y <= y1; y++) {
+            blendSpanCoverage(row, src, x1 - x0 + 1, color);
+            src += size.x;
+            row += target.stride;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+#include "../../types.h"
+#include "../../color.h"
+#include <stdint.h>
+
+#define GFX_SOFTWARE_SUBPIXEL_BITS  8
+
+namespace gfx::Software {
+    /**
+     * Pack a color into a 32bit RGBA pixel stored as R, G, B, A bytes in memory.
+     * @param color Color to pack.
+     * @return Packed pixel.
+    */
+    uint32_t packColor(const Color& color);
+
+    /**
+     * Triangle with its vertices in fixed-point pixel coordinates.
+    */
+    struct Triangle {
+        int32_t x[3];
+        int32_t y[3];
+    };
+
+    /**
+     * Area of a framebuffer to render into.
+    */
+    struct Target {
+        uint32_t* pixels;
+        int stride;
+    };
+
+    /**
+     * Blend a color over a span of pixels.
+     * @param dst First pixel of the span.
+     * @param count Number of pixels in the span.
+     * @param color Packed color. Its alpha is used as the blending factor.
+    */
+    void blendSpan(uint32_t* dst, int count, uint32_t color);
+
+    /**
+     * Blend a color over a span of pixels weighted by a per-pixel coverage.
+     * @param dst First pixel of the span.
+     * @param coverage Coverage of each pixel from 0 to 255.
+     * @param count Number of pixels in the span.
+     * @param color Packed color. Its alpha is multiplied by the coverage to get the blending factor.
+    */
+    void blendSpanCoverage(uint32_t* dst, const uint8_t* coverage, int count, uint32_t color);
+
+    /**
+     * Fill an area of the target with a color.
+     * @param target Target to draw into.
+     * @param area Area in pixels, inclusive and already clipped to the target.
+     * @param color Packed color.
+    */
+    void rasterizeRect(const Target& target, const Recti& area, uint32_t color);
+
+    /**
+     * Rasterize a triangle. Pixels are sampled at their center and shared edges are only drawn once.
+     * @param target Target to draw into.
+     * @param tri Triangle to draw.
+     * @param clip Area to limit drawing to, inclusive and already clipped to the target.
+     * @param color Packed color.
+    */
+    void rasterizeTriangle(const Target& target, const Triangle& tri, const Recti& clip, uint32_t color);
+
+    /**
+     * Blend a coverage bitmap, such as a glyph, onto the target.
+     * @param target Target to draw into.
+     * @param pos Position of the top left pixel of the bitmap.
+     * @param size Size of the bitmap in pixels.
+     * @param bitmap Coverage bitmap, one byte per pixel, tightly packed.
+     * @param clip Area to limit drawing to, inclusive and already clipped to the target.
+     * @param color Packed color.
+    */
+    void rasterizeBitmap(const Target& target, const Pointi& pos, const Sizei& size, const uint8_t* bitmap, const Recti& clip, uint32_t color);
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include "../../text_blob.h"
+#include "font_cache.h"
+#include <vector>
+
+namespace gfx::Software {
+    struct BlobGlyph {
+        // Rasterized glyph, owned by the font cache, and its descriptor
+        const GlyphBitmap* glyph;
+        GlyphDescriptor desc;
+
+        // Top left corner relative to the start of the baseline
+        Pointi position;
+    };
+
+    /**
+     * Text blob holding the glyphs to blit. It is tied to the font cache of the painter that created it,
+     * and is laid out again once the cache released glyphs.
+    */
+    class TextBlob : public gfx::TextBlob {
+    public:
+        /**
+         * Create an empty blob, filled in by the painter.
+         * @param font Font of the blob.
+         * @param text String of the blob.
+         * @param alignment Sub-pixel alignment of the origin, in quarter pixels.
+         * @param cache Font cache holding the glyphs.
+        */
+        TextBlob(const Font& font, std::string_view text, int alignment, const FontCache* cache) :
+            gfx::TextBlob(font, text, alignment), cache(cache) {}
+
+        // Font cache holding the glyphs, and the generation of its glyphs when the blob was laid out
+        const FontCache* cache;
+        uint64_t generation = 0;
+
+        // Glyphs that have pixels, in drawing order
+        std::vector<BlobGlyph> glyphs;
+
+    private:
+        friend class Painter;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+namespace gfx::Software {
+    WorkerPool::WorkerPool(int threadCount) {
+        // Select the number of threads
+        if (threadCount <= 0) { threadCount = std::max<int>(std::thread::hardware_concurrency(), 1); }
+
+        // Start the workers, the calling thread counts as one
+        for (int i = 1; i < threadCount; i++) {
+            workers.push_back(std::thread(&WorkerPool::worker, this));
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        // Tell the workers to stop
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stop = true;
+        }
+        startCnd.notify_all();
+
+        // Wait for them to exit
+        for (auto& w : workers) { w.join(); }
+    }
+
+    void WorkerPool::run(int count, const std::function<void(int)>& job) {
+        // If there's nothing to do, return immediately
+        if (count <= 0) { return; }
+
+        // If no worker is available or there's a single job, do it on the calling thread
+        if (workers.empty() || count == 1) {
+            for (int i = 0; i < count; i++) { job(i); }
+            return;
+        }
+
+        // Publish the job and wake up the workers
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            this->job = &job;
+            jobCount = count;
+            next = 0;
+            busy = (int)workers.size();
+            generation++;
+        }
+        startCnd.notify_all();
+
+        // Take part in the work
+        work();
+
+        // Wait for all workers to be done
+        std::unique_lock<std::mutex> lck(mtx);
+        doneCnd.wait(lck, [this]() { return !busy; });
+        this->job = NULL;
+    }
+
+    void WorkerPool::worker() {
+        uint64_t lastGen = 0;
+        while (true) {
+            // Wait for a new job or for the stop signal
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                startCnd.wait(lck, [&]() { return stop || generation != lastGen; });
+                if (stop) { return; }
+                lastGen = generation;
+            }
+
+            // Process indices until there are none left
+            work();
+
+            // Notify the caller if this was the last worker running
+            std::lock_guard<std::mutex> lck(mtx);
+            if (!--busy) { doneCnd.notify_one(); }
+        }
+    }
+
+    void WorkerPool::work() {
+        while (true) {
+            int i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= jobCount) { return; }
+            (*job)(i);
+        }
+    }
+}
\ No newline at end of file
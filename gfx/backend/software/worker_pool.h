@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace gfx::Software {
+    class WorkerPool {
+    public:
+        /**
+         * Create a pool of worker threads.
+         * @param threadCount Number of threads including the calling thread. Zero selects the number of hardware threads.
+        */
+        WorkerPool(int threadCount = 0);
+
+        // Destructor
+        ~WorkerPool();
+
+        /**
+         * Get the number of threads taking part in a job, including the calling thread.
+         * @return Number of threads.
+        */
+        int getThreadCount() const { return (int)workers.size() + 1; }
+
+        /**
+         * Run a job over a range of indices and wait for it to complete. The calling thread takes part in the work.
+         * @param count Number of indices to process.
+         * @param job Function called once for every index from zero to count-1.
+        */
+        void run(int count, const std::function<void(int)>& job);
+
+    private:
+        void worker();
+        void work();
+
+        std::vector<std::thread> workers;
+
+        std::mutex mtx;
+        std::condition_variable startCnd;
+        std::condition_variable doneCnd;
+        uint64_t generation = 0;
+        int busy = 0;
+        bool stop = false;
+
+        const std::function<void(int)>* job = NULL;
+        int jobCount = 0;
+        std::atomic<int> next;
+    };
+}
\ No newline at end of file
@@ -1,9 +1,70 @@
 #include "font.h"
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <vector>
+#include <unordered_map>
 
 namespace gfx {
+    struct InternedFont {
+        // Key of the font in the registry
+        std::string key;
+
+        // Generation of the handle currently using the entry
+        uint32_t generation;
+
+        // Number of fonts using the entry, it is recycled once no font uses it
+        std::atomic<int> users;
+    };
+
+    struct FontRegistry {
+        std::mutex mtx;
+
+        // Entries never move so that fonts can keep a pointer to theirs
+        std::deque<InternedFont> entries;
+        std::unordered_map<std::string, uint32_t> ids;
+        std::vector<uint32_t> freeIds;
+    };
+
+    inline FontRegistry& getRegistry() {
+        // Created on first use so that fonts can be created during static initialization
+        static FontRegistry registry;
+        return registry;
+    }
+
+    inline std::string getFontKey(const std::string& name, int size) {
+        // Font names can contain any character except null
+        return name + '\0' + std::to_string(size);
+    }
+
     Font::Font(const std::string& name, int size) {
         this->name = name;
         this->size = size;
+        intern();
+    }
+
+    Font::Font(const Font& b) {
+        // Share the handle of the other font
+        name = b.name;
+        size = b.size;
+        handle = b.handle;
+        entry = b.entry;
+        entry->users++;
+    }
+
+    Font::~Font() {
+        release();
+    }
+
+    Font& Font::operator=(const Font& b) {
+        // Take a reference to the handle of the other font before releasing the current one, in case they're the same
+        b.entry->users++;
+        release();
+        name = b.name;
+        size = b.size;
+        handle = b.handle;
+        entry = b.entry;
+        return *this;
     }
 
     std::string Font::getName() const {
@@ -14,8 +75,9 @@ namespace gfx {
         // Update the name
         this->name = name;
 
-        // Reset the backend tag
-        backendTag.reset();
+        // Switch to the handle of the new name
+        release();
+        intern();
     }
 
     int Font::getSize() const {
@@ -26,7 +88,54 @@ namespace gfx {
         // Update the size
         this->size = size;
 
-        // Reset the backend tag
-        backendTag.reset();
+        // Switch to the handle of the new size
+        release();
+        intern();
+    }
+
+    void Font::intern() {
+        FontRegistry& reg = getRegistry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        std::string key = getFontKey(name, size);
+
+        // If the font is already interned, use its entry
+        auto it = reg.ids.find(key);
+        if (it != reg.ids.end()) {
+            entry = &reg.entries[it->second];
+            entry->users++;
+            handle = { it->second, entry->generation };
+            return;
+        }
+
+        // Otherwise, reuse a recycled entry or create a new one
+        uint32_t id;
+        if (!reg.freeIds.empty()) {
+            id = reg.freeIds.back();
+            reg.freeIds.pop_back();
+        }
+        else {
+            id = (uint32_t)reg.entries.size();
+            reg.entries.emplace_back();
+            reg.entries.back().generation = 0;
+        }
+        entry = &reg.entries[id];
+        entry->key = key;
+        entry->users = 1;
+        reg.ids[key] = id;
+        handle = { id, entry->generation };
+    }
+
+    void Font::release() {
+        // Nothing else to do if other fonts still use the entry
+        if (--entry->users > 0) { return; }
+
+        // Recycle the entry unless the font got interned again in the meantime, or the entry was already recycled
+        FontRegistry& reg = getRegistry();
+        std::lock_guard<std::mutex> lck(reg.mtx);
+        if (entry->users > 0 || entry->generation != handle.generation) { return; }
+        reg.ids.erase(entry->key);
+        entry->key.clear();
+        entry->generation++;
+        reg.freeIds.push_back(handle.id);
     }
 }
\ No newline at end of file
@@ -1,8 +1,33 @@
 #pragma once
+#include <stdint.h>
 #include <string>
-#include <any>
+#include <functional>
 
 namespace gfx {
+    struct InternedFont;
+
+    /**
+     * Interned identity of a font name and size. All fonts with the same name and size share the same handle.
+     * IDs are small and dense so that caches can index arrays with them. Once no font uses a handle anymore,
+     * its ID may be reused with a higher generation, so caches must check both to tell fonts apart.
+    */
+    struct FontHandle {
+        uint32_t id;
+        uint32_t generation;
+
+        bool operator==(const FontHandle& b) const {
+            return id == b.id && generation == b.generation;
+        }
+    };
+
+    /**
+     * Range of unicode codepoints, including both ends.
+    */
+    struct CodepointRange {
+        int first;
+        int last;
+    };
+
     class Font {
     public:
         /**
@@ -10,6 +35,15 @@ namespace gfx {
         */
         Font(const std::string& name, int size);
 
+        // Copy constructor
+        Font(const Font& b);
+
+        // Destructor
+        ~Font();
+
+        // Copy assignment
+        Font& operator=(const Font& b);
+
         /**
          * Get the name of the font.
          * @return Name of the font.
@@ -34,19 +68,26 @@ namespace gfx {
         */
         void setSize(int size);
 
-        bool operator==(const Font& b) const {
-            return size == b.size && name == b.name;
-        }
-
         /**
-         * For use only by the backend code.
+         * Get the interned handle of the font. It is only resolved when the name or size changes, so getting it is free
+         * and fonts can be used from any thread.
+         * @return Handle of the font.
         */
-        // TODO: Get rid of this shit. Doing per drawText call is fine... Terminals will have to be done some other way then tons of drawText calls
-        std::any backendTag;
+        FontHandle getHandle() const { return handle; }
+
+        bool operator==(const Font& b) const {
+            // Fonts are interned, so the handles are the same if and only if the names and sizes are
+            return handle == b.handle;
+        }
 
     private:
+        void intern();
+        void release();
+
         std::string name;
         int size;
+        FontHandle handle;
+        InternedFont* entry;
 
     };
 }
@@ -56,7 +97,7 @@ struct std::hash<gfx::Font>
 {
     std::size_t operator()(const gfx::Font& s) const noexcept
     {
-        std::size_t h1 = std::hash<std::string>{}(s.getName());
-        return h1 ^ (s.getSize() << 1);
+        gfx::FontHandle h = s.getHandle();
+        return std::hash<uint64_t>{}(((uint64_t)h.generation << 32) | h.id);
     }
 };
\ No newline at end of file
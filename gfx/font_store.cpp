@@ -0,0 +1,642 @@
+#include "font_store.h"
+#include "flog/flog.h"
+#include FT_MODULE_H
+#include FT_ADVANCES_H
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string.h>
+#include <stdio.h>
+
+namespace gfx {
+    inline bool isFontFile(const std::filesystem::path& path) {
+        // Compare the extension without case
+        std::string ext = path.extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        return ext == ".ttf" || ext == ".otf" || ext == ".ttc" || ext == ".otc";
+    }
+
+    inline std::unordered_map<std::string, std::vector<FontInfo>> readIndex(const std::string& path) {
+        // Open the index, it's fine if it doesn't exist yet
+        std::unordered_map<std::string, std::vector<FontInfo>> index;
+        std::ifstream file(path);
+        if (!file.is_open()) { return index; }
+
+        // Ignore indices of other versions
+        std::string line;
+        if (!std::getline(file, line) || line != "gfx-font-index " + std::to_string(GFX_FONT_INDEX_VERSION)) { return index; }
+
+        // Read one face per line, with tab-separated fields
+        while (std::getline(file, line)) {
+            std::vector<std::string> fields;
+            std::stringstream ss(line);
+            std::string field;
+            while (std::getline(ss, field, '\t')) { fields.push_back(field); }
+            if (fields.size() != 10) { continue; }
+
+            // Decode the fields
+            FontInfo info;
+            try {
+                info.path = fields[0];
+                info.faceIndex = std::stoi(fields[1]);
+                info.mtime = std::stoll(fields[2]);
+                info.fileSize = std::stoull(fields[3]);
+                info.family = fields[4];
+                info.style = fields[5];
+                for (int i = 0; i < 4; i++) { info.coverage[i] = std::stoull(fields[6 + i], NULL, 16); }
+            }
+            catch (const std::exception& e) {
+                continue;
+            }
+            index[info.path].push_back(info);
+        }
+
+        return index;
+    }
+
+    inline void writeIndex(const std::string& path, const std::vector<FontInfo>& faces) {
+        // Write to a temporary file of this process first so that a concurrent reader never sees a partial index,
+        // and processes scanning the same directory at once each replace it with a whole index of their own
+        std::string tmpPath = getTempPath(path);
+        std::ofstream file(tmpPath, std::ios::out | std::ios::trunc);
+        if (!file.is_open()) {
+            flog::warn("Could not write font index '{}'", path);
+            return;
+        }
+
+        // Write the version then one face per line
+        file << "gfx-font-index " << GFX_FONT_INDEX_VERSION << '\n';
+        for (const auto& f : faces) {
+            file << f.path << '\t' << f.faceIndex << '\t' << f.mtime << '\t' << f.fileSize << '\t' << f.family << '\t' << f.style << std::hex;
+            for (int i = 0; i < 4; i++) { file << '\t' << f.coverage[i]; }
+            file << std::dec << '\n';
+        }
+        file.close();
+
+        // Replace the index
+        std::error_code ec;
+        std::filesystem::rename(tmpPath, path, ec);
+        if (ec) {
+            flog::warn("Could not write font index '{}': {}", path, ec.message());
+            std::filesystem::remove(tmpPath, ec);
+        }
+    }
+
+    inline uint64_t hashContent(const uint8_t* data, size_t size) {
+        // Hash eight bytes at a time, font files can be large and only have to be told apart
+        uint64_t hash = 0xCBF29CE484222325ull ^ size;
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, &data[i], 8);
+            hash = (hash ^ word) * 0x100000001B3ull;
+            hash ^= hash >> 29;
+        }
+        for (; i < size; i++) {
+            hash = (hash ^ data[i]) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+    template <typename Key>
+    inline int freeUnusedGlyphs(std::unordered_map<Key, GlyphBitmap>& glyphs) {
+        // Glyphs no cache acquired yet are kept for a few purges, so that glyphs rasterized ahead of time survive until drawn
+        int freed = 0;
+        for (auto it = glyphs.begin(); it != glyphs.end();) {
+            GlyphBitmap& glyph = it->second;
+            bool unused = glyph.unclaimed ? ++glyph.unclaimedPurges > GFX_FONT_STORE_UNCLAIMED_PURGES : glyph.users <= 0;
+            if (unused) {
+                it = glyphs.erase(it);
+                freed++;
+            }
+            else {
+                it++;
+            }
+        }
+        return freed;
+    }
+
+    FontStore::FontStore() {
+        // Initialize FreeType
+        int err = FT_Init_FreeType(&library);
+        if (err) {
+            throw std::runtime_error("Could not initialize FreeType");
+        }
+
+        // Set how far from the outline distance fields reach, in pixels of the reference size
+        FT_Int spread = GFX_SDF_SPREAD;
+        FT_Property_Set(library, "sdf", "spread", &spread);
+    }
+
+    FontStore::~FontStore() {
+        // Stop the background threads first, they may still be handing over glyphs
+        rasterizer.reset();
+
+        // Keep the glyphs rasterized by this process for the next ones
+        saveGlyphCache();
+
+        // Destroy all faces
+        for (auto& [font, data] : fonts) {
+            if (data.face) { FT_Done_Face(data.face); }
+        }
+        for (auto& [name, face] : sdfFaces) {
+            if (face.face) { FT_Done_Face(face.face); }
+        }
+
+        // Shutdown FreeType
+        FT_Done_FreeType(library);
+    }
+
+    FontStore& FontStore::getInstance() {
+        static FontStore store;
+        return store;
+    }
+
+    void FontStore::loadFont(const std::string& path) {
+        // Map the font file
+        auto mapping = std::make_unique<MappedFile>(path);
+
+        // Describe its first face and make it available, unless a font with that name is already loaded
+        std::lock_guard<std::mutex> lck(mtx);
+        std::vector<FontInfo> faces;
+        describeFile(path, *mapping, faces);
+        std::error_code ec;
+        faces[0].mtime = (int64_t)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+        faces[0].fileSize = mapping->size();
+        addFont(faces[0], std::move(mapping));
+    }
+
+    void FontStore::loadFontDirectory(const std::string& dir, const std::string& indexPath) {
+        // Load the descriptions of the previous scan
+        std::unordered_map<std::string, std::vector<FontInfo>> index;
+        if (!indexPath.empty()) { index = readIndex(indexPath); }
+
+        // Go through all font files of the directory
+        std::lock_guard<std::mutex> lck(mtx);
+        std::vector<FontInfo> scanned;
+        int described = 0;
+        std::error_code ec;
+        std::filesystem::recursive_directory_iterator dirIt(dir, std::filesystem::directory_options::skip_permission_denied, ec);
+        for (; !ec && dirIt != std::filesystem::recursive_directory_iterator(); dirIt.increment(ec)) {
+            // Skip anything that isn't a font file, or that can't be inspected
+            const auto& entry = *dirIt;
+            std::error_code fec;
+            if (!entry.is_regular_file(fec) || !isFontFile(entry.path())) { continue; }
+            std::string path = entry.path().string();
+            int64_t mtime = (int64_t)entry.last_write_time(fec).time_since_epoch().count();
+            uint64_t fileSize = (uint64_t)entry.file_size(fec);
+            if (fec) { continue; }
+
+            // Reuse the descriptions of the file if it didn't change since the previous scan
+            std::vector<FontInfo> faces;
+            auto it = index.find(path);
+            if (it != index.end() && it->second[0].mtime == mtime && it->second[0].fileSize == fileSize) {
+                faces = it->second;
+            }
+            else {
+                // Otherwise, parse the file to describe its faces
+                try {
+                    MappedFile mapping(path);
+                    describeFile(path, mapping, faces);
+                }
+                catch (const std::exception& e) {
+                    flog::warn("Could not describe font file '{}': {}", path, e.what());
+                    continue;
+                }
+                for (auto& face : faces) {
+                    face.mtime = mtime;
+                    face.fileSize = fileSize;
+                }
+                described++;
+            }
+
+            // Make the faces available
+            for (const auto& face : faces) {
+                addFont(face, NULL);
+                scanned.push_back(face);
+            }
+        }
+        if (ec) { flog::warn("Could not scan font directory '{}': {}", dir, ec.message()); }
+        flog::debug("Scanned font directory '{}': {} faces, {} files parsed", dir, scanned.size(), described);
+
+        // Save the descriptions if any changed, or if files were removed
+        int indexed = 0;
+        for (const auto& [path, faces] : index) { indexed += (int)faces.size(); }
+        if (!indexPath.empty() && (described || indexed != (int)scanned.size())) { writeIndex(indexPath, scanned); }
+    }
+
+    std::vector<FontInfo> FontStore::getFontInfo() {
+        std::lock_guard<std::mutex> lck(mtx);
+        std::vector<FontInfo> infos;
+        for (const auto& [name, file] : fontFiles) {
+            infos.push_back(file.info);
+        }
+        return infos;
+    }
+
+    StoredFont* FontStore::getFont(const std::string& name, int size) {
+        // If the font is already stored, return it
+        std::lock_guard<std::mutex> lck(mtx);
+        std::string key = name + '\0' + std::to_string(size);
+        auto it = fonts.find(key);
+        if (it != fonts.end()) { return &it->second; }
+
+        // Open the face at the size of the font
+        FT_Face face = openFace(name, size);
+
+        // Add the font to the store
+        StoredFont& data = fonts[key];
+        data.name = name;
+        data.size = size;
+        data.metrics = {
+            (float)face->size->metrics.ascender / (float)(1 << 6),
+            (float)face->size->metrics.descender / (float)(1 << 6)
+        };
+        data.unitScale = (float)face->size->metrics.x_scale / (float)(1 << 22);
+        data.face = face;
+        return &data;
+    }
+
+    const GlyphBitmap& FontStore::acquireGlyph(StoredFont* font, int glyphId, int alignment) {
+        // If the glyph is already rasterized, use it. Otherwise wait for the face if another thread is rasterizing with it,
+        // that thread may even be rasterizing this glyph.
+        std::unique_lock<std::mutex> lck(mtx);
+        GlyphDescriptor desc = (glyphId << 2) | alignment;
+        while (true) {
+            GlyphBitmap* found = findGlyph(font, desc);
+            if (found) {
+                found->users++;
+                found->unclaimed = false;
+                return *found;
+            }
+            if (!font->rasterizing) { break; }
+            faceReleased.wait(lck);
+        }
+
+        // Reopen the face if it was released
+        if (!font->face) { font->face = openFace(font->name, font->size); }
+
+        // Render the glyph without holding the store so that other fonts aren't held up, the face is reserved meanwhile
+        FT_Face ftFace = font->face;
+        font->rasterizing = true;
+        lck.unlock();
+        GlyphBitmap glyph;
+        glyph.users = 0;
+        rasterizeGlyph(ftFace, glyphId, alignment, glyph);
+        lck.lock();
+        font->rasterizing = false;
+        faceReleased.notify_all();
+
+        // Add it, unless a background thread finished it in the meantime
+        auto [it, added] = font->glyphs.try_emplace(desc, std::move(glyph));
+        if (added && font->cacheFile) { font->cacheFile->add(desc, it->second); }
+        it->second.users++;
+        it->second.unclaimed = false;
+        return it->second;
+    }
+
+    void FontStore::releaseGlyph(StoredFont* font, int glyphId, int alignment) {
+        std::lock_guard<std::mutex> lck(mtx);
+        font->glyphs[(glyphId << 2) | alignment].users--;
+    }
+
+    const GlyphBitmap& FontStore::acquireSDFGlyph(const std::string& name, int glyphId) {
+        // If the distance field is already rasterized, use it. Otherwise wait for the face if another thread is rasterizing with it.
+        std::unique_lock<std::mutex> lck(mtx);
+        StoredSDFFace& face = sdfFaces[name];
+        while (true) {
+            GlyphBitmap* found = findSDFGlyph(name, face, glyphId);
+            if (found) {
+                found->users++;
+                found->unclaimed = false;
+                return *found;
+            }
+            if (!face.rasterizing) { break; }
+            faceReleased.wait(lck);
+        }
+
+        // Open the face at the reference size that all sizes are scaled from, if not already open
+        if (!face.face) { face.face = openFace(name, GFX_SDF_SIZE); }
+
+        // Render the distance field without holding the store, the face is reserved meanwhile
+        FT_Face ftFace = face.face;
+        face.rasterizing = true;
+        lck.unlock();
+        GlyphBitmap glyph;
+        glyph.users = 0;
+        rasterizeSDFGlyph(ftFace, glyphId, glyph);
+        lck.lock();
+        face.rasterizing = false;
+        faceReleased.notify_all();
+
+        // Add it, unless a background thread finished it in the meantime
+        auto [it, added] = face.glyphs.try_emplace(glyphId, std::move(glyph));
+        if (added && face.cacheFile) { face.cacheFile->add(glyphId, it->second); }
+        it->second.users++;
+        it->second.unclaimed = false;
+        return it->second;
+    }
+
+    void FontStore::releaseSDFGlyph(const std::string& name, int glyphId) {
+        std::lock_guard<std::mutex> lck(mtx);
+        sdfFaces[name].glyphs[glyphId].users--;
+    }
+
+    const GlyphBitmap* FontStore::tryAcquireGlyph(StoredFont* font, int glyphId, int alignment) {
+        // If the glyph is already rasterized, use it
+        std::lock_guard<std::mutex> lck(mtx);
+        GlyphDescriptor desc = (glyphId << 2) | alignment;
+        GlyphBitmap* found = findGlyph(font, desc);
+        if (found) {
+            found->users++;
+            found->unclaimed = false;
+            return found;
+        }
+
+        // Otherwise have it rasterized in the background
+        queueGlyph(font, desc);
+        return NULL;
+    }
+
+    const GlyphBitmap* FontStore::tryAcquireSDFGlyph(const std::string& name, int glyphId) {
+        // If the distance field is already rasterized, use it
+        std::lock_guard<std::mutex> lck(mtx);
+        StoredSDFFace& face = sdfFaces[name];
+        GlyphBitmap* found = findSDFGlyph(name, face, glyphId);
+        if (found) {
+            found->users++;
+            found->unclaimed = false;
+            return found;
+        }
+
+        // Otherwise have it rasterized in the background
+        queueSDFGlyph(name, face, glyphId);
+        return NULL;
+    }
+
+    void FontStore::requestGlyph(StoredFont* font, int glyphId, int alignment) {
+        std::lock_guard<std::mutex> lck(mtx);
+        queueGlyph(font, (glyphId << 2) | alignment);
+    }
+
+    void FontStore::requestSDFGlyph(const std::string& name, int glyphId) {
+        std::lock_guard<std::mutex> lck(mtx);
+        queueSDFGlyph(name, sdfFaces[name], glyphId);
+    }
+
+    float FontStore::getAdvance(StoredFont* font, int glyphId) {
+        // Wait for the face to be free, then reopen it if it was released
+        std::unique_lock<std::mutex> lck(mtx);
+        faceReleased.wait(lck, [font]() { return !font->rasterizing; });
+        if (!font->face) { font->face = openFace(font->name, font->size); }
+
+        // The unhinted advance is the linear advance of the rasterized glyph, and only needs the metrics tables
+        FT_Fixed advance;
+        if (FT_Get_Advance(font->face, FT_Get_Char_Index(font->face, glyphId), FT_LOAD_NO_HINTING, &advance)) { return 0.0f; }
+        return (float)advance * (1.0f / (float)(1 << 16));
+    }
+
+    float FontStore::getSDFAdvance(const std::string& name, int glyphId) {
+        // Wait for the face to be free, then open it at the reference size if not already open
+        std::unique_lock<std::mutex> lck(mtx);
+        StoredSDFFace& face = sdfFaces[name];
+        faceReleased.wait(lck, [&face]() { return !face.rasterizing; });
+        if (!face.face) { face.face = openFace(name, GFX_SDF_SIZE); }
+
+        // Get the unhinted advance
+        FT_Fixed advance;
+        if (FT_Get_Advance(face.face, FT_Get_Char_Index(face.face, glyphId), FT_LOAD_NO_HINTING, &advance)) { return 0.0f; }
+        return (float)advance * (1.0f / (float)(1 << 16));
+    }
+
+    const KerningTable* FontStore::getKerningTable(StoredFont* font) {
+        // If the pairs of the face are already loaded, return them
+        std::unique_lock<std::mutex> lck(mtx);
+        std::unique_ptr<KerningTable>& table = kerningTables[font->name];
+        if (table) { return table.get(); }
+
+        // Wait for the face to be free, another thread may have loaded the pairs meanwhile. Then reopen it if it was released.
+        faceReleased.wait(lck, [font]() { return !font->rasterizing; });
+        if (table) { return table.get(); }
+        if (!font->face) { font->face = openFace(font->name, font->size); }
+
+        // Load the pairs
+        table = std::make_unique<KerningTable>(font->face);
+        return table.get();
+    }
+
+    void FontStore::purge() {
+        std::lock_guard<std::mutex> lck(mtx);
+        int freed = 0;
+
+        // Free the unused glyphs of each font, then its face if it has no glyphs left.
+        // The font itself is kept since its pointer is handed out.
+        for (auto& [key, font] : fonts) {
+            freed += freeUnusedGlyphs(font.glyphs);
+            if (font.face && font.glyphs.empty() && !font.rasterizing) {
+                FT_Done_Face(font.face);
+                font.face = NULL;
+            }
+        }
+
+        // Same for the distance fields
+        for (auto& [name, face] : sdfFaces) {
+            freed += freeUnusedGlyphs(face.glyphs);
+            if (face.face && face.glyphs.empty() && !face.rasterizing) {
+                FT_Done_Face(face.face);
+                face.face = NULL;
+            }
+        }
+
+        if (freed) { flog::debug("Freed {} glyphs from the font store", freed); }
+    }
+
+    void FontStore::setGlyphCacheDirectory(const std::string& dir) {
+        // Save the glyphs of the previous directory
+        saveGlyphCache();
+
+        // Forget its files, fonts look them up again when they next need a glyph
+        std::lock_guard<std::mutex> lck(mtx);
+        glyphCacheDir = dir;
+        for (auto& [key, font] : fonts) { font.cacheFile = NULL; }
+        for (auto& [name, face] : sdfFaces) { face.cacheFile = NULL; }
+        glyphCacheFiles.clear();
+    }
+
+    void FontStore::saveGlyphCache() {
+        // Write the files that have new glyphs
+        std::lock_guard<std::mutex> lck(mtx);
+        for (auto& [path, file] : glyphCacheFiles) { file->save(); }
+    }
+
+    FontFile& FontStore::getFontFile(const std::string& name) {
+        // Get the font and throw an error if not available
+        auto it = fontFiles.find(name);
+        if (it == fontFiles.end()) {
+            throw std::runtime_error("The requested font is not loaded");
+        }
+        FontFile& file = it->second;
+
+        // Map the file if this is the first face opened from it
+        if (!file.mapping) { file.mapping = std::make_unique<MappedFile>(file.info.path); }
+        return file;
+    }
+
+    FT_Face FontStore::openFace(const std::string& name, int size) {
+        // Load font data into Freetype
+        FontFile& file = getFontFile(name);
+        FT_Face face;
+        if (FT_New_Memory_Face(library, file.mapping->data(), file.mapping->size(), file.info.faceIndex, &face)) {
+            throw std::runtime_error("Could not parse font file");
+        }
+
+        // Set font size
+        FT_Set_Pixel_Sizes(face, 0, size);
+        return face;
+    }
+
+    GlyphCacheFile* FontStore::getGlyphCacheFile(const std::string& name, int size, bool distanceField) {
+        // Hash the content of the font file once, so that its glyphs are found wherever the file is
+        FontFile& file = getFontFile(name);
+        if (!file.hash) { file.hash = hashContent(file.mapping->data(), file.mapping->size()); }
+
+        // Get the file of the face at that size, mapping it if this is the first time
+        char filename[64];
+        snprintf(filename, sizeof(filename), "%016llx-%d-%s%d.glyphs", (unsigned long long)file.hash, file.info.faceIndex, distanceField ? "sdf" : "", size);
+        std::string path = (std::filesystem::path(glyphCacheDir) / filename).string();
+        std::unique_ptr<GlyphCacheFile>& cache = glyphCacheFiles[path];
+        if (!cache) { cache = std::make_unique<GlyphCacheFile>(path, distanceField ? GFX_SDF_SPREAD : 0); }
+        return cache.get();
+    }
+
+    GlyphBitmap* FontStore::findGlyph(StoredFont* font, GlyphDescriptor desc) {
+        // Search the rasterized glyphs
+        auto it = font->glyphs.find(desc);
+        if (it != font->glyphs.end()) { return &it->second; }
+
+        // Then the glyph cache, if there is one
+        if (glyphCacheDir.empty()) { return NULL; }
+        if (!font->cacheFile) { font->cacheFile = getGlyphCacheFile(font->name, font->size, false); }
+        GlyphBitmap glyph;
+        if (!font->cacheFile->load(desc, glyph)) { return NULL; }
+
+        // Keep it until acquired, like the glyphs rasterized in the background
+        glyph.users = 0;
+        glyph.unclaimed = true;
+        return &font->glyphs.emplace(desc, std::move(glyph)).first->second;
+    }
+
+    GlyphBitmap* FontStore::findSDFGlyph(const std::string& name, StoredSDFFace& face, int glyphId) {
+        // Search the rasterized distance fields
+        auto it = face.glyphs.find(glyphId);
+        if (it != face.glyphs.end()) { return &it->second; }
+
+        // Then the glyph cache, if there is one
+        if (glyphCacheDir.empty()) { return NULL; }
+        if (!face.cacheFile) { face.cacheFile = getGlyphCacheFile(name, GFX_SDF_SIZE, true); }
+        GlyphBitmap glyph;
+        if (!face.cacheFile->load(glyphId, glyph)) { return NULL; }
+
+        // Keep it until acquired, like the distance fields rasterized in the background
+        glyph.users = 0;
+        glyph.unclaimed = true;
+        return &face.glyphs.emplace(glyphId, std::move(glyph)).first->second;
+    }
+
+    GlyphRasterizer& FontStore::getRasterizer() {
+        // Start the threads on the first request, leaving a core to the threads drawing
+        if (!rasterizer) {
+            int threads = std::clamp<int>((int)std::thread::hardware_concurrency() - 1, 1, GFX_GLYPH_RASTERIZER_THREADS);
+            rasterizer = std::make_unique<GlyphRasterizer>(threads, [this](const GlyphJob& job, GlyphBitmap& glyph) { finishGlyph(job, glyph); });
+        }
+        return *rasterizer;
+    }
+
+    void FontStore::queueGlyph(StoredFont* font, GlyphDescriptor desc) {
+        // Nothing to do if the glyph is already rasterized or queued
+        if (findGlyph(font, desc) || !font->queued.insert(desc).second) { return; }
+
+        // Queue the glyph, the threads open their own faces from the mapped file
+        FontFile& file = getFontFile(font->name);
+        getRasterizer().submit({ file.mapping->data(), file.mapping->size(), file.info.faceIndex, font->size, (int)(desc >> 2), (int)(desc & 0b11), false, font });
+    }
+
+    void FontStore::queueSDFGlyph(const std::string& name, StoredSDFFace& face, int glyphId) {
+        // Nothing to do if the distance field is already rasterized or queued
+        if (findSDFGlyph(name, face, glyphId) || !face.queued.insert(glyphId).second) { return; }
+
+        // Queue the distance field at the reference size
+        FontFile& file = getFontFile(name);
+        getRasterizer().submit({ file.mapping->data(), file.mapping->size(), file.info.faceIndex, GFX_SDF_SIZE, glyphId, 0, true, &face });
+    }
+
+    void FontStore::finishGlyph(const GlyphJob& job, GlyphBitmap& glyph) {
+        // Keep the glyph until a cache acquires it
+        std::lock_guard<std::mutex> lck(mtx);
+        glyph.users = 0;
+        glyph.unclaimed = true;
+
+        // Add it unless it was rasterized on the drawing thread in the meantime
+        if (job.distanceField) {
+            StoredSDFFace* face = (StoredSDFFace*)job.target;
+            face->queued.erase(job.glyphId);
+            if (face->cacheFile) { face->cacheFile->add(job.glyphId, glyph); }
+            face->glyphs.try_emplace(job.glyphId, std::move(glyph));
+        }
+        else {
+            StoredFont* font = (StoredFont*)job.target;
+            GlyphDescriptor desc = (job.glyphId << 2) | job.alignment;
+            font->queued.erase(desc);
+            if (font->cacheFile) { font->cacheFile->add(desc, glyph); }
+            font->glyphs.try_emplace(desc, std::move(glyph));
+        }
+    }
+
+    void FontStore::describeFile(const std::string& path, const MappedFile& file, std::vector<FontInfo>& faces) {
+        // Describe every face of the file, collections have more than one
+        int faceCount = 1;
+        for (int i = 0; i < faceCount; i++) {
+            // Load the face into Freetype
+            FT_Face face;
+            if (FT_New_Memory_Face(library, file.data(), file.size(), i, &face)) {
+                if (!i) { throw std::runtime_error("Could not parse font file"); }
+                continue;
+            }
+            faceCount = face->num_faces;
+
+            // Get its names
+            FontInfo info = {};
+            info.path = path;
+            info.faceIndex = i;
+            info.family = face->family_name ? face->family_name : "";
+            info.style = face->style_name ? face->style_name : "";
+
+            // Summarize which codepoints it has glyphs for
+            FT_UInt glyphIndex;
+            FT_ULong code = FT_Get_First_Char(face, &glyphIndex);
+            while (glyphIndex) {
+                int page = std::min<int>(code >> 8, 255);
+                info.coverage[page >> 6] |= 1ull << (page & 63);
+                code = FT_Get_Next_Char(face, code, &glyphIndex);
+            }
+
+            // Destroy freetype data
+            FT_Done_Face(face);
+            faces.push_back(info);
+        }
+    }
+
+    bool FontStore::addFont(const FontInfo& info, std::unique_ptr<MappedFile> mapping) {
+        // Make sure a font with that name is not already loaded
+        std::string name = info.family + ' ' + info.style;
+        if (fontFiles.find(name) != fontFiles.end()) { return false; }
+        flog::debug("Loaded font: '{}'", name);
+
+        // Create an entry in the file list
+        FontFile& file = fontFiles[name];
+        file.info = info;
+        file.mapping = std::move(mapping);
+        return true;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,301 @@
+#pragma once
+#include "types.h"
+#include "font.h"
+#include "mapped_file.h"
+#include "kerning_table.h"
+#include "glyph_rasterizer.h"
+#include "glyph_cache_file.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// Reference size in pixels at which distance fields are rasterized, and how far from the outline they reach
+#define GFX_SDF_SIZE    32
+#define GFX_SDF_SPREAD  4
+
+// Number of purges that glyphs rasterized ahead of time survive without being acquired by any cache
+#define GFX_FONT_STORE_UNCLAIMED_PURGES 16
+
+// Version of the format of font index files, older indices are ignored
+#define GFX_FONT_INDEX_VERSION  1
+
+namespace gfx {
+    struct FontInfo {
+        // Location of the face and state of its file when it was described
+        std::string path;
+        int faceIndex;
+        int64_t mtime;
+        uint64_t fileSize;
+
+        // Names of the face
+        std::string family;
+        std::string style;
+
+        // Bit N is set if the face has glyphs between codepoints N*256 and N*256+255. Codepoints past the BMP all use the last bit.
+        uint64_t coverage[4];
+
+        /**
+         * Check if the face might have a glyph for a codepoint, using the coverage summary.
+         * @param codepoint Unicode codepoint.
+         * @return False if the face has no glyph for the codepoint, true if it might have one.
+        */
+        bool mayContain(int codepoint) const {
+            int page = std::min<int>(codepoint >> 8, 255);
+            return (coverage[page >> 6] >> (page & 63)) & 1;
+        }
+    };
+
+    struct FontFile {
+        // Description of the face
+        FontInfo info;
+
+        // Read-only mapping of the file, only created once a face is opened
+        std::unique_ptr<MappedFile> mapping;
+
+        // Hash of the content of the file, zero until the glyph cache needs it
+        uint64_t hash = 0;
+    };
+
+    struct FontMetrics {
+        float ascender;
+        float descender;
+    };
+
+    typedef uint32_t GlyphDescriptor;
+
+    struct StoredFont {
+        std::string name;
+        int size;
+        FontMetrics metrics;
+
+        // Horizontal size of a font unit in pixels, to scale kerning
+        float unitScale;
+
+        // Face set to the size of the font, NULL while the font has no glyphs
+        FT_Face face;
+
+        // Whether a thread is rasterizing a glyph with the face without holding the store, no other thread may use it meanwhile
+        bool rasterizing = false;
+
+        // Glyphs by descriptor
+        std::unordered_map<GlyphDescriptor, GlyphBitmap> glyphs;
+
+        // Glyphs being rasterized in the background
+        std::unordered_set<GlyphDescriptor> queued;
+
+        // File of the glyph cache holding the glyphs of the font, NULL until first needed
+        GlyphCacheFile* cacheFile = NULL;
+    };
+
+    struct StoredSDFFace {
+        // Face set to GFX_SDF_SIZE, NULL while the face has no glyphs
+        FT_Face face;
+
+        // Whether a thread is rasterizing a distance field with the face without holding the store
+        bool rasterizing = false;
+
+        // Distance fields by unicode ID
+        std::unordered_map<int, GlyphBitmap> glyphs;
+
+        // Distance fields being rasterized in the background
+        std::unordered_set<int> queued;
+
+        // File of the glyph cache holding the distance fields of the face, NULL until first needed
+        GlyphCacheFile* cacheFile = NULL;
+    };
+
+    /**
+     * Process-wide store of font files, faces and rasterized glyphs, shared by the font caches of all painters.
+     * It doesn't depend on any graphics context, the caches only keep the glyphs in the form their backend draws them.
+     * All methods are thread safe. Returned glyphs stay valid until they are released.
+    */
+    class FontStore {
+    public:
+        // Destructor
+        ~FontStore();
+
+        /**
+         * Get the store of the process.
+         * @return Font store.
+        */
+        static FontStore& getInstance();
+
+        /**
+         * Load a font from file. The file is mapped read-only rather than read. Loading a font with the same name again does nothing.
+         * @param path Path to the font file.
+        */
+        void loadFont(const std::string& path);
+
+        /**
+         * Make all fonts of a directory and its subdirectories available. Files are only mapped once one of their faces is used.
+         * Describing a face requires parsing its file, so descriptions are kept in an index file and reused as long as the file is unchanged.
+         * @param dir Directory to scan.
+         * @param indexPath Path of the index file of the directory, which is created or updated as needed. Empty to not use an index.
+        */
+        void loadFontDirectory(const std::string& dir, const std::string& indexPath = "");
+
+        /**
+         * Get the description of all loaded fonts.
+         * @return Description of the fonts.
+        */
+        std::vector<FontInfo> getFontInfo();
+
+        /**
+         * Get a font by name and size. The returned pointer stays valid for as long as the store exists.
+         * @param name Name of the font.
+         * @param size Size of the font in pixels.
+         * @return Stored font.
+        */
+        StoredFont* getFont(const std::string& name, int size);
+
+        /**
+         * Get the rasterized glyph of a font, rasterizing it if necessary. Must be released once no longer used.
+         * @param font Font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+         * @param alignment Sub-pixel alignement, in quarter pixels. Must be between 0 and 3 inclusive.
+         * @return Rasterized glyph.
+        */
+        const GlyphBitmap& acquireGlyph(StoredFont* font, int glyphId, int alignment);
+
+        /**
+         * Release a glyph acquired with acquireGlyph().
+         * @param font Font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+         * @param alignment Sub-pixel alignement of the glyph.
+        */
+        void releaseGlyph(StoredFont* font, int glyphId, int alignment);
+
+        /**
+         * Get the distance field of a glyph at GFX_SDF_SIZE, rasterizing it if necessary. Must be released once no longer used.
+         * Glyphs without an outline, like spaces, are empty.
+         * @param name Name of the font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+         * @return Distance field of the glyph.
+        */
+        const GlyphBitmap& acquireSDFGlyph(const std::string& name, int glyphId);
+
+        /**
+         * Release a distance field acquired with acquireSDFGlyph().
+         * @param name Name of the font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+        */
+        void releaseSDFGlyph(const std::string& name, int glyphId);
+
+        /**
+         * Get the rasterized glyph of a font without rasterizing it on the calling thread. If it isn't rasterized yet, it is queued
+         * to be rasterized in the background and NULL is returned, in which case it should be requested again later.
+         * A returned glyph must be released once no longer used.
+         * @param font Font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+         * @param alignment Sub-pixel alignement, in quarter pixels. Must be between 0 and 3 inclusive.
+         * @return Rasterized glyph, or NULL if it isn't ready.
+        */
+        const GlyphBitmap* tryAcquireGlyph(StoredFont* font, int glyphId, int alignment);
+
+        /**
+         * Get the distance field of a glyph without rasterizing it on the calling thread, see tryAcquireGlyph().
+         * @param name Name of the font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+         * @return Distance field of the glyph, or NULL if it isn't ready.
+        */
+        const GlyphBitmap* tryAcquireSDFGlyph(const std::string& name, int glyphId);
+
+        /**
+         * Have a glyph rasterized in the background so that acquiring it later doesn't have to. Does nothing if it already is.
+         * Glyphs rasterized this way are kept until acquired at least once.
+         * @param font Font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+         * @param alignment Sub-pixel alignement, in quarter pixels. Must be between 0 and 3 inclusive.
+        */
+        void requestGlyph(StoredFont* font, int glyphId, int alignment);
+
+        /**
+         * Have the distance field of a glyph rasterized in the background, see requestGlyph().
+         * @param name Name of the font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+        */
+        void requestSDFGlyph(const std::string& name, int glyphId);
+
+        /**
+         * Get the advance of a glyph without rasterizing it. Matches the advance of the rasterized glyph.
+         * @param font Font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+         * @return Advance in pixels.
+        */
+        float getAdvance(StoredFont* font, int glyphId);
+
+        /**
+         * Get the advance of a glyph at GFX_SDF_SIZE without rasterizing its distance field.
+         * @param name Name of the font to which the glyph belongs.
+         * @param glyphId Unicode ID of the glyph.
+         * @return Advance in pixels of the reference size.
+        */
+        float getSDFAdvance(const std::string& name, int glyphId);
+
+        /**
+         * Get the kerning pairs of the face of a font, loading them on first use. The table is shared by all sizes of the face
+         * and stays valid for as long as the store exists. Since it never changes, it can be read without locking.
+         * @param font Font to get the kerning pairs of.
+         * @return Kerning pairs in font units, to be scaled by the unit scale of the font.
+        */
+        const KerningTable* getKerningTable(StoredFont* font);
+
+        /**
+         * Free the glyphs no longer used by any cache, and the faces left without glyphs.
+        */
+        void purge();
+
+        /**
+         * Keep rasterized glyphs in files of a directory, so that the next processes read them instead of rasterizing them again.
+         * There is a file per font file content, face and size, which is mapped when the font first needs a glyph.
+         * Glyphs rasterized before the directory is set aren't saved.
+         * @param dir Directory of the cache, created on the first save. Empty to not use a cache.
+        */
+        void setGlyphCacheDirectory(const std::string& dir);
+
+        /**
+         * Write the glyphs rasterized since the glyph cache was last written. Also done when the store is destroyed.
+        */
+        void saveGlyphCache();
+
+    private:
+        FontStore();
+        FontFile& getFontFile(const std::string& name);
+        FT_Face openFace(const std::string& name, int size);
+        GlyphCacheFile* getGlyphCacheFile(const std::string& name, int size, bool distanceField);
+        GlyphBitmap* findGlyph(StoredFont* font, GlyphDescriptor desc);
+        GlyphBitmap* findSDFGlyph(const std::string& name, StoredSDFFace& face, int glyphId);
+        GlyphRasterizer& getRasterizer();
+        void queueGlyph(StoredFont* font, GlyphDescriptor desc);
+        void queueSDFGlyph(const std::string& name, StoredSDFFace& face, int glyphId);
+        void finishGlyph(const GlyphJob& job, GlyphBitmap& glyph);
+        void describeFile(const std::string& path, const MappedFile& file, std::vector<FontInfo>& faces);
+        bool addFont(const FontInfo& info, std::unique_ptr<MappedFile> mapping);
+
+        std::mutex mtx;
+        // Signaled when a thread is done rasterizing with a face
+        std::condition_variable faceReleased;
+        std::unordered_map<std::string, FontFile> fontFiles;
+        // Fonts by name and size, not by handle since the store outlives all handles
+        std::unordered_map<std::string, StoredFont> fonts;
+        std::unordered_map<std::string, StoredSDFFace> sdfFaces;
+        std::unordered_map<std::string, std::unique_ptr<KerningTable>> kerningTables;
+
+        FT_Library library;
+
+        // Threads rasterizing the requested glyphs, started on the first request
+        std::unique_ptr<GlyphRasterizer> rasterizer;
+
+        // Files of the glyph cache by path, empty directory if there is no cache
+        std::string glyphCacheDir;
+        std::unordered_map<std::string, std::unique_ptr<GlyphCacheFile>> glyphCacheFiles;
+    };
+}
\ No newline at end of file
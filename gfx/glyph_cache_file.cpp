@@ -0,0 +1,185 @@
+#include "glyph_cache_file.h"
+#include "flog/flog.h"
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <algorithm>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace gfx {
+    GlyphCacheFile::GlyphCacheFile(const std::string& path, int sdfSpread) : path(path), sdfSpread(sdfSpread) {
+        map();
+    }
+
+    bool GlyphCacheFile::load(uint32_t desc, GlyphBitmap& glyph) const {
+        // Glyphs added since the file was mapped aren't in it yet
+        auto it = added.find(desc);
+        if (it != added.end()) {
+            glyph.size = it->second.size;
+            glyph.offset = it->second.offset;
+            glyph.bitmap = it->second.bitmap;
+            glyph.xAdvance = it->second.xAdvance;
+            return true;
+        }
+
+        // Search the file, and check that the bitmap is all there
+        const GlyphCacheEntry* entry = find(desc);
+        if (!entry || entry->width < 0 || entry->height < 0) { return false; }
+        size_t bytes = (size_t)entry->width * (size_t)entry->height;
+        if ((size_t)entry->offset + bytes > dataSize) { return false; }
+
+        // Copy the glyph
+        glyph.size = Sizei(entry->width, entry->height);
+        glyph.offset = Vec2i(entry->left, entry->top);
+        glyph.bitmap.assign(data + entry->offset, data + entry->offset + bytes);
+        glyph.xAdvance = entry->xAdvance;
+        return true;
+    }
+
+    void GlyphCacheFile::add(uint32_t desc, const GlyphBitmap& glyph) {
+        // Nothing to do if the file already has the glyph
+        if (find(desc)) { return; }
+
+        // Glyphs too large for the entries are rasterized again every time
+        if (glyph.size.x > SHRT_MAX || glyph.size.y > SHRT_MAX || abs(glyph.offset.x) > SHRT_MAX || abs(glyph.offset.y) > SHRT_MAX) { return; }
+
+        added.try_emplace(desc, glyph);
+    }
+
+    bool GlyphCacheFile::save() {
+        // Nothing to do if the file is up to date
+        if (added.empty()) { return true; }
+
+        // Merge the glyphs of the file with the added ones, both are sorted by descriptor
+        std::vector<GlyphCacheEntry> outEntries;
+        std::vector<uint8_t> outData;
+        outEntries.reserve(count + added.size());
+        auto it = added.begin();
+        uint32_t i = 0;
+        while (i < count || it != added.end()) {
+            if (it == added.end() || (i < count && entries[i].desc < it->first)) {
+                // Copy the glyph of the file, unless its bitmap isn't all there
+                GlyphCacheEntry entry = entries[i++];
+                if (entry.width < 0 || entry.height < 0) { continue; }
+                size_t bytes = (size_t)entry.width * (size_t)entry.height;
+                if ((size_t)entry.offset + bytes > dataSize) { continue; }
+                const uint8_t* bitmap = data + entry.offset;
+                entry.offset = (uint32_t)outData.size();
+                outData.insert(outData.end(), bitmap, bitmap + bytes);
+                outEntries.push_back(entry);
+            }
+            else {
+                // Add the new glyph, it replaces any glyph of the file with the same descriptor
+                if (i < count && entries[i].desc == it->first) { i++; }
+                const GlyphBitmap& glyph = it->second;
+                GlyphCacheEntry entry = {
+                    it->first,
+                    (int16_t)glyph.size.x,
+                    (int16_t)glyph.size.y,
+                    (int16_t)glyph.offset.x,
+                    (int16_t)glyph.offset.y,
+                    glyph.xAdvance,
+                    (uint32_t)outData.size()
+                };
+                outData.insert(outData.end(), glyph.bitmap.begin(), glyph.bitmap.end());
+                outEntries.push_back(entry);
+                it++;
+            }
+        }
+
+        // Write to a temporary file of this process first so that a concurrent reader never sees a partial file,
+        // and processes saving the same file at once each replace it with a whole file of their own
+        GlyphCacheHeader header = {
+            { 'G', 'F', 'X', 'G' },
+            GFX_GLYPH_CACHE_VERSION,
+            FREETYPE_MAJOR << 16 | FREETYPE_MINOR << 8 | FREETYPE_PATCH,
+            (uint32_t)sdfSpread,
+            (uint32_t)outEntries.size(),
+            (uint32_t)outData.size()
+        };
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+        std::string tmpPath = getTempPath(path);
+        std::ofstream file(tmpPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write((const char*)outEntries.data(), outEntries.size() * sizeof(GlyphCacheEntry));
+        file.write((const char*)outData.data(), outData.size());
+        file.close();
+        if (!file) {
+            flog::warn("Could not write glyph cache '{}'", path);
+            std::filesystem::remove(tmpPath, ec);
+            return false;
+        }
+
+        // Unmap the file before replacing it, some systems can't replace a mapped file
+        mapping.reset();
+        std::filesystem::rename(tmpPath, path, ec);
+        if (ec) {
+            flog::warn("Could not write glyph cache '{}': {}", path, ec.message());
+            std::filesystem::remove(tmpPath, ec);
+            map();
+            return false;
+        }
+
+        // Map the new file, the added glyphs are now part of it
+        flog::debug("Saved {} glyphs to glyph cache '{}'", outEntries.size(), path);
+        added.clear();
+        map();
+        return true;
+    }
+
+    void GlyphCacheFile::map() {
+        // Start out empty
+        mapping.reset();
+        entries = NULL;
+        count = 0;
+        data = NULL;
+        dataSize = 0;
+
+        // Nothing to map if the file wasn't written yet
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec)) { return; }
+        std::unique_ptr<MappedFile> file;
+        try {
+            file = std::make_unique<MappedFile>(path);
+        }
+        catch (const std::exception& e) {
+            flog::warn("Could not map glyph cache '{}': {}", path, e.what());
+            return;
+        }
+
+        // Ignore files of other formats or rasterized by another version of FreeType, the next save overwrites them
+        GlyphCacheHeader header;
+        if (file->size() < sizeof(header)) { return; }
+        memcpy(&header, file->data(), sizeof(header));
+        uint32_t freetypeVersion = FREETYPE_MAJOR << 16 | FREETYPE_MINOR << 8 | FREETYPE_PATCH;
+        if (memcmp(header.magic, "GFXG", 4) || header.version != GFX_GLYPH_CACHE_VERSION ||
+            header.freetypeVersion != freetypeVersion || header.sdfSpread != (uint32_t)sdfSpread) {
+            flog::debug("Ignoring outdated glyph cache '{}'", path);
+            return;
+        }
+
+        // Check that the entries and bitmaps are all there
+        size_t entriesEnd = sizeof(header) + (size_t)header.count * sizeof(GlyphCacheEntry);
+        if (file->size() < entriesEnd + header.dataSize) {
+            flog::warn("Ignoring truncated glyph cache '{}'", path);
+            return;
+        }
+
+        // Use the file
+        entries = (const GlyphCacheEntry*)(file->data() + sizeof(header));
+        count = header.count;
+        data = file->data() + entriesEnd;
+        dataSize = header.dataSize;
+        mapping = std::move(file);
+    }
+
+    const GlyphCacheEntry* GlyphCacheFile::find(uint32_t desc) const {
+        // Binary search the sorted entries
+        const GlyphCacheEntry* end = entries + count;
+        const GlyphCacheEntry* it = std::lower_bound(entries, end, desc, [](const GlyphCacheEntry& e, uint32_t d) { return e.desc < d; });
+        return (it != end && it->desc == desc) ? it : NULL;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+#include "glyph_rasterizer.h"
+#include "mapped_file.h"
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <memory>
+
+// Version of the format of glyph cache files, files of other versions are ignored
+#define GFX_GLYPH_CACHE_VERSION 1
+
+namespace gfx {
+    struct GlyphCacheHeader {
+        // Identification of the format and of what the glyphs were rasterized with
+        char magic[4];
+        uint32_t version;
+        uint32_t freetypeVersion;
+        uint32_t sdfSpread;
+
+        // Number of glyphs, and size of their bitmaps following the entries
+        uint32_t count;
+        uint32_t dataSize;
+    };
+
+    struct GlyphCacheEntry {
+        // Descriptor of the glyph, entries are sorted by it
+        uint32_t desc;
+
+        // Glyph geometry
+        int16_t width;
+        int16_t height;
+        int16_t left;
+        int16_t top;
+
+        // Advance instructions
+        float xAdvance;
+
+        // Location of the bitmap from the start of the bitmaps
+        uint32_t offset;
+    };
+
+    /**
+     * Rasterized glyphs of a face at one size, kept in a file so that they don't have to be rasterized again by the next process.
+     * The file is mapped read-only, glyphs rasterized since it was mapped are kept in memory until saved.
+    */
+    class GlyphCacheFile {
+    public:
+        /**
+         * Map a glyph cache file. A missing file, or one written for another format or FreeType version, starts out empty.
+         * @param path Path to the file.
+         * @param sdfSpread Spread of the distance fields of the file, zero if it holds coverage bitmaps.
+        */
+        GlyphCacheFile(const std::string& path, int sdfSpread);
+
+        GlyphCacheFile(const GlyphCacheFile& b) = delete;
+        GlyphCacheFile& operator=(const GlyphCacheFile& b) = delete;
+
+        /**
+         * Get a glyph from the file or from the glyphs added since it was mapped.
+         * @param desc Descriptor of the glyph.
+         * @param glyph Bitmap to copy the glyph into. Its users are left untouched.
+         * @return True if the glyph was found, false otherwise.
+        */
+        bool load(uint32_t desc, GlyphBitmap& glyph) const;
+
+        /**
+         * Add a glyph to be written by the next save. Does nothing if the file already has it.
+         * @param desc Descriptor of the glyph.
+         * @param glyph Rasterized glyph.
+        */
+        void add(uint32_t desc, const GlyphBitmap& glyph);
+
+        /**
+         * Write the file with the added glyphs and map it again. Does nothing if no glyph was added.
+         * @return True if the file is up to date, false if it couldn't be written.
+        */
+        bool save();
+
+    private:
+        void map();
+        const GlyphCacheEntry* find(uint32_t desc) const;
+
+        std::string path;
+        int sdfSpread;
+
+        // Mapping of the file and the locations of its parts, empty if the file doesn't exist or is invalid
+        std::unique_ptr<MappedFile> mapping;
+        const GlyphCacheEntry* entries = NULL;
+        uint32_t count = 0;
+        const uint8_t* data = NULL;
+        uint32_t dataSize = 0;
+
+        // Glyphs added since the file was mapped, sorted by descriptor
+        std::map<uint32_t, GlyphBitmap> added;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,149 @@
+#include "glyph_rasterizer.h"
+#include "font_store.h"
+#include "flog/flog.h"
+#include FT_MODULE_H
+#include <map>
+#include <tuple>
+#include <string.h>
+
+namespace gfx {
+    inline void copyBitmap(const FT_GlyphSlot slot, GlyphBitmap& glyph) {
+        // Save the geometry and the bitmap without its row padding
+        const FT_Bitmap& bm = slot->bitmap;
+        glyph.size = Sizei(bm.width, bm.rows);
+        glyph.offset = Vec2i(slot->bitmap_left, slot->bitmap_top);
+        glyph.bitmap.resize(bm.width * bm.rows);
+        for (int i = 0; i < (int)bm.rows; i++) {
+            memcpy(&glyph.bitmap[i * bm.width], &bm.buffer[i * bm.pitch], bm.width);
+        }
+    }
+
+    void rasterizeGlyph(FT_Face face, int glyphId, int alignment, GlyphBitmap& glyph) {
+        // Apply subpixel alignment
+        FT_Vector delta;
+        delta.x = (float)alignment * (64.0f/4.0f);
+        delta.y = 0;
+        FT_Set_Transform(face, NULL, &delta);
+
+        // Render the glyph
+        FT_GlyphSlot slot = face->glyph;
+        if (FT_Load_Char(face, glyphId, FT_LOAD_RENDER)) {
+            glyph.size = Sizei(0, 0);
+            glyph.offset = Vec2i(0, 0);
+            glyph.xAdvance = 0.0f;
+            return;
+        }
+
+        // Save the glyph
+        copyBitmap(slot, glyph);
+        glyph.xAdvance = (float)slot->linearHoriAdvance * (1.0f / (float)(1 << 16));
+    }
+
+    void rasterizeSDFGlyph(FT_Face face, int glyphId, GlyphBitmap& glyph) {
+        // Load the outline without hinting since it's specific to a single size
+        glyph.size = Sizei(0, 0);
+        glyph.offset = Vec2i(0, 0);
+        FT_GlyphSlot slot = face->glyph;
+        bool loaded = !FT_Load_Char(face, glyphId, FT_LOAD_NO_HINTING);
+        glyph.xAdvance = loaded ? (float)slot->linearHoriAdvance * (1.0f / (float)(1 << 16)) : 0.0f;
+
+        // Glyphs without an outline, like spaces, only have an advance
+        bool hasOutline = loaded && slot->format == FT_GLYPH_FORMAT_OUTLINE && slot->outline.n_points > 0;
+        if (!hasOutline || FT_Render_Glyph(slot, FT_RENDER_MODE_SDF)) { return; }
+
+        // Save the distance field
+        copyBitmap(slot, glyph);
+    }
+
+    GlyphRasterizer::GlyphRasterizer(int threadCount, std::function<void(const GlyphJob&, GlyphBitmap&)> done) : done(done) {
+        // Start the threads
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back(&GlyphRasterizer::worker, this);
+        }
+    }
+
+    GlyphRasterizer::~GlyphRasterizer() {
+        // Wake up all threads and wait for them to finish their current job
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            stopping = true;
+        }
+        cond.notify_all();
+        for (auto& thread : threads) { thread.join(); }
+    }
+
+    void GlyphRasterizer::submit(const GlyphJob& job) {
+        {
+            std::lock_guard<std::mutex> lck(mtx);
+            jobs.push_back(job);
+        }
+        cond.notify_one();
+    }
+
+    void GlyphRasterizer::worker() {
+        // Each thread has its own library since faces of the same library can't be loaded concurrently
+        FT_Library library;
+        if (FT_Init_FreeType(&library)) {
+            flog::error("Could not initialize FreeType for a glyph rasterizer thread");
+            return;
+        }
+        FT_Int spread = GFX_SDF_SPREAD;
+        FT_Property_Set(library, "sdf", "spread", &spread);
+
+        // Faces opened by the thread, by font file, face index and size
+        std::map<std::tuple<const uint8_t*, int, int>, FT_Face> faces;
+
+        while (true) {
+            // Wait for a job
+            GlyphJob job;
+            {
+                std::unique_lock<std::mutex> lck(mtx);
+                cond.wait(lck, [this]() { return stopping || !jobs.empty(); });
+                if (stopping) { break; }
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            // Get the face, opening it if this thread didn't yet
+            auto key = std::make_tuple(job.data, job.faceIndex, job.size);
+            auto it = faces.find(key);
+            if (it == faces.end()) {
+                // Close all faces once too many are open, most jobs are for the same few fonts
+                if (faces.size() >= GFX_GLYPH_RASTERIZER_FACES) {
+                    for (auto& [k, face] : faces) {
+                        if (face) { FT_Done_Face(face); }
+                    }
+                    faces.clear();
+                }
+
+                // Open the face, a face that can't be parsed still gets its glyphs but they are empty
+                FT_Face face = NULL;
+                if (!FT_New_Memory_Face(library, job.data, job.dataSize, job.faceIndex, &face)) {
+                    FT_Set_Pixel_Sizes(face, 0, job.size);
+                }
+                it = faces.emplace(key, face).first;
+            }
+
+            // Rasterize the glyph
+            GlyphBitmap glyph;
+            glyph.size = Sizei(0, 0);
+            glyph.offset = Vec2i(0, 0);
+            glyph.xAdvance = 0.0f;
+            if (it->second && job.distanceField) {
+                rasterizeSDFGlyph(it->second, job.glyphId, glyph);
+            }
+            else if (it->second) {
+                rasterizeGlyph(it->second, job.glyphId, job.alignment, glyph);
+            }
+
+            // Hand it over
+            done(job, glyph);
+        }
+
+        // Close the faces of the thread
+        for (auto& [k, face] : faces) {
+            if (face) { FT_Done_Face(face); }
+        }
+        FT_Done_FreeType(library);
+    }
+}
\ No newline at end of file
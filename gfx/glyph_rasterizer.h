@@ -0,0 +1,110 @@
+#pragma once
+#include "types.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// Maximum number of threads rasterizing glyphs in the background
+#define GFX_GLYPH_RASTERIZER_THREADS    4
+
+// Number of faces a rasterizer thread keeps open before closing them all
+#define GFX_GLYPH_RASTERIZER_FACES      16
+
+namespace gfx {
+    struct GlyphBitmap {
+        // Glyph geometry
+        Sizei size;
+        Vec2i offset;
+
+        // Coverage or distance field, one byte per pixel, tightly packed
+        std::vector<uint8_t> bitmap;
+
+        // Advance instructions
+        float xAdvance;
+
+        // Number of caches using the glyph, it is only freed once no cache uses it
+        int users;
+
+        // Rasterized in the background and not acquired by any cache yet, which keeps it from being freed for a few purges
+        bool unclaimed = false;
+        int unclaimedPurges = 0;
+    };
+
+    struct GlyphJob {
+        // Content of the font file, which must stay mapped for as long as the rasterizer exists
+        const uint8_t* data;
+        size_t dataSize;
+        int faceIndex;
+
+        // Size of the face in pixels
+        int size;
+
+        // Glyph to rasterize
+        int glyphId;
+        int alignment;
+        bool distanceField;
+
+        // Destination of the glyph, only used by whoever submitted the job
+        void* target;
+    };
+
+    /**
+     * Rasterize the coverage of a glyph. The geometry is left empty if the glyph can't be loaded.
+     * @param face Face set to the size of the font.
+     * @param glyphId Unicode ID of the glyph.
+     * @param alignment Sub-pixel alignement, in quarter pixels. Must be between 0 and 3 inclusive.
+     * @param glyph Bitmap to rasterize the glyph into.
+    */
+    void rasterizeGlyph(FT_Face face, int glyphId, int alignment, GlyphBitmap& glyph);
+
+    /**
+     * Rasterize the distance field of a glyph. Glyphs without an outline, like spaces, only get an advance.
+     * @param face Face set to GFX_SDF_SIZE, from a library with the distance field spread set.
+     * @param glyphId Unicode ID of the glyph.
+     * @param glyph Bitmap to rasterize the distance field into.
+    */
+    void rasterizeSDFGlyph(FT_Face face, int glyphId, GlyphBitmap& glyph);
+
+    /**
+     * Threads rasterizing glyphs in the background. A FreeType face can't be used by two threads at once,
+     * so each thread opens its own faces from the mapped font files.
+    */
+    class GlyphRasterizer {
+    public:
+        /**
+         * Start the threads.
+         * @param threadCount Number of threads.
+         * @param done Function called from the rasterizing thread with each job and its glyph.
+        */
+        GlyphRasterizer(int threadCount, std::function<void(const GlyphJob&, GlyphBitmap&)> done);
+
+        // Destructor, stops the threads and drops the jobs not started yet
+        ~GlyphRasterizer();
+
+        GlyphRasterizer(const GlyphRasterizer& b) = delete;
+        GlyphRasterizer& operator=(const GlyphRasterizer& b) = delete;
+
+        /**
+         * Queue a glyph to be rasterized.
+         * @param job Glyph to rasterize.
+        */
+        void submit(const GlyphJob& job);
+
+    private:
+        void worker();
+
+        std::function<void(const GlyphJob&, GlyphBitmap&)> done;
+        std::vector<std::thread> threads;
+        std::deque<GlyphJob> jobs;
+        std::mutex mtx;
+        std::condition_variable cond;
+        bool stopping = false;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,187 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// Number of codepoints stored directly, covering ASCII and Latin-1
+#define GFX_GLYPH_TABLE_DIRECT_CODEPOINTS   256
+
+// Initial number of slots of the hash part, must be a power of two
+#define GFX_GLYPH_TABLE_INITIAL_CAPACITY    64
+
+namespace gfx {
+    /**
+     * Table of per-glyph values keyed by glyph descriptor, that is the codepoint shifted left by two with the sub-pixel
+     * alignment in the low bits. Latin-1 descriptors index an array directly, all others use open addressing with linear probing.
+     * Slots are stored inline so lookups touch a single cache line. Values of the hash part move whenever an insertion rehashes it,
+     * which happens when it grows and when it fills up with erased slots.
+    */
+    template <typename T>
+    class GlyphTable {
+    public:
+        /**
+         * Find the value of a glyph.
+         * @param desc Descriptor of the glyph.
+         * @return Pointer to the value, or NULL if the glyph isn't in the table. Invalidated by the next insertion.
+        */
+        inline T* find(uint32_t desc) {
+            Slot* s = findSlot(desc);
+            return s ? &s->value : NULL;
+        }
+
+        /**
+         * Insert or replace the value of a glyph.
+         * @param desc Descriptor of the glyph.
+         * @param value Value of the glyph.
+         * @return Reference to the value in the table. Invalidated by the next insertion.
+        */
+        T& insert(uint32_t desc, const T& value) {
+            // Latin-1 glyphs are stored directly
+            if (desc < DIRECT_SLOTS) {
+                if (direct.empty()) { direct.resize(DIRECT_SLOTS); }
+                Slot& s = direct[desc];
+                if (s.key != desc) { count++; }
+                s.key = desc;
+                s.value = value;
+                return s.value;
+            }
+
+            // Replace the value if the glyph is already present
+            T* existing = find(desc);
+            if (existing) {
+                *existing = value;
+                return *existing;
+            }
+
+            // Rehash before the table gets more than half full, counting erased slots since they lengthen searches too
+            if ((used + 1) * 2 > slots.size()) { rehash(); }
+
+            // Use the first empty or erased slot
+            size_t mask = slots.size() - 1;
+            size_t i = hash(desc) & mask;
+            while (slots[i].key != EMPTY && slots[i].key != ERASED) { i = (i + 1) & mask; }
+            if (slots[i].key == EMPTY) { used++; }
+            slots[i].key = desc;
+            slots[i].value = value;
+            count++;
+            hashCount++;
+            return slots[i].value;
+        }
+
+        /**
+         * Remove a glyph from the table. Doesn't move any other value.
+         * @param desc Descriptor of the glyph.
+        */
+        void erase(uint32_t desc) {
+            // Find the slot of the glyph
+            Slot* s = findSlot(desc);
+            if (!s) { return; }
+
+            // Mark it as erased, hash slots stay occupied so that searches continue past them
+            if (desc < DIRECT_SLOTS) {
+                s->key = EMPTY;
+            }
+            else {
+                s->key = ERASED;
+                hashCount--;
+            }
+            s->value = T();
+            count--;
+        }
+
+        /**
+         * Remove all glyphs and free the memory of the table.
+        */
+        void clear() {
+            direct.clear();
+            slots.clear();
+            count = 0;
+            hashCount = 0;
+            used = 0;
+        }
+
+        /**
+         * Get the number of glyphs in the table.
+         * @return Number of glyphs.
+        */
+        size_t size() const { return count; }
+
+        /**
+         * Check if the table has no glyphs.
+         * @return True if the table is empty, false otherwise.
+        */
+        bool empty() const { return !count; }
+
+        /**
+         * Call a function for each glyph of the table. The function may erase the glyph it's called for, but not insert any.
+         * @param func Function taking the descriptor of the glyph and a reference to its value.
+        */
+        template <typename F>
+        void forEach(F func) {
+            for (auto& s : direct) {
+                if (s.key != EMPTY) { func(s.key, s.value); }
+            }
+            for (auto& s : slots) {
+                if (s.key != EMPTY && s.key != ERASED) { func(s.key, s.value); }
+            }
+        }
+
+    private:
+        static constexpr uint32_t DIRECT_SLOTS = GFX_GLYPH_TABLE_DIRECT_CODEPOINTS << 2;
+        static constexpr uint32_t EMPTY = UINT32_MAX;
+        static constexpr uint32_t ERASED = UINT32_MAX - 1;
+
+        struct Slot {
+            uint32_t key = EMPTY;
+            T value = T();
+        };
+
+        static inline size_t hash(uint32_t desc) {
+            // Fibonacci hashing spreads consecutive codepoints over the table
+            return (size_t)(((uint64_t)desc * 0x9E3779B97F4A7C15ull) >> 32);
+        }
+
+        inline Slot* findSlot(uint32_t desc) {
+            // Latin-1 glyphs are stored directly
+            if (desc < DIRECT_SLOTS) {
+                if (direct.empty()) { return NULL; }
+                Slot& s = direct[desc];
+                return (s.key == desc) ? &s : NULL;
+            }
+
+            // Other glyphs are searched for from their hash until an empty slot is found
+            if (slots.empty()) { return NULL; }
+            size_t mask = slots.size() - 1;
+            for (size_t i = hash(desc) & mask;; i = (i + 1) & mask) {
+                Slot& s = slots[i];
+                if (s.key == desc) { return &s; }
+                if (s.key == EMPTY) { return NULL; }
+            }
+        }
+
+        void rehash() {
+            // Only grow if actually getting full rather than just full of erased slots
+            size_t capacity = slots.empty() ? GFX_GLYPH_TABLE_INITIAL_CAPACITY : slots.size();
+            if ((hashCount + 1) * 4 > capacity) { capacity *= 2; }
+
+            // Reinsert all live glyphs into the new slots
+            std::vector<Slot> old(capacity);
+            std::swap(old, slots);
+            size_t mask = slots.size() - 1;
+            used = 0;
+            for (auto& s : old) {
+                if (s.key == EMPTY || s.key == ERASED) { continue; }
+                size_t i = hash(s.key) & mask;
+                while (slots[i].key != EMPTY) { i = (i + 1) & mask; }
+                slots[i] = s;
+                used++;
+            }
+        }
+
+        std::vector<Slot> direct;
+        std::vector<Slot> slots;
+        size_t count = 0;
+        size_t hashCount = 0;
+        size_t used = 0;
+    };
+}
\ No newline at end of file
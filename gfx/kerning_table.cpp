@@ -0,0 +1,258 @@
+#include "kerning_table.h"
+#include "flog/flog.h"
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
+#include <unordered_map>
+#include <unordered_set>
+#include <set>
+#include <algorithm>
+
+namespace gfx {
+    // Big-endian readers that return zero past the end of the table, so that truncated tables read as empty
+    inline uint16_t readU16(const std::vector<uint8_t>& data, size_t offset) {
+        if (offset + 2 > data.size()) { return 0; }
+        return (uint16_t)((data[offset] << 8) | data[offset + 1]);
+    }
+
+    inline int16_t readI16(const std::vector<uint8_t>& data, size_t offset) {
+        return (int16_t)readU16(data, offset);
+    }
+
+    inline uint32_t readU32(const std::vector<uint8_t>& data, size_t offset) {
+        return ((uint32_t)readU16(data, offset) << 16) | readU16(data, offset + 2);
+    }
+
+    inline uint32_t pairKey(uint16_t left, uint16_t right) {
+        return ((uint32_t)left << 16) | right;
+    }
+
+    inline bool loadTable(FT_Face face, FT_ULong tag, std::vector<uint8_t>& data) {
+        // Get the size of the table, then its content
+        FT_ULong length = 0;
+        if (FT_Load_Sfnt_Table(face, tag, 0, NULL, &length) || !length) { return false; }
+        data.resize(length);
+        return !FT_Load_Sfnt_Table(face, tag, 0, data.data(), &length);
+    }
+
+    inline std::vector<uint16_t> readCoverage(const std::vector<uint8_t>& data, size_t offset) {
+        // Glyphs in coverage index order, either listed or as ranges
+        std::vector<uint16_t> glyphs;
+        uint16_t format = readU16(data, offset);
+        uint16_t count = readU16(data, offset + 2);
+        if (format == 1) {
+            for (int i = 0; i < count; i++) { glyphs.push_back(readU16(data, offset + 4 + 2*i)); }
+        }
+        else if (format == 2) {
+            for (int i = 0; i < count; i++) {
+                size_t range = offset + 4 + 6*i;
+                uint16_t start = readU16(data, range);
+                uint16_t end = readU16(data, range + 2);
+                for (int g = start; g <= end; g++) { glyphs.push_back(g); }
+            }
+        }
+        return glyphs;
+    }
+
+    inline std::unordered_map<uint16_t, uint16_t> readClassDef(const std::vector<uint8_t>& data, size_t offset) {
+        // Class of each glyph that isn't in class zero, either as an array or as ranges
+        std::unordered_map<uint16_t, uint16_t> classes;
+        uint16_t format = readU16(data, offset);
+        if (format == 1) {
+            uint16_t start = readU16(data, offset + 2);
+            uint16_t count = readU16(data, offset + 4);
+            for (int i = 0; i < count; i++) { classes[start + i] = readU16(data, offset + 6 + 2*i); }
+        }
+        else if (format == 2) {
+            uint16_t count = readU16(data, offset + 2);
+            for (int i = 0; i < count; i++) {
+                size_t range = offset + 4 + 6*i;
+                uint16_t start = readU16(data, range);
+                uint16_t end = readU16(data, range + 2);
+                uint16_t cls = readU16(data, range + 4);
+                for (int g = start; g <= end; g++) { classes[g] = cls; }
+            }
+        }
+        return classes;
+    }
+
+    inline int valueRecordSize(uint16_t format) {
+        // Each bit of the format is one 16bit field
+        int size = 0;
+        for (; format; format &= format - 1) { size += 2; }
+        return size;
+    }
+
+    inline void readPairPos(const std::vector<uint8_t>& data, size_t offset, std::unordered_map<uint32_t, int>& pairs, std::unordered_set<uint16_t>& claimed) {
+        // Only the advance of the first glyph is used, which is the third field of its value record if present
+        uint16_t format = readU16(data, offset);
+        std::vector<uint16_t> coverage = readCoverage(data, offset + readU16(data, offset + 2));
+        uint16_t valueFormat1 = readU16(data, offset + 4);
+        uint16_t valueFormat2 = readU16(data, offset + 6);
+        if (!(valueFormat1 & 0x0004)) { return; }
+        int advanceOffset = valueRecordSize(valueFormat1 & 0x0003);
+        int recordSize = valueRecordSize(valueFormat1) + valueRecordSize(valueFormat2);
+
+        // Subtables are tried in order until one applies. Pairs found first win and class-based subtables
+        // apply to all pairs of the glyphs they cover, so later subtables can't kern those anymore.
+        if (format == 1) {
+            // Pairs listed for each covered first glyph
+            uint16_t setCount = readU16(data, offset + 8);
+            for (int i = 0; i < std::min<int>(setCount, coverage.size()); i++) {
+                uint16_t left = coverage[i];
+                if (claimed.count(left)) { continue; }
+                size_t set = offset + readU16(data, offset + 10 + 2*i);
+                uint16_t count = readU16(data, set);
+                for (int j = 0; j < count; j++) {
+                    size_t record = set + 2 + (size_t)j * (2 + recordSize);
+                    pairs.emplace(pairKey(left, readU16(data, record)), readI16(data, record + 2 + advanceOffset));
+                }
+            }
+        }
+        else if (format == 2) {
+            // Values for each pair of classes, expanded to the glyphs of the classes. Class zero of the second glyph
+            // holds all glyphs not listed and is never kerned in practice, so it's skipped.
+            std::unordered_map<uint16_t, uint16_t> classes1 = readClassDef(data, offset + readU16(data, offset + 8));
+            std::unordered_map<uint16_t, uint16_t> classes2 = readClassDef(data, offset + readU16(data, offset + 10));
+            uint16_t class1Count = readU16(data, offset + 12);
+            uint16_t class2Count = readU16(data, offset + 14);
+            std::vector<std::vector<uint16_t>> members(class2Count);
+            for (const auto& [glyph, cls] : classes2) {
+                if (cls < class2Count) { members[cls].push_back(glyph); }
+            }
+            for (uint16_t left : coverage) {
+                if (!claimed.insert(left).second) { continue; }
+                auto it = classes1.find(left);
+                uint16_t class1 = (it != classes1.end()) ? it->second : 0;
+                if (class1 >= class1Count) { continue; }
+                for (int class2 = 1; class2 < class2Count; class2++) {
+                    size_t record = offset + 16 + ((size_t)class1 * class2Count + class2) * recordSize;
+                    int value = readI16(data, record + advanceOffset);
+                    if (!value) { continue; }
+                    for (uint16_t right : members[class2]) { pairs.emplace(pairKey(left, right), value); }
+                }
+            }
+        }
+    }
+
+    inline bool readGPOS(const std::vector<uint8_t>& data, std::unordered_map<uint32_t, int>& pairs) {
+        // Only version 1.x is known
+        if (readU16(data, 0) != 1) { return false; }
+        size_t featureList = readU16(data, 6);
+        size_t lookupList = readU16(data, 8);
+
+        // Collect the lookups of the kern features of all scripts. Without a shaper the script of the text is unknown,
+        // but the lookups specific to a script only cover the glyphs of that script.
+        std::set<uint16_t> lookups;
+        uint16_t featureCount = readU16(data, featureList);
+        for (int i = 0; i < featureCount; i++) {
+            size_t record = featureList + 2 + 6*i;
+            if (readU32(data, record) != FT_MAKE_TAG('k', 'e', 'r', 'n')) { continue; }
+            size_t feature = featureList + readU16(data, record + 4);
+            uint16_t count = readU16(data, feature + 2);
+            for (int j = 0; j < count; j++) { lookups.insert(readU16(data, feature + 4 + 2*j)); }
+        }
+        if (lookups.empty()) { return false; }
+
+        // Read the pair adjustments of each lookup, the adjustments of different lookups add up
+        uint16_t lookupCount = readU16(data, lookupList);
+        for (uint16_t index : lookups) {
+            if (index >= lookupCount) { continue; }
+            size_t lookup = lookupList + readU16(data, lookupList + 2 + 2*index);
+            uint16_t type = readU16(data, lookup);
+            uint16_t subtableCount = readU16(data, lookup + 4);
+            std::unordered_map<uint32_t, int> lookupPairs;
+            std::unordered_set<uint16_t> claimed;
+            for (int i = 0; i < subtableCount; i++) {
+                // Follow extension subtables to the actual subtable
+                size_t subtable = lookup + readU16(data, lookup + 6 + 2*i);
+                uint16_t subtableType = type;
+                if (type == 9) {
+                    subtableType = readU16(data, subtable + 2);
+                    subtable += readU32(data, subtable + 4);
+                }
+
+                // Only pair adjustments are kerning
+                if (subtableType == 2) { readPairPos(data, subtable, lookupPairs, claimed); }
+            }
+            for (const auto& [key, value] : lookupPairs) { pairs[key] += value; }
+        }
+        return true;
+    }
+
+    inline void readKern(const std::vector<uint8_t>& data, std::unordered_map<uint32_t, int>& pairs) {
+        // Only the OpenType version of the table is known, as for FreeType
+        if (readU16(data, 0) != 0) { return; }
+        uint16_t subtableCount = readU16(data, 2);
+        size_t subtable = 4;
+        for (int i = 0; i < subtableCount; i++) {
+            uint16_t length = readU16(data, subtable + 2);
+            uint16_t coverage = readU16(data, subtable + 4);
+            uint16_t count = readU16(data, subtable + 6);
+
+            // Only horizontal format 0 subtables hold kerning pairs. They either add to or override the previous ones.
+            if ((coverage & ~0x0008) == 0x0001) {
+                for (int j = 0; j < count; j++) {
+                    size_t record = subtable + 14 + 6*j;
+                    uint32_t key = pairKey(readU16(data, record), readU16(data, record + 2));
+                    int value = readI16(data, record + 4);
+                    if (coverage & 0x0008) {
+                        pairs[key] = value;
+                    }
+                    else {
+                        pairs[key] += value;
+                    }
+                }
+            }
+
+            // The length overflows for large subtables, so never trust it to be shorter than the pairs
+            subtable += std::max<size_t>(length, 14 + 6 * (size_t)count);
+        }
+    }
+
+    KerningTable::KerningTable(FT_Face face) {
+        // Read the pairs from the GPOS table, or from the kern table if the GPOS table doesn't kern
+        std::unordered_map<uint32_t, int> pairs;
+        std::vector<uint8_t> data;
+        if (!loadTable(face, TTAG_GPOS, data) || !readGPOS(data, pairs)) {
+            if (loadTable(face, TTAG_kern, data)) { readKern(data, pairs); }
+        }
+
+        if (pairs.empty()) { return; }
+
+        // List the codepoints of the Basic Multilingual Plane mapped to each glyph. Glyphs without any, like ligatures,
+        // can't be reached without a shaper so their pairs are dropped.
+        std::unordered_map<uint16_t, std::vector<uint16_t>> codepoints;
+        FT_UInt glyph;
+        for (FT_ULong c = FT_Get_First_Char(face, &glyph); glyph && c <= 0xFFFF; c = FT_Get_Next_Char(face, c, &glyph)) {
+            if (glyph <= 0xFFFF) { codepoints[glyph].push_back(c); }
+        }
+
+        // Translate the pairs that didn't cancel out
+        std::vector<std::pair<uint32_t, int>> translated;
+        for (const auto& [key, value] : pairs) {
+            if (!value) { continue; }
+            auto left = codepoints.find(key >> 16);
+            auto right = codepoints.find(key & 0xFFFF);
+            if (left == codepoints.end() || right == codepoints.end()) { continue; }
+            for (uint16_t l : left->second) {
+                for (uint16_t r : right->second) { translated.push_back({ pairKey(l, r), value }); }
+            }
+        }
+        if (translated.empty()) { return; }
+
+        // Store them in a table that stays at most half full
+        size_t capacity = 16;
+        while (capacity < translated.size() * 2) { capacity *= 2; }
+        keys.resize(capacity, EMPTY);
+        values.resize(capacity, 0);
+        size_t mask = capacity - 1;
+        for (const auto& [key, value] : translated) {
+            size_t i = hash(key) & mask;
+            while (keys[i] != EMPTY) { i = (i + 1) & mask; }
+            keys[i] = key;
+            values[i] = (int16_t)std::clamp<int>(value, INT16_MIN, INT16_MAX);
+        }
+        count = translated.size();
+        flog::debug("Loaded {} kerning pairs for '{} {}'", (int)count, face->family_name, face->style_name);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+namespace gfx {
+    /**
+     * Horizontal kerning of the glyph pairs of a face, in font units so that all sizes share it. Pairs are read in bulk
+     * from the kern feature of the GPOS table, or from the legacy kern table of faces without one, and translated from
+     * glyph indices to unicode IDs through the character map so that text can be kerned before its glyphs are fetched.
+     * They are kept in a flat hash table so that a lookup is a single probe in the common case. The table never changes once loaded.
+    */
+    class KerningTable {
+    public:
+        /**
+         * Load the kerning pairs of a face.
+         * @param face Face to load the pairs of.
+        */
+        KerningTable(FT_Face face);
+
+        /**
+         * Get the kerning of a pair of glyphs. Only glyphs of the Basic Multilingual Plane are kerned.
+         * @param leftId Unicode ID of the left glyph.
+         * @param rightId Unicode ID of the right glyph.
+         * @return Adjustment of the advance of the left glyph in font units, zero if the pair isn't kerned.
+        */
+        inline int get(int leftId, int rightId) const {
+            if (keys.empty() || (uint32_t)leftId > 0xFFFF || (uint32_t)rightId > 0xFFFF) { return 0; }
+            uint32_t key = ((uint32_t)leftId << 16) | (uint32_t)rightId;
+            size_t mask = keys.size() - 1;
+            for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+                if (keys[i] == key) { return values[i]; }
+                if (keys[i] == EMPTY) { return 0; }
+            }
+        }
+
+        /**
+         * Get the number of kerned pairs.
+         * @return Number of pairs.
+        */
+        size_t size() const { return count; }
+
+    private:
+        static constexpr uint32_t EMPTY = UINT32_MAX;
+
+        static inline size_t hash(uint32_t key) {
+            // Fibonacci hashing spreads the pairs of neighbouring codepoints over the table
+            return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> 32);
+        }
+
+        std::vector<uint32_t> keys;
+        std::vector<int16_t> values;
+        size_t count = 0;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#include "mapped_file.h"
+#include <stdexcept>
+#include <atomic>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace gfx {
+#ifdef _WIN32
+    MappedFile::MappedFile(const std::string& path) {
+        // Open the file
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Could not open file");
+        }
+
+        // Get its size, empty files can't be mapped
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || !fileSize.QuadPart) {
+            CloseHandle(file);
+            throw std::runtime_error("Could not map file");
+        }
+        len = (size_t)fileSize.QuadPart;
+
+        // Map it, the mapping keeps the file open on its own
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if (!mapping) {
+            throw std::runtime_error("Could not map file");
+        }
+        ptr = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!ptr) {
+            CloseHandle(mapping);
+            throw std::runtime_error("Could not map file");
+        }
+    }
+
+    MappedFile::~MappedFile() {
+        UnmapViewOfFile(ptr);
+        CloseHandle(mapping);
+    }
+#else
+    MappedFile::MappedFile(const std::string& path) {
+        // Open the file
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open file");
+        }
+
+        // Get its size, empty files can't be mapped
+        struct stat st;
+        if (fstat(fd, &st) || !st.st_size) {
+            close(fd);
+            throw std::runtime_error("Could not map file");
+        }
+        len = (size_t)st.st_size;
+
+        // Map it, the mapping keeps the file open on its own
+        void* addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            throw std::runtime_error("Could not map file");
+        }
+        ptr = (const uint8_t*)addr;
+    }
+
+    MappedFile::~MappedFile() {
+        munmap((void*)ptr, len);
+    }
+#endif
+
+    std::string getTempPath(const std::string& path) {
+        // Tell processes apart by their ID, and the temporary files of a process by a counter
+        static std::atomic<uint32_t> counter = 0;
+#ifdef _WIN32
+        unsigned long pid = (unsigned long)GetCurrentProcessId();
+#else
+        unsigned long pid = (unsigned long)getpid();
+#endif
+        return path + "." + std::to_string(pid) + "-" + std::to_string(counter++) + ".tmp";
+    }
+}
\ No newline at end of file
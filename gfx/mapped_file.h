@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+namespace gfx {
+    class MappedFile {
+    public:
+        /**
+         * Map a file read-only into memory.
+         * @param path Path to the file.
+        */
+        MappedFile(const std::string& path);
+
+        // Destructor
+        ~MappedFile();
+
+        MappedFile(const MappedFile& b) = delete;
+        MappedFile& operator=(const MappedFile& b) = delete;
+
+        /**
+         * Get the content of the file. Pages are only read from disk once accessed.
+         * @return Pointer to the content of the file.
+        */
+        const uint8_t* data() const { return ptr; }
+
+        /**
+         * Get the size of the file.
+         * @return Size of the file in bytes.
+        */
+        size_t size() const { return len; }
+
+    private:
+        const uint8_t* ptr = NULL;
+        size_t len = 0;
+#ifdef _WIN32
+        void* mapping = NULL;
+#endif
+    };
+
+    /**
+     * Get the path of a temporary file to write the new content of a file to before renaming it over the file.
+     * It's unique to the process and the call, so that processes replacing the same file at once never write into the same temporary file.
+     * @param path Path of the file to replace.
+     * @return Path of the temporary file, in the same directory.
+    */
+    std::string getTempPath(const std::string& path);
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#include "painter.h"
+#include "utf8.h"
+#include <math.h>
+#include <algorithm>
+
+namespace gfx {
+    Sizei Painter::getCellSize(const Font& font) {
+        // Characters of a monospace font all have the advance of any of them
+        std::shared_ptr<const TextBlob> blob = createTextBlob(font, "M");
+        int width = std::max<int>((int)roundf(blob->getWidth()), 1);
+        int height = std::max<int>((int)ceilf(blob->getAscender() - blob->getDescender()), 1);
+        return Sizei(width, height);
+    }
+
+    void Painter::drawTextGrid(const Point& position, TextGrid& grid) {
+        // Cells are placed on whole pixels
+        Sizei cell = getCellSize(grid.getFont());
+        Point origin(roundf(position.x), roundf(position.y));
+        const Sizei& size = grid.getSize();
+
+        // Draw all backgrounds first, characters may reach into the neighbouring cells
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                const TextCell& c = grid.getCell(x, y);
+                if (c.background.a <= 0.0f) { continue; }
+                fillRect(Rect(Point(origin.x + x * cell.x, origin.y + y * cell.y), Size(cell.x, cell.y)), c.background);
+            }
+        }
+
+        // Draw the characters from the top of their cell
+        char str[5];
+        for (int y = 0; y < size.y; y++) {
+            for (int x = 0; x < size.x; x++) {
+                const TextCell& c = grid.getCell(x, y);
+                if (!c.codepoint || c.foreground.a <= 0.0f) { continue; }
+                encodeUTF8(c.codepoint, str);
+                drawText(Point(origin.x + x * cell.x, origin.y + y * cell.y), str, grid.getFont(), c.foreground, H_REF_LEFT, V_REF_TOP);
+            }
+        }
+    }
+
+    void Painter::prewarm(const Font&, const std::vector<CodepointRange>&) {
+        // Painters without a glyph cache have nothing to prepare
+    }
+}
\ No newline at end of file
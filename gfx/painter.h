@@ -3,28 +3,13 @@
 #include "color.h"
 #include "polygon.h"
 #include "font.h"
+#include "text_blob.h"
+#include "text_grid.h"
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace gfx {
-    /**
-     * Horizontal reference.
-    */
-    enum HRef {
-        H_REF_LEFT,
-        H_REF_CENTER,
-        H_REF_RIGHT
-    };
-
-    /**
-     * Vertical reference.
-    */
-    enum VRef {
-        V_REF_TOP,
-        V_REF_CENTER,
-        V_REF_BASELINE,
-        V_REF_BOTTOM
-    };
-
     // TODO: Switch to floats !!!!!!!!!!!!!!!!!!!!!!
 
     class Painter {
@@ -110,14 +95,14 @@ namespace gfx {
          * @param str String to draw.
          * @param font Font to use to draw the string.
         */
-        virtual Size measureText(Font& font, const char* str) = 0;
+        virtual Size measureText(const Font& font, const char* str) = 0;
 
         /**
          * Measure the size of a string.
          * @param str String to draw.
          * @param font Font to use to draw the string.
         */
-        inline Size measureText(Font& font, const std::string& str) {
+        inline Size measureText(const Font& font, const std::string& str) {
             return measureText(font, str.c_str());
         }
 
@@ -130,7 +115,7 @@ namespace gfx {
          * @param href Horizontal reference point.
          * @param vref Vertical reference point.
         */
-        virtual void drawText(const Point& position, const char* str, Font& font, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE) = 0;
+        virtual void drawText(const Point& position, const char* str, const Font& font, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE) = 0;
 
         /**
          * Draw a string.
@@ -141,8 +126,59 @@ namespace gfx {
          * @param href Horizontal reference point.
          * @param vref Vertical reference point.
         */
-        inline void drawText(const Point& position, const std::string& str, Font& font, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE) {
+        inline void drawText(const Point& position, const std::string& str, const Font& font, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE) {
             drawText(position, str.c_str(), font, color, href, vref);
         };
+
+        /**
+         * Lay out a string so that it can be drawn many times without looking up its glyphs again.
+         * @param font Font to lay the string out in.
+         * @param str String to lay out.
+         * @return Text blob, which can be kept for as long as needed.
+        */
+        virtual std::shared_ptr<const TextBlob> createTextBlob(const Font& font, const char* str) = 0;
+
+        /**
+         * Lay out a string so that it can be drawn many times without looking up its glyphs again.
+         * @param font Font to lay the string out in.
+         * @param str String to lay out.
+         * @return Text blob, which can be kept for as long as needed.
+        */
+        inline std::shared_ptr<const TextBlob> createTextBlob(const Font& font, const std::string& str) {
+            return createTextBlob(font, str.c_str());
+        }
+
+        /**
+         * Draw a text blob. Looks the same as drawing its string with drawText().
+         * @param position Position at which the blob will be drawn.
+         * @param blob Text blob to draw.
+         * @param color Color of the text.
+         * @param href Horizontal reference point.
+         * @param vref Vertical reference point.
+        */
+        virtual void drawTextBlob(const Point& position, const TextBlob& blob, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE) = 0;
+
+        /**
+         * Get the size of the cells of a text grid: the advance of a character and the height of a line, in whole pixels.
+         * @param font Font of the grid.
+         * @return Size of a cell in pixels.
+        */
+        Sizei getCellSize(const Font& font);
+
+        /**
+         * Draw a text grid. Painters able to keep the grid between frames only update the cells that changed since they
+         * last drew it, others draw the background and character of each cell.
+         * @param position Position of the top left corner of the grid, rounded to whole pixels.
+         * @param grid Text grid to draw. Its changes may be taken.
+        */
+        virtual void drawTextGrid(const Point& position, TextGrid& grid);
+
+        /**
+         * Prepare the glyphs of ranges of codepoints ahead of time, so that the first frames showing them don't have to.
+         * Glyphs are rasterized in the background, the call doesn't wait for them.
+         * @param font Font to which the glyphs belong.
+         * @param ranges Codepoints to prepare.
+        */
+        virtual void prewarm(const Font& font, const std::vector<CodepointRange>& ranges);
     };
 }
\ No newline at end of file
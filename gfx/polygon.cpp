@@ -1,4 +1,5 @@
 #include "polygon.h"
+#include <algorithm>
 
 namespace gfx {
     Polygon::Polygon(const std::vector<Point>& vertices) {
@@ -22,6 +23,44 @@ namespace gfx {
         return triangles;
     }
 
+    void Polygon::getOutline(const Point& position, const Size& size, float thickness, std::vector<Vec2f>& outer, std::vector<Vec2f>& inner) const {
+        // Place the vertices
+        int count = (int)vertices.size();
+        outer.resize(count);
+        inner.resize(count);
+        for (int i = 0; i < count; i++) {
+            outer[i] = Vec2f(position.x + vertices[i].x*size.x, position.y + vertices[i].y*size.y);
+        }
+
+        // The inside is on the right of the edges of a clockwise polygon, the shoelace sum tells if it really is
+        float area = 0.0f;
+        for (int i = 0; i < count; i++) {
+            const Vec2f& a = outer[i];
+            const Vec2f& b = outer[(i+1)%count];
+            area += a.x*b.y - b.x*a.y;
+        }
+        float side = (area < 0.0f) ? -1.0f : 1.0f;
+
+        // Move each vertex inwards along the bisector of its edges, far enough for both edges to be at the right distance
+        for (int i = 0; i < count; i++) {
+            Vec2f prev = outer[i] - outer[(i+count-1)%count];
+            Vec2f next = outer[(i+1)%count] - outer[i];
+            float prevLength = prev.N();
+            float nextLength = next.N();
+            Vec2f n0 = (prevLength > 0.0f) ? Vec2f(-prev.y, prev.x) * (side / prevLength) : Vec2f(0.0f, 0.0f);
+            Vec2f n1 = (nextLength > 0.0f) ? Vec2f(-next.y, next.x) * (side / nextLength) : Vec2f(0.0f, 0.0f);
+            Vec2f miter = n0 + n1;
+            float miterLength = miter.N();
+            if (miterLength < 1e-6f) {
+                inner[i] = outer[i] + n0*thickness;
+                continue;
+            }
+            miter = miter / miterLength;
+            float cosine = std::max<float>(miter.x*n0.x + miter.y*n0.y, 1.0f / GFX_POLYGON_MITER_LIMIT);
+            inner[i] = outer[i] + miter*(thickness / cosine);
+        }
+    }
+
     void Polygon::triangulate(const std::vector<Point>& verts, const std::vector<int>& vertInds) {
         // Find spikes in the remaining vertices
         std::vector<Point> unusedVertices;
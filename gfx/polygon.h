@@ -2,6 +2,9 @@
 #include <vector>
 #include "types.h"
 
+// Longest a mitered corner of a polygon border can get, as a multiple of its thickness
+#define GFX_POLYGON_MITER_LIMIT    4.0f
+
 namespace gfx {
     class Polygon {
     public:
@@ -22,6 +25,16 @@ namespace gfx {
          * @return List of triangles of the polygon.
         */
         const std::vector<Vec3i> getTriangles() const;
+
+        /**
+         * Compute the edges of a border drawn inside the polygon once placed, with mitered corners.
+         * @param position Position of the top left corner of the polygon.
+         * @param size Size of the bounding box of the polygon.
+         * @param thickness Thickness of the border in pixels.
+         * @param outer Outer edge of the border, one point per vertex. Previous content is discarded.
+         * @param inner Inner edge of the border, one point per vertex. Previous content is discarded.
+        */
+        void getOutline(const Point& position, const Size& size, float thickness, std::vector<Vec2f>& outer, std::vector<Vec2f>& inner) const;
     
     private:
         void triangulate(const std::vector<Point>& verts, const std::vector<int>& vertInds);
@@ -0,0 +1,229 @@
+#include "recording_painter.h"
+#include <string.h>
+#include <stdexcept>
+
+namespace gfx {
+    template <typename T>
+    inline T read(const uint8_t*& ptr) {
+        T value;
+        memcpy(&value, ptr, sizeof(T));
+        ptr += sizeof(T);
+        return value;
+    }
+
+    RecordingPainter::RecordingPainter(Painter* measurer) {
+        this->measurer = measurer;
+    }
+
+    void RecordingPainter::clear() {
+        commands.clear();
+        polygons.clear();
+        fonts.clear();
+        strings.clear();
+    }
+
+    void RecordingPainter::replay(Painter& painter) const {
+        const uint8_t* ptr = commands.data();
+        const uint8_t* end = ptr + commands.size();
+        while (ptr < end) {
+            // Decode and issue the command
+            switch (read<RecordedCommandType>(ptr)) {
+            case RECORDED_PUSH_STENCIL:
+                painter.pushStencil(read<Recti>(ptr));
+                break;
+            case RECORDED_POP_STENCIL:
+                painter.popStencil();
+                break;
+            case RECORDED_PUSH_OFFSET:
+                painter.pushOffset(read<Pointi>(ptr));
+                break;
+            case RECORDED_POP_OFFSET:
+                painter.popOffset();
+                break;
+            case RECORDED_DRAW_LINE: {
+                Point a = read<Point>(ptr);
+                Point b = read<Point>(ptr);
+                Color color = read<Color>(ptr);
+                painter.drawLine(a, b, color, read<float>(ptr));
+                break;
+            }
+            case RECORDED_DRAW_RECT: {
+                Rect area = read<Rect>(ptr);
+                Color color = read<Color>(ptr);
+                float thickness = read<float>(ptr);
+                painter.drawRect(area, color, thickness, read<float>(ptr));
+                break;
+            }
+            case RECORDED_FILL_RECT: {
+                Rect area = read<Rect>(ptr);
+                Color color = read<Color>(ptr);
+                painter.fillRect(area, color, read<float>(ptr));
+                break;
+            }
+            case RECORDED_DRAW_POLYGON: {
+                Point position = read<Point>(ptr);
+                const Polygon& polygon = polygons[read<int>(ptr)];
+                Size size = read<Size>(ptr);
+                Color color = read<Color>(ptr);
+                painter.drawPolygon(position, polygon, size, color, read<float>(ptr));
+                break;
+            }
+            case RECORDED_FILL_POLYGON: {
+                Point position = read<Point>(ptr);
+                const Polygon& polygon = polygons[read<int>(ptr)];
+                Size size = read<Size>(ptr);
+                painter.fillPolygon(position, polygon, size, read<Color>(ptr));
+                break;
+            }
+            case RECORDED_DRAW_ARC: {
+                Point center = read<Point>(ptr);
+                float diameter = read<float>(ptr);
+                float startAngle = read<float>(ptr);
+                float endAngle = read<float>(ptr);
+                Color color = read<Color>(ptr);
+                painter.drawArc(center, diameter, startAngle, endAngle, color, read<float>(ptr));
+                break;
+            }
+            case RECORDED_FILL_ARC: {
+                Point center = read<Point>(ptr);
+                float diameter = read<float>(ptr);
+                float startAngle = read<float>(ptr);
+                float endAngle = read<float>(ptr);
+                painter.fillArc(center, diameter, startAngle, endAngle, read<Color>(ptr));
+                break;
+            }
+            case RECORDED_DRAW_TEXT: {
+                Point position = read<Point>(ptr);
+                const char* str = &strings[read<int>(ptr)];
+                const Font& font = fonts[read<int>(ptr)];
+                Color color = read<Color>(ptr);
+                HRef href = (HRef)read<uint8_t>(ptr);
+                VRef vref = (VRef)read<uint8_t>(ptr);
+                painter.drawText(position, str, font, color, href, vref);
+                break;
+            }
+            default:
+                throw std::runtime_error("Invalid recorded command");
+            }
+        }
+    }
+
+    void RecordingPainter::pushStencil(const Recti& stencil) {
+        write(RECORDED_PUSH_STENCIL);
+        write(stencil);
+    }
+
+    void RecordingPainter::popStencil() {
+        write(RECORDED_POP_STENCIL);
+    }
+
+    void RecordingPainter::pushOffset(const Pointi& offset) {
+        write(RECORDED_PUSH_OFFSET);
+        write(offset);
+    }
+
+    void RecordingPainter::popOffset() {
+        write(RECORDED_POP_OFFSET);
+    }
+
+    void RecordingPainter::drawLine(const Point& a, const Point& b, const Color& color, float thickness) {
+        write(RECORDED_DRAW_LINE);
+        write(a);
+        write(b);
+        write(color);
+        write(thickness);
+    }
+
+    void RecordingPainter::drawRect(const Rect& area, const Color& color, float thickness, float borderRadius) {
+        write(RECORDED_DRAW_RECT);
+        write(area);
+        write(color);
+        write(thickness);
+        write(borderRadius);
+    }
+
+    void RecordingPainter::fillRect(const Rect& area, const Color& color, float borderRadius) {
+        write(RECORDED_FILL_RECT);
+        write(area);
+        write(color);
+        write(borderRadius);
+    }
+
+    void RecordingPainter::drawPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color, float thickness) {
+        write(RECORDED_DRAW_POLYGON);
+        write(position);
+        write((int)polygons.size());
+        write(size);
+        write(color);
+        write(thickness);
+        polygons.push_back(polygon);
+    }
+
+    void RecordingPainter::fillPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color) {
+        write(RECORDED_FILL_POLYGON);
+        write(position);
+        write((int)polygons.size());
+        write(size);
+        write(color);
+        polygons.push_back(polygon);
+    }
+
+    void RecordingPainter::drawArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color, float thickness) {
+        write(RECORDED_DRAW_ARC);
+        write(center);
+        write(diameter);
+        write(startAngle);
+        write(endAngle);
+        write(color);
+        write(thickness);
+    }
+
+    void RecordingPainter::fillArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color) {
+        write(RECORDED_FILL_ARC);
+        write(center);
+        write(diameter);
+        write(startAngle);
+        write(endAngle);
+        write(color);
+    }
+
+    Size RecordingPainter::measureText(const Font& font, const char* str) {
+        // Without a backend, there is no way to know the size of the glyphs
+        if (!measurer) { throw std::runtime_error("Cannot measure text without a measuring painter"); }
+        return measurer->measureText(font, str);
+    }
+
+    void RecordingPainter::drawText(const Point& position, const char* str, const Font& font, const Color& color, HRef href, VRef vref) {
+        write(RECORDED_DRAW_TEXT);
+        write(position);
+        write((int)strings.size());
+        write(addFont(font));
+        write(color);
+        write((uint8_t)href);
+        write((uint8_t)vref);
+
+        // Save the string including its null terminator
+        strings.insert(strings.end(), str, str + strlen(str) + 1);
+    }
+
+    std::shared_ptr<const TextBlob> RecordingPainter::createTextBlob(const Font& font, const char* str) {
+        // Without a backend, there is no way to lay out the glyphs
+        if (!measurer) { throw std::runtime_error("Cannot lay out text without a measuring painter"); }
+        return measurer->createTextBlob(font, str);
+    }
+
+    void RecordingPainter::drawTextBlob(const Point& position, const TextBlob& blob, const Color& color, HRef href, VRef vref) {
+        drawText(position, blob.getText().c_str(), blob.getFont(), color, href, vref);
+    }
+
+    int RecordingPainter::addFont(const Font& font) {
+        // Reuse the font if it was already used, there's usually only a handful of them
+        for (int i = 0; i < (int)fonts.size(); i++) {
+            if (fonts[i] == font) { return i; }
+        }
+
+        // Otherwise, save a copy of it, which shares its handle
+        fonts.push_back(font);
+        return (int)fonts.size() - 1;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,179 @@
+#pragma once
+#include "painter.h"
+#include <vector>
+#include <stdint.h>
+
+namespace gfx {
+    enum RecordedCommandType : uint8_t {
+        RECORDED_PUSH_STENCIL,
+        RECORDED_POP_STENCIL,
+        RECORDED_PUSH_OFFSET,
+        RECORDED_POP_OFFSET,
+        RECORDED_DRAW_LINE,
+        RECORDED_DRAW_RECT,
+        RECORDED_FILL_RECT,
+        RECORDED_DRAW_POLYGON,
+        RECORDED_FILL_POLYGON,
+        RECORDED_DRAW_ARC,
+        RECORDED_FILL_ARC,
+        RECORDED_DRAW_TEXT
+    };
+
+    /**
+     * Painter that records draw calls into a compact command buffer instead of drawing them.
+     * The recording can then be replayed into any painter, or compiled by a backend into prebuilt geometry.
+    */
+    class RecordingPainter : public Painter {
+    public:
+        /**
+         * Create a recording painter.
+         * @param measurer Painter used to answer measureText() calls while recording. Can be NULL if text is never measured.
+        */
+        RecordingPainter(Painter* measurer = NULL);
+
+        /**
+         * Discard all recorded commands.
+        */
+        void clear();
+
+        /**
+         * Check if no command was recorded.
+         * @return True if the recording is empty, false otherwise.
+        */
+        bool empty() const { return commands.empty(); }
+
+        /**
+         * Issue all recorded commands to a painter, in order.
+         * @param painter Painter to replay the commands into.
+        */
+        void replay(Painter& painter) const;
+
+        void pushStencil(const Recti& stencil);
+
+        void popStencil();
+
+        void pushOffset(const Pointi& offset);
+
+        void popOffset();
+
+        /**
+         * Draw a line.
+         * @param a Starting point.
+         * @param b Ending point.
+         * @param color Color of the line.
+         * @param thickness Thickness of the line in pixels
+        */
+        void drawLine(const Point& a, const Point& b, const Color& color, float thickness = 1);
+
+        /**
+         * Draw a hollow rectangle.
+         * @param area Area of rectangle including border.
+         * @param color Color of the rectangle.
+         * @param thickness Thickness of the border in pixels.
+         * @param borderRadius Rounding radius in pixels.
+        */
+        void drawRect(const Rect& area, const Color& color, float thickness = 1, float borderRadius = 0);
+
+        /**
+         * Draw a filled rectangle.
+         * @param area Area of rectangle including border.
+         * @param color Color of the rectangle.
+         * @param borderRadius Rounding radius in pixels.
+        */
+        void fillRect(const Rect& area, const Color& color, float borderRadius = 0);
+
+        /**
+         * Draw a hollow polygon.
+         * @param position Position of the top left corner of the polygon.
+         * @param polygon The polygon to draw.
+         * @param size Size of the bounding box of the polygon.
+         * @param color Color of the polygon.
+         * @param thickness Thickness of the border in pixels.
+        */
+        void drawPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color, float thickness = 1);
+
+        /**
+         * Draw a filled polygon.
+         * @param position Position of the top left corner of the polygon.
+         * @param polygon The polygon to draw.
+         * @param size Size of the bounding box of the polygon.
+         * @param color Color of the polygon.
+        */
+        void fillPolygon(const Point& position, const Polygon& polygon, const Size& size, const Color& color);
+
+        /**
+         * Draw a hollow arc. The arc is drawn in a clockwise direction with the reference point being on the left.
+         * @param center Center point.
+         * @param diameter Diameter of the arc in pixels.
+         * @param startAngle Angle at which the arc start.
+         * @param endAngle Angle at which the arc ends.
+         * @param color  Color of the arc.
+        */
+        void drawArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color, float thickness = 1);
+
+        /**
+         * Draw a filled arc. The arc is drawn in a clockwise direction with the reference point being on the left.
+         * @param center Center point.
+         * @param diameter Diameter of the arc in pixels.
+         * @param startAngle Angle at which the arc start.
+         * @param endAngle Angle at which the arc ends.
+         * @param color  Color of the arc.
+        */
+        void fillArc(const Point& center, float diameter, float startAngle, float endAngle, const Color& color);
+
+        /**
+         * Measure the size of a string. Forwarded to the measuring painter.
+         * @param str String to draw.
+         * @param font Font to use to draw the string.
+        */
+        Size measureText(const Font& font, const char* str);
+
+        /**
+         * Draw a string.
+         * @param position Position at which the string will be draw.
+         * @param str String to draw.
+         * @param font Font to use to draw the string.
+         * @param color Color of the text.
+         * @param href Horizontal reference point.
+         * @param vref Vertical reference point.
+        */
+        void drawText(const Point& position, const char* str, const Font& font, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE);
+
+        /**
+         * Lay out a string. Forwarded to the measuring painter.
+         * @param font Font to lay the string out in.
+         * @param str String to lay out.
+         * @return Text blob of the measuring painter.
+        */
+        std::shared_ptr<const TextBlob> createTextBlob(const Font& font, const char* str);
+
+        /**
+         * Draw a text blob. It is recorded as its string, which the replaying painter lays out itself.
+         * @param position Position at which the blob will be drawn.
+         * @param blob Text blob to draw.
+         * @param color Color of the text.
+         * @param href Horizontal reference point.
+         * @param vref Vertical reference point.
+        */
+        void drawTextBlob(const Point& position, const TextBlob& blob, const Color& color, HRef href = H_REF_LEFT, VRef vref = V_REF_BASELINE);
+
+    private:
+        template <typename T>
+        void write(const T& value) {
+            const uint8_t* bytes = (const uint8_t*)&value;
+            commands.insert(commands.end(), bytes, bytes + sizeof(T));
+        }
+
+        int addFont(const Font& font);
+
+        Painter* measurer;
+
+        // Command stream, each command is its type followed by its arguments
+        std::vector<uint8_t> commands;
+
+        // Arguments too large or not trivially copyable to live in the command stream
+        std::vector<Polygon> polygons;
+        std::vector<Font> fonts;
+        std::vector<char> strings;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,236 @@
+#pragma once
+#include "types.h"
+#include "font.h"
+#include <stdint.h>
+#include <math.h>
+#include <string>
+#include <string_view>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// Number of text blobs a painter keeps for the strings it draws
+#define GFX_TEXT_BLOB_CACHE_SIZE    512
+
+namespace gfx {
+    /**
+     * Horizontal reference.
+    */
+    enum HRef {
+        H_REF_LEFT,
+        H_REF_CENTER,
+        H_REF_RIGHT
+    };
+
+    /**
+     * Vertical reference.
+    */
+    enum VRef {
+        V_REF_TOP,
+        V_REF_CENTER,
+        V_REF_BASELINE,
+        V_REF_BOTTOM
+    };
+
+    /**
+     * String laid out in a font once so that it can be drawn many times. Blobs are created by a painter and hold
+     * whatever that painter needs to draw the string without looking up its glyphs again. Other painters can still
+     * draw them, but lay the string out again to do so.
+    */
+    class TextBlob {
+    public:
+        // Virtual destructor
+        virtual ~TextBlob() {}
+
+        /**
+         * Get the font the string is laid out in.
+         * @return Font of the blob.
+        */
+        const Font& getFont() const { return font; }
+
+        /**
+         * Get the string of the blob.
+         * @return String of the blob.
+        */
+        const std::string& getText() const { return text; }
+
+        /**
+         * Get the sub-pixel alignment of the origin the string was laid out for.
+         * @return Alignment in quarter pixels, between 0 and 3 inclusive.
+        */
+        int getAlignment() const { return alignment; }
+
+        /**
+         * Get the advance width of the string, as returned by measureText().
+         * @return Width in pixels.
+        */
+        float getWidth() const { return width; }
+
+        /**
+         * Get the area covered by the glyphs, relative to the start of the baseline.
+         * @return Bounds of the glyphs. Empty if no glyph has any pixel.
+        */
+        const Rect& getBounds() const { return bounds; }
+
+        /**
+         * Get the distance from the baseline to the top of the font.
+         * @return Ascender of the font in pixels.
+        */
+        float getAscender() const { return ascender; }
+
+        /**
+         * Get the distance from the baseline to the bottom of the font, negative below the baseline.
+         * @return Descender of the font in pixels.
+        */
+        float getDescender() const { return descender; }
+
+        /**
+         * Get the start of the baseline when drawing the blob at a position, quantized like the painters do it.
+         * @param position Position at which the blob is drawn.
+         * @param href Horizontal reference point.
+         * @param vref Vertical reference point.
+         * @return Start of the baseline, on a quarter of pixel horizontally and a whole pixel vertically.
+        */
+        Vec2f getOrigin(const Point& position, HRef href, VRef vref) const {
+            // Quantize the position
+            Vec2f origin(roundf(position.x * 4.0f) * 0.25f, roundf(position.y * 4.0f) * 0.25f);
+
+            // Do horizontal alignment
+            if (href == H_REF_CENTER) {
+                origin.x -= width / 2;
+            }
+            else if (href == H_REF_RIGHT) {
+                origin.x -= width;
+            }
+
+            // Do vertical alignment
+            if (vref == V_REF_BOTTOM) {
+                origin.y += descender;
+            }
+            else if (vref == V_REF_CENTER) {
+                origin.y += (descender + ascender) * 0.5f;
+            }
+            else if (vref == V_REF_TOP) {
+                origin.y += ascender;
+            }
+
+            // Quantize to the available subpixel increment
+            return Vec2f(roundf(origin.x * 4.0f) * 0.25f, roundf(origin.y));
+        }
+
+    protected:
+        TextBlob(const Font& font, std::string_view text, int alignment) : font(font), text(text), alignment(alignment) {
+            width = 0.0f;
+            bounds = Rect(Point(0, 0), Size(0, 0));
+            ascender = 0.0f;
+            descender = 0.0f;
+        }
+
+        Font font;
+        std::string text;
+        int alignment;
+        float width;
+        Rect bounds;
+
+        // Metrics of the font, for vertical alignment
+        float ascender;
+        float descender;
+    };
+
+    /**
+     * Least recently used text blobs of a painter, by string, font and alignment of the origin.
+    */
+    template <typename T>
+    class TextBlobCache {
+    public:
+        /**
+         * Create an empty cache.
+         * @param capacity Maximum number of blobs to keep.
+        */
+        TextBlobCache(int capacity = GFX_TEXT_BLOB_CACHE_SIZE) : capacity(capacity) {}
+
+        /**
+         * Find a blob and mark it as the most recently used one.
+         * @param font Font of the blob.
+         * @param text String of the blob.
+         * @param alignment Sub-pixel alignment of the origin of the blob.
+         * @return Blob, or NULL if it isn't in the cache.
+        */
+        std::shared_ptr<T> find(const Font& font, std::string_view text, int alignment) {
+            // Search by hash of the string
+            auto it = index.find(Key{ std::hash<std::string_view>{}(text), font.getHandle(), alignment });
+            if (it == index.end()) { return NULL; }
+
+            // The string could just collide
+            const std::shared_ptr<T>& blob = *it->second;
+            if (blob->getText() != text) { return NULL; }
+
+            // Move it to the front
+            entries.splice(entries.begin(), entries, it->second);
+            return blob;
+        }
+
+        /**
+         * Add a blob as the most recently used one, dropping the least recently used blob if the cache is full.
+         * @param blob Blob to add. Replaces any blob with the same key.
+        */
+        void insert(const std::shared_ptr<T>& blob) {
+            // Remove the blob with the same key, if any
+            Key key{ std::hash<std::string_view>{}(blob->getText()), blob->getFont().getHandle(), blob->getAlignment() };
+            auto it = index.find(key);
+            if (it != index.end()) {
+                entries.erase(it->second);
+                index.erase(it);
+            }
+
+            // Add the blob at the front
+            entries.push_front(blob);
+            index[key] = entries.begin();
+
+            // Drop the least recently used blob if over capacity. Callers may still hold it.
+            if (entries.size() > capacity) {
+                const std::shared_ptr<T>& last = entries.back();
+                index.erase(Key{ std::hash<std::string_view>{}(last->getText()), last->getFont().getHandle(), last->getAlignment() });
+                entries.pop_back();
+            }
+        }
+
+        /**
+         * Remove all blobs.
+        */
+        void clear() {
+            index.clear();
+            entries.clear();
+        }
+
+        /**
+         * Call a function for each blob, from the most to the least recently used.
+         * @param func Function taking a reference to the blob.
+        */
+        template <typename F>
+        void forEach(F func) {
+            for (auto& blob : entries) { func(*blob); }
+        }
+
+    private:
+        struct Key {
+            size_t hash;
+            FontHandle font;
+            int alignment;
+
+            bool operator==(const Key& b) const {
+                return hash == b.hash && font == b.font && alignment == b.alignment;
+            }
+        };
+
+        struct KeyHash {
+            size_t operator()(const Key& k) const noexcept {
+                return k.hash ^ (((size_t)k.font.id * 0x9E3779B97F4A7C15ull) + ((size_t)k.font.generation << 2) + k.alignment);
+            }
+        };
+
+        size_t capacity;
+        std::list<std::shared_ptr<T>> entries;
+        std::unordered_map<Key, typename std::list<std::shared_ptr<T>>::iterator, KeyHash> index;
+    };
+}
\ No newline at end of file
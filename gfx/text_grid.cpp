@@ -0,0 +1,109 @@
+#include "text_grid.h"
+#include "utf8.h"
+#include <atomic>
+#include <algorithm>
+
+namespace gfx {
+    // Identifier given to the next grid
+    std::atomic<uint64_t> nextGridId = 1;
+
+    inline bool operator==(const Color& a, const Color& b) {
+        return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    }
+
+    inline bool operator==(const TextCell& a, const TextCell& b) {
+        return a.codepoint == b.codepoint && a.foreground == b.foreground && a.background == b.background;
+    }
+
+    TextGrid::TextGrid(const Font& font, const Sizei& size) : font(font) {
+        id = nextGridId++;
+        resize(size);
+    }
+
+    void TextGrid::setFont(const Font& font) {
+        if (font == this->font) { return; }
+        this->font = font;
+        markAllChanged();
+    }
+
+    void TextGrid::resize(const Sizei& size) {
+        // Copy the cells at the same position to a new grid of empty cells
+        TextCell empty = { 0, Color(), Color() };
+        std::vector<TextCell> resized(std::max<int>(size.x, 0) * std::max<int>(size.y, 0), empty);
+        int cols = std::min<int>(size.x, this->size.x);
+        int rows = std::min<int>(size.y, this->size.y);
+        for (int y = 0; y < rows; y++) {
+            std::copy_n(&cells[y * this->size.x], cols, &resized[y * size.x]);
+        }
+        std::swap(cells, resized);
+        this->size = size;
+
+        // All cells moved
+        changedFlags.assign(cells.size(), false);
+        markAllChanged();
+    }
+
+    void TextGrid::setCell(int x, int y, const TextCell& cell) {
+        int index = y * size.x + x;
+        if (cells[index] == cell) { return; }
+        cells[index] = cell;
+        markChanged(index);
+    }
+
+    int TextGrid::print(int x, int y, std::string_view str, const Color& foreground, const Color& background) {
+        // Decode the string, it can't have more characters than bytes
+        std::vector<int> codepoints(str.size());
+        size_t count = decodeUTF8(str.data(), str.size(), codepoints.data());
+
+        // Write one character per cell until the end of the row
+        int written = std::clamp<int>(size.x - x, 0, (int)count);
+        for (int i = 0; i < written; i++) {
+            setCell(x + i, y, { codepoints[i], foreground, background });
+        }
+        return written;
+    }
+
+    void TextGrid::fill(const Recti& area, const TextCell& cell) {
+        // Clip the area to the grid
+        int x0 = std::max<int>(area.A().x, 0);
+        int y0 = std::max<int>(area.A().y, 0);
+        int x1 = std::min<int>(area.B().x, size.x - 1);
+        int y1 = std::min<int>(area.B().y, size.y - 1);
+
+        // Set the cells
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) { setCell(x, y, cell); }
+        }
+    }
+
+    bool TextGrid::takeChanges(std::vector<int>& changed) {
+        // Hand the list over and start a new one
+        bool all = allChanged;
+        changed.clear();
+        if (all) {
+            changedFlags.assign(cells.size(), false);
+        }
+        else {
+            for (int index : changes) { changedFlags[index] = false; }
+            std::swap(changed, changes);
+        }
+        allChanged = false;
+        revision++;
+        return all;
+    }
+
+    void TextGrid::markChanged(int index) {
+        // Nothing to track if all cells are already changed or the cell is already listed
+        if (allChanged || changedFlags[index]) { return; }
+
+        // Add the cell, or give up on listing cells once a large part of the grid changed
+        changedFlags[index] = true;
+        changes.push_back(index);
+        if (changes.size() > cells.size() / 4) { markAllChanged(); }
+    }
+
+    void TextGrid::markAllChanged() {
+        allChanged = true;
+        changes.clear();
+    }
+}
\ No newline at end of file
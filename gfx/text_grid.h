@@ -0,0 +1,136 @@
+#pragma once
+#include "types.h"
+#include "color.h"
+#include "font.h"
+#include <stdint.h>
+#include <string_view>
+#include <vector>
+
+namespace gfx {
+    struct TextCell {
+        // Unicode ID of the character, zero for an empty cell
+        int codepoint;
+
+        // Color of the character and of the cell
+        Color foreground;
+        Color background;
+    };
+
+    /**
+     * Grid of character cells in a monospace font, like the screen of a terminal. Cells are drawn in one go by painters,
+     * which keep the grid in whatever form they draw it from and only update the cells that changed since they last drew it.
+     * Changed cells are tracked until a painter takes them, so a grid is best drawn by a single painter.
+    */
+    class TextGrid {
+    public:
+        /**
+         * Create a grid of empty cells with a transparent background.
+         * @param font Font of the characters.
+         * @param size Number of columns and rows.
+        */
+        TextGrid(const Font& font, const Sizei& size);
+
+        // Grids are identified by the painters drawing them, so they can't be copied
+        TextGrid(const TextGrid& b) = delete;
+        TextGrid& operator=(const TextGrid& b) = delete;
+
+        /**
+         * Get the font of the characters.
+         * @return Font of the grid.
+        */
+        const Font& getFont() const { return font; }
+
+        /**
+         * Set the font of the characters. All cells change.
+         * @param font New font.
+        */
+        void setFont(const Font& font);
+
+        /**
+         * Get the number of columns and rows.
+         * @return Size of the grid in cells.
+        */
+        const Sizei& getSize() const { return size; }
+
+        /**
+         * Change the number of columns and rows. Cells keep their position, new cells are empty with a transparent background.
+         * @param size New size of the grid in cells.
+        */
+        void resize(const Sizei& size);
+
+        /**
+         * Get a cell.
+         * @param x Column of the cell.
+         * @param y Row of the cell.
+         * @return Cell.
+        */
+        const TextCell& getCell(int x, int y) const { return cells[y * size.x + x]; }
+
+        /**
+         * Get a cell by index.
+         * @param index Index of the cell, row by row.
+         * @return Cell.
+        */
+        const TextCell& getCell(int index) const { return cells[index]; }
+
+        /**
+         * Set a cell. Nothing changes if it already has the same content.
+         * @param x Column of the cell.
+         * @param y Row of the cell.
+         * @param cell New content of the cell.
+        */
+        void setCell(int x, int y, const TextCell& cell);
+
+        /**
+         * Write a string to consecutive cells of a row, one character per cell. Characters past the end of the row are dropped.
+         * @param x Column of the first cell.
+         * @param y Row of the cells.
+         * @param str UTF-8 string to write.
+         * @param foreground Color of the characters.
+         * @param background Color of the cells.
+         * @return Number of cells written.
+        */
+        int print(int x, int y, std::string_view str, const Color& foreground, const Color& background);
+
+        /**
+         * Set all cells of an area.
+         * @param area Area to fill, clipped to the grid.
+         * @param cell Content of the cells.
+        */
+        void fill(const Recti& area, const TextCell& cell);
+
+        /**
+         * Get the unique identifier of the grid, which painters keep what they drew it from by.
+         * @return Identifier of the grid.
+        */
+        uint64_t getId() const { return id; }
+
+        /**
+         * Get the number of times changes were taken, so that a painter can tell if others took changes it didn't see.
+         * @return Revision of the grid.
+        */
+        uint64_t getRevision() const { return revision; }
+
+        /**
+         * Take the cells that changed since the last time changes were taken, and increment the revision.
+         * @param changed Filled with the index of each changed cell, in no particular order. Empty if all cells changed.
+         * @return True if all cells must be considered changed, false if only those returned changed.
+        */
+        bool takeChanges(std::vector<int>& changed);
+
+    private:
+        void markChanged(int index);
+        void markAllChanged();
+
+        Font font;
+        Sizei size = Sizei(0, 0);
+        std::vector<TextCell> cells;
+        uint64_t id;
+        uint64_t revision = 0;
+
+        // Changed cells and whether each cell is in the list. Past a quarter of the grid, all cells are considered changed instead.
+        std::vector<int> changes;
+        std::vector<bool> changedFlags;
+        bool allChanged = true;
+    };
+}
\ No newline at end of file
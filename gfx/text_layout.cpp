@@ -0,0 +1,285 @@
+#include "text_layout.h"
+#include <stdexcept>
+#include <algorithm>
+
+namespace gfx {
+    inline void splitParagraphs(std::string_view text, std::vector<std::string_view>& paragraphs) {
+        // Cut the text at each line feed, a trailing line feed starts an empty paragraph
+        size_t start = 0;
+        while (true) {
+            size_t end = text.find('\n', start);
+            if (end == std::string_view::npos) {
+                paragraphs.push_back(text.substr(start));
+                return;
+            }
+            paragraphs.push_back(text.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+
+    TextLayout::TextLayout(const Font& font, float width, HRef align) : font(font) {
+        this->width = width;
+        this->align = align;
+    }
+
+    void TextLayout::setText(std::string_view text) {
+        // Split the text into paragraphs
+        std::vector<std::string_view> texts;
+        splitParagraphs(text, texts);
+
+        // Keep the paragraphs that didn't change at the start and at the end
+        size_t common = std::min<size_t>(paragraphs.size(), texts.size());
+        size_t prefix = 0;
+        while (prefix < common && paragraphs[prefix].text == texts[prefix]) { prefix++; }
+        size_t suffix = 0;
+        while (suffix < common - prefix && paragraphs[paragraphs.size() - 1 - suffix].text == texts[texts.size() - 1 - suffix]) { suffix++; }
+
+        // Replace the ones in between
+        size_t count = paragraphs.size() - prefix - suffix;
+        std::vector<std::string_view> changed(texts.begin() + prefix, texts.end() - suffix);
+        if (count || !changed.empty()) { replace(prefix, count, changed); }
+    }
+
+    void TextLayout::replaceParagraphs(size_t first, size_t count, std::string_view text) {
+        std::vector<std::string_view> texts;
+        splitParagraphs(text, texts);
+        replace(first, count, texts);
+    }
+
+    void TextLayout::removeParagraphs(size_t first, size_t count) {
+        replace(first, count, {});
+    }
+
+    void TextLayout::setFont(const Font& font) {
+        // Nothing to do if the font doesn't change
+        if (font == this->font) { return; }
+        this->font = font;
+
+        // Measure everything again
+        metricsValid = false;
+        for (auto& para : paragraphs) {
+            para.measured = false;
+            para.broken = false;
+        }
+        markDirty(0, paragraphs.size());
+    }
+
+    void TextLayout::setWidth(float width) {
+        // Nothing to do if the width doesn't change
+        if (width == this->width) { return; }
+        float fits = std::min<float>(width, this->width);
+        this->width = width;
+
+        // Paragraphs that fit on a single line at both widths keep it, the others are broken again from their measured words
+        for (size_t i = 0; i < paragraphs.size(); i++) {
+            Paragraph& para = paragraphs[i];
+            if (para.broken && para.naturalWidth > fits) {
+                para.broken = false;
+                markDirty(i, i + 1);
+            }
+        }
+    }
+
+    void TextLayout::update(Painter& painter) {
+        // Get the metrics of the font
+        if (!metricsValid) {
+            std::shared_ptr<const TextBlob> blob = painter.createTextBlob(font, " ");
+            lineHeight = blob->getAscender() - blob->getDescender();
+            spaceWidth = blob->getWidth();
+            metricsValid = true;
+        }
+
+        // Lay out the paragraphs that changed, the following lines move if their number of lines changes
+        for (size_t i = dirtyBegin; i < dirtyEnd; i++) {
+            Paragraph& para = paragraphs[i];
+            if (!para.measured) { measure(painter, para); }
+            if (para.broken) { continue; }
+            size_t oldLines = para.lines.size();
+            breakLines(para);
+            if (para.lines.size() != oldLines) { movedFrom = std::min<size_t>(movedFrom, i); }
+        }
+        dirtyBegin = 0;
+        dirtyEnd = 0;
+
+        // Number the lines again from the first paragraph whose lines moved
+        if (movedFrom == SIZE_MAX) { return; }
+        size_t line = 0;
+        if (movedFrom) {
+            const Paragraph& prev = paragraphs[movedFrom - 1];
+            line = prev.firstLine + prev.lines.size();
+        }
+        for (size_t i = movedFrom; i < paragraphs.size(); i++) {
+            paragraphs[i].firstLine = line;
+            line += paragraphs[i].lines.size();
+        }
+        lineCount = line;
+        movedFrom = SIZE_MAX;
+    }
+
+    TextLine TextLayout::getLine(size_t index) const {
+        // Check the index
+        if (index >= lineCount) { throw std::runtime_error("Line index out of range"); }
+
+        // Find the line in its paragraph
+        size_t p = findParagraph(index);
+        const Line& line = paragraphs[p].lines[index - paragraphs[p].firstLine];
+        return TextLine{ p, line.start, line.end, Point(getLineX(line), (float)index * lineHeight), line.width };
+    }
+
+    size_t TextLayout::findLine(float y) const {
+        // All lines have the same height
+        if (!lineCount || y < 0.0f) { return 0; }
+        if (y >= getHeight()) { return lineCount - 1; }
+        return std::min<size_t>((size_t)(y / lineHeight), lineCount - 1);
+    }
+
+    void TextLayout::draw(Painter& painter, const Point& position, const Color& color, float visibleTop, float visibleBottom) {
+        // Lay out what changed
+        update(painter);
+        if (!lineCount || visibleTop >= getHeight()) { return; }
+
+        // Draw the lines from the first visible one until one is past the bottom
+        size_t index = findLine(visibleTop);
+        for (size_t p = findParagraph(index); p < paragraphs.size(); p++) {
+            const Paragraph& para = paragraphs[p];
+            for (size_t l = index - para.firstLine; l < para.lines.size(); l++, index++) {
+                // Stop once below the visible area
+                float y = (float)index * lineHeight;
+                if (y >= visibleBottom) { return; }
+
+                // Draw the line from its top, skipping empty ones
+                const Line& line = para.lines[l];
+                if (line.start == line.end) { continue; }
+                scratch.assign(para.text, line.start, line.end - line.start);
+                painter.drawText(Point(position.x + getLineX(line), position.y + y), scratch, font, color, H_REF_LEFT, V_REF_TOP);
+            }
+        }
+    }
+
+    void TextLayout::replace(size_t first, size_t count, const std::vector<std::string_view>& texts) {
+        // Check the range
+        if (first > paragraphs.size() || count > paragraphs.size() - first) {
+            throw std::runtime_error("Paragraph range out of range");
+        }
+
+        // Move the range of paragraphs waiting for an update along with them
+        size_t newCount = texts.size();
+        if (dirtyBegin < dirtyEnd) {
+            if (dirtyBegin >= first + count) { dirtyBegin = dirtyBegin - count + newCount; }
+            else if (dirtyBegin > first) { dirtyBegin = first; }
+            if (dirtyEnd >= first + count) { dirtyEnd = dirtyEnd - count + newCount; }
+            else if (dirtyEnd > first) { dirtyEnd = first + newCount; }
+        }
+
+        // Replace the text of the paragraphs in place as far as possible, then remove or insert the difference
+        size_t reused = std::min<size_t>(count, newCount);
+        for (size_t i = 0; i < reused; i++) {
+            Paragraph& para = paragraphs[first + i];
+            para.text.assign(texts[i]);
+            para.measured = false;
+            para.broken = false;
+        }
+        if (count > newCount) {
+            paragraphs.erase(paragraphs.begin() + first + newCount, paragraphs.begin() + first + count);
+        }
+        else if (newCount > count) {
+            paragraphs.insert(paragraphs.begin() + first + count, newCount - count, Paragraph());
+            for (size_t i = count; i < newCount; i++) { paragraphs[first + i].text.assign(texts[i]); }
+        }
+
+        // Lay out the new paragraphs at the next update, the lines after them move if paragraphs were added or removed
+        markDirty(first, first + newCount);
+        if (count != newCount) { movedFrom = std::min<size_t>(movedFrom, first); }
+    }
+
+    void TextLayout::markDirty(size_t begin, size_t end) {
+        if (begin >= end) { return; }
+        if (dirtyBegin >= dirtyEnd) {
+            dirtyBegin = begin;
+            dirtyEnd = end;
+            return;
+        }
+        dirtyBegin = std::min<size_t>(dirtyBegin, begin);
+        dirtyEnd = std::max<size_t>(dirtyEnd, end);
+    }
+
+    float TextLayout::measureRange(Painter& painter, const std::string& text, size_t start, size_t end) {
+        // The painter only measures null terminated strings
+        if (start == end) { return 0.0f; }
+        scratch.assign(text, start, end - start);
+        return painter.measureText(font, scratch).x;
+    }
+
+    void TextLayout::measure(Painter& painter, Paragraph& para) {
+        // Cut the paragraph into words, each followed by the spaces at which a line can break
+        para.segments.clear();
+        const std::string& text = para.text;
+        size_t i = 0;
+        while (i < text.size()) {
+            Segment seg;
+            size_t start = i;
+            while (i < text.size() && text[i] != ' ') { i++; }
+            seg.wordEnd = i;
+            while (i < text.size() && text[i] == ' ') { i++; }
+            seg.end = i;
+
+            // Measure the word, spaces are never kerned so they're only measured once
+            seg.wordWidth = measureRange(painter, text, start, seg.wordEnd);
+            seg.spaceWidth = (float)(seg.end - seg.wordEnd) * spaceWidth;
+            para.segments.push_back(seg);
+        }
+
+        // Get the width on a single line, without the trailing spaces
+        float natural = 0.0f;
+        for (const auto& seg : para.segments) { natural += seg.wordWidth + seg.spaceWidth; }
+        if (!para.segments.empty()) { natural -= para.segments.back().spaceWidth; }
+        para.naturalWidth = natural;
+        para.measured = true;
+        para.broken = false;
+    }
+
+    void TextLayout::breakLines(Paragraph& para) {
+        // Add words to the line until the next one doesn't fit, a line always gets at least one word
+        para.lines.clear();
+        Line line = { 0, 0, 0.0f };
+        float x = 0.0f;
+        size_t start = 0;
+        for (const auto& seg : para.segments) {
+            // Start a new line if the word doesn't fit, the spaces before it hang past the end of the line
+            if (start > line.start && x + seg.wordWidth > width) {
+                para.lines.push_back(line);
+                line = { start, start, 0.0f };
+                x = 0.0f;
+            }
+
+            // Add the word
+            line.end = seg.wordEnd;
+            line.width = x + seg.wordWidth;
+            x = line.width + seg.spaceWidth;
+            start = seg.end;
+        }
+
+        // The last line keeps its trailing spaces, empty paragraphs still get an empty line
+        if (!para.segments.empty()) {
+            line.end = para.segments.back().end;
+            line.width = x;
+        }
+        para.lines.push_back(line);
+        para.broken = true;
+    }
+
+    size_t TextLayout::findParagraph(size_t line) const {
+        // Every paragraph has at least one line, so the first lines are strictly increasing
+        auto it = std::upper_bound(paragraphs.begin(), paragraphs.end(), line, [](size_t l, const Paragraph& para) {
+            return l < para.firstLine;
+        });
+        return (it - paragraphs.begin()) - 1;
+    }
+
+    float TextLayout::getLineX(const Line& line) const {
+        // Lines can only be aligned within a finite width
+        if (align == H_REF_LEFT || width == FLT_MAX) { return 0.0f; }
+        if (align == H_REF_CENTER) { return (width - line.width) * 0.5f; }
+        return width - line.width;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#pragma once
+#include "painter.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <float.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace gfx {
+    /**
+     * Line of a text layout.
+    */
+    struct TextLine {
+        // Index of the paragraph the line belongs to
+        size_t paragraph;
+
+        // Range of bytes of the paragraph drawn on the line, the spaces ending a wrapped line are left out
+        size_t start;
+        size_t end;
+
+        // Position relative to the top left of the layout, as aligned
+        Point position;
+
+        // Width of the line, as the sum of the measured widths of its words and spaces
+        float width;
+    };
+
+    /**
+     * Multi-line text wrapped to a width. The text is split into paragraphs at line feeds, and each paragraph keeps the
+     * measured widths of its words and where its lines break. Edits only lay out the paragraphs they touch again, and a
+     * new width only breaks again the paragraphs that didn't fit on a single line, from the widths they already have.
+     * Words wider than the layout overflow their line instead of being split.
+    */
+    class TextLayout {
+    public:
+        /**
+         * Create an empty layout.
+         * @param font Font of the text.
+         * @param width Width to wrap the text to in pixels. FLT_MAX to not wrap it.
+         * @param align Horizontal alignment of the lines.
+        */
+        TextLayout(const Font& font, float width = FLT_MAX, HRef align = H_REF_LEFT);
+
+        /**
+         * Set the text of the layout. Paragraphs equal to those found at the same position from the start or from the end
+         * of the current text keep their layout, so setting an edited copy of the text only lays out the edited paragraphs again.
+         * @param text New text.
+        */
+        void setText(std::string_view text);
+
+        /**
+         * Replace paragraphs by text, which is split into paragraphs at line feeds.
+         * @param first Index of the first paragraph to replace.
+         * @param count Number of paragraphs to replace. Zero to insert the text before the first paragraph.
+         * @param text Text of the new paragraphs.
+        */
+        void replaceParagraphs(size_t first, size_t count, std::string_view text);
+
+        /**
+         * Remove paragraphs.
+         * @param first Index of the first paragraph to remove.
+         * @param count Number of paragraphs to remove.
+        */
+        void removeParagraphs(size_t first, size_t count);
+
+        /**
+         * Get the number of paragraphs.
+         * @return Number of paragraphs.
+        */
+        size_t getParagraphCount() const { return paragraphs.size(); }
+
+        /**
+         * Get the text of a paragraph.
+         * @param index Index of the paragraph.
+         * @return Text of the paragraph, without the line feed.
+        */
+        const std::string& getParagraph(size_t index) const { return paragraphs[index].text; }
+
+        /**
+         * Set the font of the text. All paragraphs will be measured again.
+         * @param font New font.
+        */
+        void setFont(const Font& font);
+
+        /**
+         * Get the font of the text.
+         * @return Font of the text.
+        */
+        const Font& getFont() const { return font; }
+
+        /**
+         * Set the width the text is wrapped to.
+         * @param width New width in pixels. FLT_MAX to not wrap the text.
+        */
+        void setWidth(float width);
+
+        /**
+         * Get the width the text is wrapped to.
+         * @return Width in pixels.
+        */
+        float getWidth() const { return width; }
+
+        /**
+         * Set the horizontal alignment of the lines. Lines aren't broken again.
+         * @param align New alignment.
+        */
+        void setAlignment(HRef align) { this->align = align; }
+
+        /**
+         * Get the horizontal alignment of the lines.
+         * @return Alignment of the lines.
+        */
+        HRef getAlignment() const { return align; }
+
+        /**
+         * Lay out the paragraphs that changed since the last update. The methods describing lines only reflect the last update.
+         * @param painter Painter used to measure the text.
+        */
+        void update(Painter& painter);
+
+        /**
+         * Get the number of lines.
+         * @return Number of lines.
+        */
+        size_t getLineCount() const { return lineCount; }
+
+        /**
+         * Get the distance between the tops of two lines, from the metrics of the font.
+         * @return Height of a line in pixels.
+        */
+        float getLineHeight() const { return lineHeight; }
+
+        /**
+         * Get the height of the text.
+         * @return Height in pixels.
+        */
+        float getHeight() const { return (float)lineCount * lineHeight; }
+
+        /**
+         * Get a line.
+         * @param index Index of the line.
+         * @return Line.
+        */
+        TextLine getLine(size_t index) const;
+
+        /**
+         * Find the line at a height.
+         * @param y Height relative to the top of the layout. Clamped to the lines of the layout.
+         * @return Index of the line. Zero if the layout has no line.
+        */
+        size_t findLine(float y) const;
+
+        /**
+         * Update the layout and draw its lines.
+         * @param painter Painter to draw with.
+         * @param position Top left corner of the layout.
+         * @param color Color of the text.
+         * @param visibleTop Height relative to the top of the layout above which lines aren't drawn.
+         * @param visibleBottom Height relative to the top of the layout below which lines aren't drawn.
+        */
+        void draw(Painter& painter, const Point& position, const Color& color, float visibleTop = 0.0f, float visibleBottom = FLT_MAX);
+
+    private:
+        struct Segment {
+            // End of the word and of the spaces after it, a segment starts where the previous one ends
+            size_t wordEnd;
+            size_t end;
+            float wordWidth;
+            float spaceWidth;
+        };
+
+        struct Line {
+            size_t start;
+            size_t end;
+            float width;
+        };
+
+        struct Paragraph {
+            std::string text;
+            std::vector<Segment> segments;
+            std::vector<Line> lines;
+
+            // Width of the paragraph on a single line
+            float naturalWidth = 0.0f;
+
+            // Index of the first line of the paragraph in the layout
+            size_t firstLine = 0;
+
+            bool measured = false;
+            bool broken = false;
+        };
+
+        void replace(size_t first, size_t count, const std::vector<std::string_view>& texts);
+        void markDirty(size_t begin, size_t end);
+        float measureRange(Painter& painter, const std::string& text, size_t start, size_t end);
+        void measure(Painter& painter, Paragraph& para);
+        void breakLines(Paragraph& para);
+        size_t findParagraph(size_t line) const;
+        float getLineX(const Line& line) const;
+
+        Font font;
+        float width;
+        HRef align;
+        std::vector<Paragraph> paragraphs;
+
+        // Paragraphs that may need to be measured or broken again, and the first one whose lines may have moved
+        size_t dirtyBegin = 0;
+        size_t dirtyEnd = 0;
+        size_t movedFrom = SIZE_MAX;
+
+        // Metrics of the font, measured again after it changes
+        bool metricsValid = false;
+        float lineHeight = 0.0f;
+        float spaceWidth = 0.0f;
+
+        size_t lineCount = 0;
+        std::string scratch;
+    };
+}
\ No newline at end of file
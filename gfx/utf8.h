@@ -0,0 +1,182 @@
+#pragma once
+#include <stddef.h>
+
+// SIMD instructions available on all processors of the architecture are used to convert ASCII runs
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GFX_UTF8_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define GFX_UTF8_NEON
+#endif
+
+// Codepoint decoded in place of invalid sequences
+#define GFX_UTF8_REPLACEMENT    0xFFFD
+
+namespace gfx {
+    /**
+     * Decode one UTF-8 sequence, validating it. Invalid sequences decode as GFX_UTF8_REPLACEMENT, one per maximal
+     * subpart as recommended by the Unicode standard, so that a bad byte never swallows the valid characters after it.
+     * @param str Start of the sequence.
+     * @param end End of the string. Reading also stops at any byte that can't continue the sequence, like a null terminator.
+     * @param next Set to the start of the next sequence.
+     * @return Unicode ID of the codepoint.
+    */
+    inline int decodeSequence(const unsigned char* str, const unsigned char* end, const unsigned char*& next) {
+        // Get the number of continuation bytes and their valid range from the lead byte.
+        // The ranges of the first continuation byte exclude overlong forms, surrogates and codepoints past U+10FFFF.
+        unsigned char c = *str;
+        int count;
+        int id;
+        unsigned char lo = 0x80;
+        unsigned char hi = 0xBF;
+        if (c < 0x80) {
+            next = str + 1;
+            return c;
+        }
+        else if (c >= 0xC2 && c <= 0xDF) {
+            count = 1;
+            id = c & 0b11111;
+        }
+        else if (c >= 0xE0 && c <= 0xEF) {
+            count = 2;
+            id = c & 0b1111;
+            if (c == 0xE0) { lo = 0xA0; }
+            else if (c == 0xED) { hi = 0x9F; }
+        }
+        else if (c >= 0xF0 && c <= 0xF4) {
+            count = 3;
+            id = c & 0b111;
+            if (c == 0xF0) { lo = 0x90; }
+            else if (c == 0xF4) { hi = 0x8F; }
+        }
+        else {
+            next = str + 1;
+            return GFX_UTF8_REPLACEMENT;
+        }
+
+        // Add the bits of the continuation bytes, stopping at the first one that isn't valid
+        const unsigned char* p = str + 1;
+        for (int i = 0; i < count; i++, p++) {
+            if (p >= end || *p < lo || *p > hi) {
+                next = p;
+                return GFX_UTF8_REPLACEMENT;
+            }
+            id = (id << 6) | (*p & 0b111111);
+            lo = 0x80;
+            hi = 0xBF;
+        }
+        next = p;
+        return id;
+    }
+
+    /**
+     * Decode a whole UTF-8 string into unicode IDs. Runs of ASCII are converted 16 bytes at a time with SIMD instructions,
+     * other characters are validated and decoded one by one. Invalid sequences decode as GFX_UTF8_REPLACEMENT.
+     * @param str String to decode.
+     * @param len Length of the string in bytes.
+     * @param out Buffer receiving the unicode IDs. Must have room for len IDs.
+     * @return Number of decoded unicode IDs.
+    */
+    inline size_t decodeUTF8(const char* str, size_t len, int* out) {
+        const unsigned char* s = (const unsigned char*)str;
+        const unsigned char* end = s + len;
+        int* o = out;
+        while (s < end) {
+            // Convert blocks of 16 bytes at once as long as they're pure ASCII
+            const unsigned char* blockEnd = s;
+#if defined(GFX_UTF8_SSE2)
+            for (; end - s >= 16; s += 16, o += 16) {
+                __m128i bytes = _mm_loadu_si128((const __m128i*)s);
+                if (_mm_movemask_epi8(bytes)) { break; }
+                __m128i zero = _mm_setzero_si128();
+                __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+                __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+                _mm_storeu_si128((__m128i*)o, _mm_unpacklo_epi16(lo, zero));
+                _mm_storeu_si128((__m128i*)(o + 4), _mm_unpackhi_epi16(lo, zero));
+                _mm_storeu_si128((__m128i*)(o + 8), _mm_unpacklo_epi16(hi, zero));
+                _mm_storeu_si128((__m128i*)(o + 12), _mm_unpackhi_epi16(hi, zero));
+            }
+            blockEnd = s + 16;
+#elif defined(GFX_UTF8_NEON)
+            for (; end - s >= 16; s += 16, o += 16) {
+                uint8x16_t bytes = vld1q_u8(s);
+                if (vmaxvq_u8(bytes) >= 0x80) { break; }
+                uint16x8_t lo = vmovl_u8(vget_low_u8(bytes));
+                uint16x8_t hi = vmovl_u8(vget_high_u8(bytes));
+                vst1q_s32(o, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lo))));
+                vst1q_s32(o + 4, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lo))));
+                vst1q_s32(o + 8, vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(hi))));
+                vst1q_s32(o + 12, vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(hi))));
+            }
+            blockEnd = s + 16;
+#endif
+
+            // Decode the block that wasn't pure ASCII, or the tail of the string, one character at a time
+            if (blockEnd > end || blockEnd == s) { blockEnd = end; }
+            while (s < blockEnd) {
+                if (*s < 0x80) {
+                    *o++ = *s++;
+                }
+                else {
+                    *o++ = decodeSequence(s, end, s);
+                }
+            }
+        }
+        return o - out;
+    }
+
+    /**
+     * Decode the next unicode codepoint from a null terminated UTF-8 string and advance the pointer past it.
+     * Invalid sequences decode as GFX_UTF8_REPLACEMENT.
+     * @param str Pointer to the string. Updated to point after the decoded codepoint, unless the end was reached.
+     * @return Unicode ID of the codepoint or zero if the end of the string was reached.
+    */
+    inline int getCodepoint(const char*& str) {
+        // Stop at the null terminator
+        const unsigned char* s = (const unsigned char*)str;
+        if (!*s) { return 0; }
+
+        // A sequence is at most 4 bytes long, and reading stops at the terminator since it can't continue one
+        int id = decodeSequence(s, s + 4, s);
+        str = (const char*)s;
+        return id;
+    }
+
+    /**
+     * Encode a unicode codepoint to UTF-8.
+     * @param codepoint Unicode ID of the codepoint. Invalid IDs are encoded as GFX_UTF8_REPLACEMENT.
+     * @param str Buffer receiving the null terminated sequence, must have room for 5 bytes.
+     * @return Length of the sequence in bytes.
+    */
+    inline int encodeUTF8(int codepoint, char* str) {
+        // Replace surrogates and IDs outside of the unicode range
+        if (codepoint < 0 || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+            codepoint = GFX_UTF8_REPLACEMENT;
+        }
+
+        // Write the lead byte and the continuation bytes
+        int len;
+        if (codepoint < 0x80) {
+            str[0] = (char)codepoint;
+            len = 1;
+        }
+        else if (codepoint < 0x800) {
+            str[0] = (char)(0xC0 | (codepoint >> 6));
+            len = 2;
+        }
+        else if (codepoint < 0x10000) {
+            str[0] = (char)(0xE0 | (codepoint >> 12));
+            len = 3;
+        }
+        else {
+            str[0] = (char)(0xF0 | (codepoint >> 18));
+            len = 4;
+        }
+        for (int i = 1; i < len; i++) {
+            str[i] = (char)(0x80 | ((codepoint >> (6 * (len - 1 - i))) & 0b111111));
+        }
+        str[len] = 0;
+        return len;
+    }
+}
\ No newline at end of file
@@ -15,7 +15,7 @@
 #define M_PI 3.141592653589793238462643383279502884197
 #endif
 
-void drawButton(gfx::Painter& painter, gfx::Font& font, gfx::Point pos, gfx::HRef href, gfx::VRef vref) {
+void drawButton(gfx::Painter& painter, const gfx::Font& font, gfx::Point pos, gfx::HRef href, gfx::VRef vref) {
     // TODO: Figure out why the +1 is required for it to look correct...
     // TODO: Change rect to use .A() and .B() for conciseness
     // TODO: Use float as default to remove f suffix
@@ -186,9 +186,6 @@ int main() {
             while (counter > M_PI) { counter -= 2.0*M_PI; }
             while (counter < -M_PI) { counter += 2.0*M_PI; }
 
-            // TODO: Workaround for buggy behavior
-            painter.fc->atlas.pushTexture();
-
             // Finish the render
             painter.endRender();
 